@@ -0,0 +1,124 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "bench.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> allocated_bytes(0);
+
+void* operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+uint64_t allocationCount() {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+
+uint64_t allocatedBytes() {
+  return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+void BenchState::pause() {
+  paused_at = std::chrono::steady_clock::now();
+  paused_allocations = allocationCount();
+  paused_bytes = allocatedBytes();
+}
+
+void BenchState::resume() {
+  excluded_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - paused_at).count();
+  excluded_allocations += allocationCount() - paused_allocations;
+  excluded_bytes += allocatedBytes() - paused_bytes;
+}
+
+BenchRunner::BenchRunner(const std::string& filter, int64_t min_time_ms)
+    : filter(filter), min_time_ns(min_time_ms * 1000000) {}
+
+void BenchRunner::run(const std::string& name, std::function<void(BenchState&)> body, uint64_t ops_limit) {
+  if (!filter.empty() && name.find(filter) == std::string::npos) {
+    return;
+  }
+
+  uint64_t ops = 1;
+  while (true) {
+    BenchState state(ops);
+
+    uint64_t start_allocations = allocationCount();
+    uint64_t start_bytes = allocatedBytes();
+    auto start = std::chrono::steady_clock::now();
+    body(state);
+    auto end = std::chrono::steady_clock::now();
+
+    int64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() - state.excluded_ns;
+    uint64_t allocations = allocationCount() - start_allocations - state.excluded_allocations;
+    uint64_t bytes = allocatedBytes() - start_bytes - state.excluded_bytes;
+
+    if (elapsed_ns >= min_time_ns || ops >= ops_limit) {
+      BenchResult result{name, ops, (double)elapsed_ns / ops, (double)allocations / ops, (double)bytes / ops};
+      results.push_back(result);
+      printf("%-40s %12lu ops %14.1f ns/op %10.2f allocs/op %12.1f B/op\n", name.c_str(), ops,
+             result.ns_per_op, result.allocations_per_op, result.bytes_per_op);
+      fflush(stdout);
+      return;
+    }
+
+    // Aim directly for the minimum time, but grow at most by 10x per run
+    uint64_t next = elapsed_ns > 0 ? (uint64_t)(ops * 1.2 * min_time_ns / elapsed_ns) : ops * 10;
+    ops = std::min(std::max(ops * 2, std::min(next, ops * 10)), ops_limit);
+  }
+}
+
+bool BenchRunner::writeJson(const std::string& path, const std::string& context) const {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+
+  fprintf(file, "{\n  \"context\": %s,\n  \"benchmarks\": [\n", context.c_str());
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& result = results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.3f, \"allocations_per_op\": %.4f, "
+            "\"bytes_per_op\": %.2f}%s\n",
+            result.name.c_str(), result.ops, result.ns_per_op, result.allocations_per_op, result.bytes_per_op,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,77 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Number of heap allocations and allocated bytes since program start, counted
+// by the global operator new of the benchmark binary
+uint64_t allocationCount();
+uint64_t allocatedBytes();
+
+// Passed to every benchmark run, excludes setup work from the measurement
+class BenchState {
+ private:
+  std::chrono::steady_clock::time_point paused_at;
+  uint64_t paused_allocations;
+  uint64_t paused_bytes;
+
+ public:
+  // Number of operations the run has to perform
+  uint64_t ops;
+
+  int64_t excluded_ns = 0;
+  uint64_t excluded_allocations = 0;
+  uint64_t excluded_bytes = 0;
+
+  BenchState(uint64_t ops) : ops(ops) {}
+
+  void pause();
+  void resume();
+};
+
+struct BenchResult {
+  std::string name;
+  uint64_t ops;
+  double ns_per_op;
+  double allocations_per_op;
+  double bytes_per_op;
+};
+
+/*
+  Minimal benchmark runner. Every benchmark performs state.ops operations per
+  run; the runner doubles the count until a run takes at least min_time_ms and
+  reports the last run.
+*/
+class BenchRunner {
+ private:
+  std::string filter;
+  int64_t min_time_ns;
+  std::vector<BenchResult> results;
+
+ public:
+  BenchRunner(const std::string& filter, int64_t min_time_ms);
+
+  // `ops_limit` caps the operations per run for benchmarks with bounded state
+  void run(const std::string& name, std::function<void(BenchState&)> body, uint64_t ops_limit = UINT64_MAX);
+
+  const std::vector<BenchResult>& getResults() const { return results; }
+  bool writeJson(const std::string& path, const std::string& context) const;
+};
+
+// Keeps the compiler from optimizing away benchmarked computations
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
@@ -0,0 +1,719 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "bench.hpp"
+#include "../counter_widener.hpp"
+#include "../flow_manager.hpp"
+#include "../flow_readout.hpp"
+#include "../flow_state_store.hpp"
+#include "../flow_table.hpp"
+#include "../instrumentation.hpp"
+#include "../measurement_log.hpp"
+#include "../measurement_output.hpp"
+#include "../mirror_report.hpp"
+#include "../output_pipeline.hpp"
+#include "../rtt_change.hpp"
+#include "../rtt_filters.hpp"
+#include "../rtt_sketch.hpp"
+#include "../sim_backend.hpp"
+#include "../spsc_ring.hpp"
+#include "../tofino_switch_control.hpp"
+
+// Flows of the readout and output benchmarks, the default simulator size
+#define BENCH_FLOWS 4096
+// Bound of stress/readout_cycle_programming as a multiple of stress/readout_cycle_idle
+#define STRESS_MAX_CYCLE_SLOWDOWN 2.0
+
+static FlowTuple benchTuple(uint32_t flow_id) {
+  return FlowTuple{0x0A000000 | flow_id, 0x0A010001, (uint16_t)(10000 + (flow_id & 0x7FFF)), 443};
+}
+
+// Spin bit control plane on a simulated data plane without access latencies
+struct SimSetup {
+  SimBackend backend;
+  TofinoSwitchControl tsc;
+  FlowTable flows;
+
+  SimSetup(bool spinbit_enabled = true) : backend(SimConfig()), tsc(&backend, "", spinbit_enabled, 0) {
+    tsc.initializeDataplaneInterfaces();
+    for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+      flows.add(flow_id, benchTuple(flow_id));
+    }
+  }
+
+  // Two packets with opposite spin bits per flow, i.e., one measurement each,
+  // on pipe 0 or spread over all pipes
+  void measureAll(uint16_t time, bool all_pipes = false) {
+    for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+      uint32_t pipe = all_pipes ? flow_id % backend.pipeCount() : 0;
+      backend.processPacket(pipe, flow_id, 1, time);
+      backend.processPacket(pipe, flow_id, 0, time + 20);
+    }
+  }
+};
+
+static FlowSample benchSample(uint32_t flow_id) {
+  FlowSample sample = {};
+  sample.flow_id = flow_id;
+  sample.measurement_count = flow_id & 0xFF;
+  sample.rtt = 20 + (flow_id & 0x0F);
+  sample.rtt_accumulator = 4 * sample.rtt;
+  sample.raw_timestamp = flow_id * 7;
+  for (uint32_t rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    sample.class_current[rtt_class] = flow_id + rtt_class;
+    sample.class_sum[rtt_class] = flow_id * rtt_class;
+  }
+  sample.measurement_total = flow_id * 3;
+  return sample;
+}
+
+static void registerBenchmarks(BenchRunner& runner) {
+  runner.run("register/read", [](BenchState& state) {
+    state.pause();
+    SimSetup setup;
+    state.resume();
+
+    TofinoRegister* reg = setup.tsc.spin_measurement_register;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      doNotOptimize(reg->read(i % BENCH_FLOWS, 0));
+    }
+  });
+
+  runner.run("register/snapshot_4096", [](BenchState& state) {
+    state.pause();
+    SimSetup setup;
+    std::vector<uint64_t> values(BENCH_FLOWS);
+    TofinoRegister* reg = setup.tsc.spin_measurement_register;
+    reg->reserveSnapshot(BENCH_FLOWS);
+    state.resume();
+
+    for (uint64_t i = 0; i < state.ops; i++) {
+      reg->snapshot(0, BENCH_FLOWS, 0, values.data());
+    }
+    doNotOptimize(values[0]);
+  });
+}
+
+static void tableBenchmarks(BenchRunner& runner) {
+  runner.run("tables/rtt_class_set_entry", [](BenchState& state) {
+    std::unique_ptr<SimSetup> setup;
+
+    // The table holds RTT_CLASS_TABLE_SIZE entries, start over with an empty one in between
+    const uint64_t entries_per_table = 512;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      if (i % entries_per_table == 0) {
+        state.pause();
+        setup.reset(new SimSetup(false));
+        state.resume();
+      }
+      uint16_t base = (i % entries_per_table) * 100;
+      setup->tsc.RTTClassTableSetEntry(4 * base, 4 * base + 399, base, base + 99, i % NUM_RTT_CLASSES);
+    }
+  });
+
+  // One op is one entry of the new plan, every swap reclassifies all ranges
+  runner.run("tables/rtt_class_plan_swap_1000", [](BenchState& state) {
+    state.pause();
+    SimSetup setup(false);
+    std::vector<rtt_class_range> plans[2];
+    for (uint32_t i = 0; i < RTT_CLASS_TABLE_SIZE; i++) {
+      uint16_t base = i * 60;
+      plans[0].push_back(rtt_class_range{(uint16_t)(4 * base), (uint16_t)(4 * base + 239), base, (uint16_t)(base + 59), (uint8_t)(i % NUM_RTT_CLASSES)});
+      plans[1].push_back(plans[0].back());
+      plans[1].back().rtt_class = (i + 1) % NUM_RTT_CLASSES;
+    }
+    setup.tsc.applyRTTClassPlan(plans[0]);
+    state.resume();
+
+    for (uint64_t done = 0, swap = 1; done < state.ops; done += RTT_CLASS_TABLE_SIZE, swap++) {
+      setup.tsc.applyRTTClassPlan(plans[swap % 2]);
+    }
+  });
+
+  runner.run("tables/flow_insert_batch_1024", [](BenchState& state) {
+    state.pause();
+    SimSetup setup(false);
+    std::vector<flow_entry> entries(1024);
+    std::vector<FlowTuple> tuples(1024);
+    for (uint32_t i = 0; i < entries.size(); i++) {
+      entries[i] = flow_entry{benchTuple(i), i};
+      tuples[i] = entries[i].tuple;
+    }
+    state.resume();
+
+    // One op is one installed entry
+    for (uint64_t done = 0; done < state.ops; done += entries.size()) {
+      setup.tsc.tables->flowTableAddEntries(entries.data(), entries.size());
+
+      state.pause();
+      setup.tsc.tables->flowTableDeleteEntries(tuples.data(), tuples.size());
+      state.resume();
+    }
+  });
+
+  // One op is one recycled flow; 9000 consecutive and 1000 scattered ids per transaction
+  runner.run("tables/recycle_flows_10000", [](BenchState& state) {
+    state.pause();
+    SimConfig config;
+    config.num_flows = 32768;
+    SimBackend backend(config);
+    TofinoSwitchControl tsc(&backend, "", true, 0);
+    tsc.initializeDataplaneInterfaces();
+    std::vector<uint32_t> flow_ids;
+    for (uint32_t i = 0; i < 10000; i++) {
+      flow_ids.push_back(i < 9000 ? i : 16384 + (i - 9000) * 8);
+    }
+    state.resume();
+
+    for (uint64_t done = 0; done < state.ops; done += flow_ids.size()) {
+      tsc.tables->recycleFlows(flow_ids.data(), flow_ids.size());
+    }
+  });
+
+  // One op is one recycled flow, the highest id of flow_id_v4. Its ring buffer
+  // slot lies beyond the register, the simulator aborts on out-of-range writes.
+  runner.run("tables/recycle_highest_flow", [](BenchState& state) {
+    state.pause();
+    SimConfig config;
+    SimBackend backend(config);
+    TofinoSwitchControl tsc(&backend, "", true, 0);
+    tsc.initializeDataplaneInterfaces();
+    uint32_t flow_id = tsc.tables->flowTableSize() - 1;
+    state.resume();
+
+    for (uint64_t i = 0; i < state.ops; i++) {
+      tsc.tables->recycleFlows(&flow_id, 1);
+    }
+  });
+}
+
+static void flowManagerBenchmarks(BenchRunner& runner) {
+  // One op is one flow added and later removed through the manager: id allocation,
+  // batching on the programming thread, flow_id_v4 batches and register recycling
+  runner.run("flow_manager/add_remove_1024", [](BenchState& state) {
+    state.pause();
+    SimSetup setup(false);
+    FlowTable flows;
+    FlowManager manager(setup.tsc.tables, &flows, setup.tsc.tables->flowTableSize());
+    manager.start();
+    std::vector<FlowTuple> tuples(1024);
+    for (uint32_t i = 0; i < tuples.size(); i++) {
+      tuples[i] = benchTuple(i);
+    }
+    state.resume();
+
+    uint32_t flow_id;
+    for (uint64_t done = 0; done < state.ops; done += tuples.size()) {
+      for (auto& tuple : tuples) {
+        manager.addFlow(tuple, &flow_id);
+      }
+      manager.flush();
+      for (auto& tuple : tuples) {
+        manager.removeFlow(tuple);
+      }
+      manager.flush();
+    }
+
+    state.pause();
+    manager.stop();
+    state.resume();
+  });
+}
+
+static void readoutBenchmarks(BenchRunner& runner) {
+  // One op is the readout of one flow, including the class counter accumulation.
+  // Every cycle sees new measurements, counters wrap every 256 cycles.
+  runner.run("readout/flow_cycle_4096", [](BenchState& state) {
+    state.pause();
+    SimSetup setup;
+    FlowReadout readout(&setup.tsc, &setup.flows, 0);
+    state.resume();
+
+    uint16_t time = 0;
+    for (uint64_t done = 0; done < state.ops; done += BENCH_FLOWS) {
+      state.pause();
+      setup.measureAll(time);
+      time += 40;
+      state.resume();
+
+      readout.readout();
+      doNotOptimize(readout.samples().data());
+    }
+  });
+
+  // The same gets keeping all pipes, flows spread over the pipes
+  runner.run("readout/flow_cycle_4096_all_pipes", [](BenchState& state) {
+    state.pause();
+    SimSetup setup;
+    FlowReadout readout(&setup.tsc, &setup.flows, READOUT_ALL_PIPES);
+    state.resume();
+
+    uint16_t time = 0;
+    for (uint64_t done = 0; done < state.ops; done += BENCH_FLOWS) {
+      state.pause();
+      setup.measureAll(time, true);
+      time += 40;
+      state.resume();
+
+      readout.readout();
+      doNotOptimize(readout.samples().data());
+    }
+  });
+
+  // Readout tiers with every 16th flow measuring each cycle and the others idle,
+  // one op is still one flow of a cycle
+  runner.run("readout/tiered_cycle_4096", [](BenchState& state) {
+    state.pause();
+    SimSetup setup;
+    FlowReadout readout(&setup.tsc, &setup.flows, 0);
+    readout.enableTiers(ReadoutTierConfig());
+    state.resume();
+
+    uint16_t time = 0;
+    for (uint64_t done = 0; done < state.ops; done += BENCH_FLOWS) {
+      state.pause();
+      for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id += 16) {
+        setup.backend.processPacket(0, flow_id, 1, time);
+        setup.backend.processPacket(0, flow_id, 0, time + 20);
+      }
+      time += 40;
+      state.resume();
+
+      readout.readout();
+      doNotOptimize(readout.samples().data());
+    }
+  });
+}
+
+static void counterBenchmarks(BenchRunner& runner) {
+  // One op is one widened counter, all class counters of 2^18 flows per update
+  runner.run("counters/widen_class_counters", [](BenchState& state) {
+    state.pause();
+    const size_t counters = (size_t)MAX_FLOW_IDS * NUM_RTT_CLASSES;
+    CounterWidener widener(counters, RTT_CLASS_COUNTER_BITS);
+    std::vector<uint64_t> snapshot(counters);
+    state.resume();
+
+    for (uint64_t done = 0, round = 0; done < state.ops; done += counters, round++) {
+      state.pause();
+      for (size_t i = 0; i < counters; i++) {
+        snapshot[i] = (i + round * 37) & 0xFF;
+      }
+      state.resume();
+
+      widener.update(0, snapshot.data(), counters);
+    }
+    doNotOptimize(widener.total(0));
+  });
+}
+
+static void reportBenchmarks(BenchRunner& runner) {
+  runner.run("reports/decode", [](BenchState& state) {
+    state.pause();
+    std::vector<uint8_t> buffer(BENCH_FLOWS * MIRROR_REPORT_SIZE);
+    for (uint32_t i = 0; i < BENCH_FLOWS; i++) {
+      MirrorReport report{i, (uint8_t)i, (uint16_t)(i * 3), 20, 80, (uint8_t)(i >> 3), (uint8_t)(i & 7)};
+      encodeMirrorReport(report, buffer.data() + i * MIRROR_REPORT_SIZE);
+    }
+    state.resume();
+
+    MirrorReport report;
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      const uint8_t* data = buffer.data() + (i % BENCH_FLOWS) * MIRROR_REPORT_SIZE;
+      if (isMirrorReport(data, MIRROR_REPORT_SIZE)) {
+        decodeMirrorReport(data, &report);
+        checksum += report.flow_id + report.current_rtt;
+      }
+    }
+    doNotOptimize(checksum);
+  });
+}
+
+static void outputBenchmarks(BenchRunner& runner) {
+  for (const char* format : {"csv", "binary"}) {
+    runner.run(std::string("output/") + format + "_flow_sample", [format](BenchState& state) {
+      state.pause();
+      FlowTable flows;
+      for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+        flows.add(flow_id, benchTuple(flow_id));
+      }
+      std::unique_ptr<MeasurementOutput> output(MeasurementOutput::create(format, "/dev/null", &flows, false));
+      std::vector<FlowSample> samples;
+      for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+        samples.push_back(benchSample(flow_id));
+      }
+      state.resume();
+
+      // One commit per readout cycle of BENCH_FLOWS samples
+      int64_t timestamp_ns = monotonicNanoseconds();
+      for (uint64_t i = 0; i < state.ops; i++) {
+        output->writeFlowSample(timestamp_ns, samples[i % BENCH_FLOWS]);
+        if (i % BENCH_FLOWS == BENCH_FLOWS - 1) {
+          output->commit();
+          timestamp_ns += 1000000;
+        }
+      }
+
+      state.pause();
+      output->close();
+      state.resume();
+    });
+
+    runner.run(std::string("output/") + format + "_report", [format](BenchState& state) {
+      state.pause();
+      FlowTable flows;
+      std::unique_ptr<MeasurementOutput> output(MeasurementOutput::create(format, "/dev/null", &flows, true));
+      state.resume();
+
+      MirrorReport report{0, 0, 0, 20, 80, 0, 1};
+      int64_t timestamp_ns = monotonicNanoseconds();
+      for (uint64_t i = 0; i < state.ops; i++) {
+        report.flow_id = i % BENCH_FLOWS;
+        output->writeReport(timestamp_ns + i, report);
+      }
+      output->commit();
+
+      state.pause();
+      output->close();
+      state.resume();
+    });
+  }
+
+  // CSV behind the change detector, every 16th flow measures in a cycle and 1 in 8 of those shifts its RTT
+  runner.run("output/csv_change_events", [](BenchState& state) {
+    state.pause();
+    FlowTable flows;
+    for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+      flows.add(flow_id, benchTuple(flow_id));
+    }
+    EventOutput output(MeasurementOutput::create("csv", "/dev/null", &flows, false), EventMode::CHANGE,
+                       RttChangeConfig());
+    std::vector<FlowSample> samples;
+    for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+      samples.push_back(benchSample(flow_id));
+    }
+    state.resume();
+
+    int64_t timestamp_ns = monotonicNanoseconds();
+    for (uint64_t i = 0; i < state.ops; i++) {
+      uint32_t flow_id = i % BENCH_FLOWS;
+      uint64_t cycle = i / BENCH_FLOWS;
+      FlowSample& sample = samples[flow_id];
+      if (flow_id % 16 == cycle % 16) {
+        sample.measurement_total++;
+        sample.rtt = (flow_id % 128 == cycle % 128 ? 40 : 20) + (cycle & 1);
+      }
+      output.writeFlowSample(timestamp_ns, sample);
+      if (flow_id == BENCH_FLOWS - 1) {
+        output.commit();
+        timestamp_ns += 1000000;
+      }
+    }
+
+    state.pause();
+    output.close();
+    state.resume();
+  });
+
+  runner.run("output/ring_push_pop", [](BenchState& state) {
+    state.pause();
+    SpscRing<OutputRecord> ring(1 << 12);
+    std::vector<OutputRecord> batch(256);
+    state.resume();
+
+    OutputRecord record = {};
+    record.kind = OUTPUT_FLOW_SAMPLE;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      record.timestamp_ns = i;
+      if (!ring.push(record)) {
+        ring.popBatch(batch.data(), batch.size());
+        ring.push(record);
+      }
+    }
+    doNotOptimize(batch[0]);
+  });
+}
+
+static void sketchBenchmarks(BenchRunner& runner) {
+  runner.run("sketch/record", [](BenchState& state) {
+    state.pause();
+    RttSketchStore store(BENCH_FLOWS, MAX_FLOW_IDS, 6, 1000000);
+    int64_t start_ns = monotonicNanoseconds();
+    state.resume();
+
+    // A new epoch every 2^20 samples
+    for (uint64_t i = 0; i < state.ops; i++) {
+      store.record(i % BENCH_FLOWS, (uint16_t)(20 + (i * 7919) % 400), start_ns + (int64_t)i);
+    }
+    doNotOptimize(store.flows().size());
+  });
+
+  // One op merges the window and lifetime histograms of a flow and reads four quantiles
+  runner.run("sketch/window_query", [](BenchState& state) {
+    state.pause();
+    RttSketchStore store(BENCH_FLOWS, MAX_FLOW_IDS, 6, 64);
+    int64_t start_ns = monotonicNanoseconds();
+    // 64 samples per flow spread over 16 epochs
+    for (uint64_t i = 0; i < 64 * BENCH_FLOWS; i++) {
+      store.record(i % BENCH_FLOWS, (uint16_t)(20 + (i * 7919) % 400), start_ns + (int64_t)(i / 256));
+    }
+    int64_t now_ns = start_ns + 64 * BENCH_FLOWS / 256;
+    state.resume();
+
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      RttHistogram window, lifetime;
+      store.window(i % BENCH_FLOWS, now_ns, &window);
+      store.lifetime(i % BENCH_FLOWS, &lifetime);
+      checksum += window.quantile(0.5) + window.quantile(0.99) + lifetime.quantile(0.9) + lifetime.quantile(0.999);
+    }
+    doNotOptimize(checksum);
+  });
+}
+
+static void filterBenchmarks(BenchRunner& runner) {
+  // One op is one sample; pseudo-random RTTs keep the minimum deques partly filled,
+  // the window slides every 2^17 samples
+  runner.run("filters/record", [](BenchState& state) {
+    state.pause();
+    RttFilterConfig config;
+    config.min_window_ns = RTT_MIN_WINDOW_SLOTS << 17;
+    RttFilterStore store(MAX_FLOW_IDS, config);
+    int64_t start_ns = monotonicNanoseconds();
+    state.resume();
+
+    for (uint64_t i = 0; i < state.ops; i++) {
+      store.record(i % BENCH_FLOWS, (uint16_t)(20 + (i * 7919) % 400), start_ns + (int64_t)i);
+    }
+
+    state.pause();
+    RttFilterValues values;
+    store.values(0, start_ns + (int64_t)state.ops, &values);
+    doNotOptimize(values.min_rtt);
+    state.resume();
+  });
+}
+
+static void flowStateBenchmarks(BenchRunner& runner) {
+  // BENCH_FLOWS active flows spread over the whole flow id space
+  const uint32_t stride = MAX_FLOW_IDS / BENCH_FLOWS;
+
+  runner.run("flow_state/update", [stride](BenchState& state) {
+    state.pause();
+    FlowStateStore store;
+    state.resume();
+
+    for (uint64_t i = 0; i < state.ops; i++) {
+      uint32_t flow_id = (uint32_t)(i % BENCH_FLOWS) * stride;
+      FlowHotState& hot = store.activate(flow_id);
+      hot.updated_ns = (int64_t)i;
+      hot.measurement_total++;
+      hot.rtt = (uint16_t)i;
+      store.classTotals(flow_id)[i % NUM_RTT_CLASSES]++;
+    }
+    doNotOptimize(store.activeCount());
+  });
+
+  // One op visits all active flows
+  runner.run("flow_state/scan_active_4096", [stride](BenchState& state) {
+    state.pause();
+    FlowStateStore store;
+    for (uint32_t i = 0; i < BENCH_FLOWS; i++) {
+      store.activate(i * stride).rtt = (uint16_t)i;
+    }
+    state.resume();
+
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      store.forEachActive([&](uint32_t flow_id) { checksum += store.hotState(flow_id).rtt; });
+    }
+    doNotOptimize(checksum);
+  });
+}
+
+// Readout cycles of BENCH_FLOWS flows with BfRt-like latencies while another
+// thread, like the flow manager and the control socket, installs and removes
+// 1024 flows, recycles their registers and swaps the class plan in a loop.
+// One op is one readout cycle; allocations include those of the programming thread.
+static void readoutUnderProgramming(BenchState& state, bool programming, bool shared_session) {
+  state.pause();
+  SimConfig config = SimConfig::tofino();
+  config.num_flows = BENCH_FLOWS;
+  SimBackend backend(config);
+  TofinoSwitchControl tsc(&backend, "", true, 0, shared_session);
+  tsc.initializeDataplaneInterfaces();
+  FlowTable flows;
+  for (uint32_t flow_id = 0; flow_id < BENCH_FLOWS; flow_id++) {
+    flows.add(flow_id, benchTuple(flow_id));
+  }
+  FlowReadout readout(&tsc, &flows, 0);
+
+  std::vector<flow_entry> entries(1024);
+  std::vector<FlowTuple> tuples(entries.size());
+  std::vector<uint32_t> flow_ids(entries.size());
+  for (uint32_t i = 0; i < entries.size(); i++) {
+    entries[i] = flow_entry{benchTuple(i), i};
+    tuples[i] = entries[i].tuple;
+    flow_ids[i] = i;
+  }
+  std::vector<rtt_class_range> plans[2];
+  for (uint32_t i = 0; i < 64; i++) {
+    uint16_t base = i * 60;
+    plans[0].push_back(rtt_class_range{(uint16_t)(4 * base), (uint16_t)(4 * base + 239), base, (uint16_t)(base + 59), (uint8_t)(i % NUM_RTT_CLASSES)});
+    plans[1].push_back(plans[0].back());
+    plans[1].back().rtt_class = (i + 1) % NUM_RTT_CLASSES;
+  }
+
+  std::atomic<bool> running(programming);
+  std::thread programmer;
+  if (programming) {
+    programmer = std::thread([&] {
+      for (uint64_t round = 0; running.load(std::memory_order_relaxed); round++) {
+        tsc.tables->flowTableAddEntries(entries.data(), entries.size());
+        tsc.tables->flowTableDeleteEntries(tuples.data(), tuples.size());
+        tsc.tables->recycleFlows(flow_ids.data(), flow_ids.size());
+        tsc.applyRTTClassPlan(plans[round % 2]);
+      }
+    });
+  }
+  state.resume();
+
+  for (uint64_t i = 0; i < state.ops; i++) {
+    readout.readout();
+    doNotOptimize(readout.samples().data());
+  }
+
+  state.pause();
+  running = false;
+  if (programmer.joinable()) {
+    programmer.join();
+  }
+  state.resume();
+}
+
+static const BenchResult* findResult(const BenchRunner& runner, const std::string& name) {
+  for (const BenchResult& result : runner.getResults()) {
+    if (result.name == name) {
+      return &result;
+    }
+  }
+  return nullptr;
+}
+
+// Returns false if bulk programming slows the readout cycle beyond the bound
+static bool stressBenchmarks(BenchRunner& runner) {
+  runner.run("stress/readout_cycle_idle", [](BenchState& state) { readoutUnderProgramming(state, false, false); });
+  // Both paths on one session, the readout queues behind batches and transactions
+  runner.run("stress/readout_cycle_programming_shared_session",
+             [](BenchState& state) { readoutUnderProgramming(state, true, true); });
+  // Separate readout and programming sessions, the cycle should stay close to idle
+  runner.run("stress/readout_cycle_programming",
+             [](BenchState& state) { readoutUnderProgramming(state, true, false); });
+
+  // Only checked if both entries ran
+  const BenchResult* idle = findResult(runner, "stress/readout_cycle_idle");
+  const BenchResult* programming = findResult(runner, "stress/readout_cycle_programming");
+  if (idle == nullptr || programming == nullptr) {
+    return true;
+  }
+  double slowdown = programming->ns_per_op / idle->ns_per_op;
+  if (slowdown > STRESS_MAX_CYCLE_SLOWDOWN) {
+    fprintf(stderr, "FAILED: the readout cycle under programming takes %.2fx the idle cycle, at most %.2fx allowed\n",
+            slowdown, STRESS_MAX_CYCLE_SLOWDOWN);
+    return false;
+  }
+  return true;
+}
+
+static void probeBenchmarks(BenchRunner& runner) {
+  // One op is one timed scope, nearly free unless built with -DWITH_INSTRUMENTATION=ON
+  runner.run("probes/scope", [](BenchState& state) {
+    state.pause();
+    Instrumentation::calibrate();
+    state.resume();
+
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < state.ops; i++) {
+      PROBE_SCOPE(PROBE_LOOP_PUSH);
+      checksum += i;
+      doNotOptimize(checksum);
+    }
+  });
+}
+
+int main(int argc, char** argv) {
+  std::string filter;
+  std::string json_path;
+  int min_time_ms = 200;
+
+  static const struct option long_options[] = {
+      {"filter", required_argument, 0, 'f'},
+      {"json", required_argument, 0, 'j'},
+      {"min_time_ms", required_argument, 0, 't'},
+      {0, 0, 0, 0}};
+
+  while (true) {
+    const auto opt = getopt_long(argc, argv, "f:j:t:", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    }
+
+    switch (opt) {
+      case 'f':
+        filter = optarg;
+        break;
+      case 'j':
+        json_path = optarg;
+        break;
+      case 't':
+        min_time_ms = std::atoi(optarg);
+        break;
+      default:
+        std::cerr << "Usage: " << argv[0] << " [--filter SUBSTRING] [--json FILE] [--min_time_ms VAL]" << std::endl;
+        return 1;
+    }
+  }
+
+  loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+
+  BenchRunner runner(filter, min_time_ms);
+  registerBenchmarks(runner);
+  tableBenchmarks(runner);
+  flowManagerBenchmarks(runner);
+  readoutBenchmarks(runner);
+  counterBenchmarks(runner);
+  reportBenchmarks(runner);
+  outputBenchmarks(runner);
+  sketchBenchmarks(runner);
+  filterBenchmarks(runner);
+  flowStateBenchmarks(runner);
+  bool passed = stressBenchmarks(runner);
+  probeBenchmarks(runner);
+
+  if (!json_path.empty()) {
+    char context[256];
+    snprintf(context, sizeof(context), "{\"date\": %ld, \"cpus\": %ld, \"min_time_ms\": %d, \"backend\": \"sim\"}",
+             (long)time(nullptr), sysconf(_SC_NPROCESSORS_ONLN), min_time_ms);
+    if (!runner.writeJson(json_path, context)) {
+      std::cerr << "Cannot write " << json_path << std::endl;
+      return 1;
+    }
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,421 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "bfrt_backend.hpp"
+
+extern "C" {
+#include <traffic_mgr/traffic_mgr.h>
+#include <bf_pm/bf_pm_intf.h>
+#include <tofino/bf_pal/dev_intf.h>
+}
+
+void BfRtSessionHandle::beginBatch() {
+  auto bf_status = session->beginBatch();
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtSessionHandle::endBatch() {
+  auto bf_status = session->endBatch(true);
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtSessionHandle::beginTransaction() {
+  auto bf_status = session->beginTransaction(true);
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtSessionHandle::commitTransaction() {
+  auto bf_status = session->commitTransaction(true);
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtSessionHandle::abortTransaction() {
+  auto bf_status = session->abortTransaction();
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtSessionHandle::completeOperations() {
+  auto bf_status = session->sessionCompleteOperations();
+  assert(bf_status == BF_SUCCESS);
+}
+
+BfRtBackend::BfRtBackend(Switchd* switchd) : switchd(switchd) {}
+
+bfrt::BfRtSession& BfRtBackend::bfrtSession(DataplaneSession& session) {
+  return *static_cast<BfRtSessionHandle&>(session).session;
+}
+
+std::shared_ptr<DataplaneSession> BfRtBackend::createSession() {
+  auto session = bfrt::BfRtSession::sessionCreate();
+  CHECK_F(session != nullptr, "Failed to create a BfRt session");
+  return std::make_shared<BfRtSessionHandle>(session);
+}
+
+uint32_t BfRtBackend::pipeCount() {
+  uint32_t num_pipes = 0;
+  auto bf_status = bf_pal_num_pipes_get(switchd->device_target.dev_id, &num_pipes);
+  assert(bf_status == BF_SUCCESS);
+  return num_pipes;
+}
+
+dp_handle_t BfRtBackend::registerOpen(const std::string& name) {
+  bf_status_t bf_status;
+
+  std::unique_ptr<RegisterState> state(new RegisterState());
+  state->sync_done = false;
+  state->sync_session = nullptr;
+
+  char data_field[128];
+  snprintf(data_field, 128, "%s.f1", name.c_str());
+
+  bf_status = switchd->bfrtInfo->bfrtTableFromNameGet(name.c_str(), &state->table);
+  CHECK_F(bf_status == BF_SUCCESS, "Unknown register %s", name.c_str());
+
+  bf_status = state->table->keyFieldIdGet("$REGISTER_INDEX", &state->reg_index_key_id);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->dataFieldIdGet(data_field, &state->data_id);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->tableSizeGet(*switchd->session, switchd->device_target, &state->size);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->keyAllocate(&state->key);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->dataAllocate(&state->data);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->keyAllocate(&state->write_key);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->dataAllocate(&state->write_data);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state->table->operationsAllocate(TableOperationsType::REGISTER_SYNC, &state->sync_ops);
+  assert(bf_status == BF_SUCCESS);
+
+  // Room for one value per pipe
+  state->values.reserve(8);
+
+  registers.push_back(std::move(state));
+  return registers.size() - 1;
+}
+
+size_t BfRtBackend::registerSize(dp_handle_t reg) {
+  return registers.at(reg)->size;
+}
+
+uint64_t BfRtBackend::registerRead(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint32_t pipe) {
+  bf_status_t bf_status;
+  RegisterState& state = *registers[reg];
+
+  auto flag = bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_HW;
+
+  bf_status = state.key->setValue(state.reg_index_key_id, index);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.table->tableEntryGet(bfrtSession(session), switchd->device_target,
+                                         *state.key, flag, state.data.get());
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.data->getValue(state.data_id, &state.values);
+  assert(bf_status == BF_SUCCESS);
+
+  return state.values.at(pipe);
+}
+
+void BfRtBackend::registerWrite(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint64_t value) {
+  bf_status_t bf_status;
+  RegisterState& state = *registers[reg];
+
+  bf_status = state.write_key->setValue(state.reg_index_key_id, index);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.table->dataReset(state.write_data.get());
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.write_data->setValue(state.data_id, value);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.table->tableEntryAdd(bfrtSession(session), switchd->device_target,
+                                         *state.write_key, *state.write_data);
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtBackend::registerWriteRange(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                     uint64_t value) {
+  bf_status_t bf_status;
+  RegisterState& state = *registers[reg];
+
+  // The data is the same for all cells, only the key changes
+  bf_status = state.table->dataReset(state.write_data.get());
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.write_data->setValue(state.data_id, value);
+  assert(bf_status == BF_SUCCESS);
+
+  for (uint64_t index = first; index < first + count; index++) {
+    bf_status = state.write_key->setValue(state.reg_index_key_id, index);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = state.table->tableEntryAdd(bfrtSession(session), switchd->device_target,
+                                           *state.write_key, *state.write_data);
+    assert(bf_status == BF_SUCCESS);
+  }
+}
+
+void BfRtBackend::registerSyncStart(DataplaneSession& session, dp_handle_t reg) {
+  RegisterState& state = *registers[reg];
+
+  // The sync runs on the session it is set up with, rebinding only happens on the first sync
+  bfrt::BfRtSession* sync_session = &bfrtSession(session);
+  if (state.sync_session != sync_session) {
+    RegisterState* reg_state = &state;
+    auto bf_status = state.sync_ops->registerSyncSet(
+        *sync_session, switchd->device_target,
+        [reg_state](const bf_rt_target_t&, void*) {
+          std::lock_guard<std::mutex> lock(reg_state->sync_mutex);
+          reg_state->sync_done = true;
+          reg_state->sync_cv.notify_all();
+        },
+        nullptr);
+    assert(bf_status == BF_SUCCESS);
+    state.sync_session = sync_session;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state.sync_mutex);
+    state.sync_done = false;
+  }
+
+  auto bf_status = state.table->tableOperationsExecute(*state.sync_ops);
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtBackend::registerSyncWait(dp_handle_t reg) {
+  RegisterState& state = *registers[reg];
+
+  std::unique_lock<std::mutex> lock(state.sync_mutex);
+  state.sync_cv.wait(lock, [&state] { return state.sync_done; });
+}
+
+void BfRtBackend::registerReserve(dp_handle_t reg, uint32_t count) {
+  bf_status_t bf_status;
+  RegisterState& state = *registers[reg];
+
+  while (state.batch_keys.size() < count) {
+    std::unique_ptr<BfRtTableKey> table_key;
+    std::unique_ptr<BfRtTableData> table_data;
+
+    bf_status = state.table->keyAllocate(&table_key);
+    assert(bf_status == BF_SUCCESS);
+
+    bf_status = state.table->dataAllocate(&table_data);
+    assert(bf_status == BF_SUCCESS);
+
+    state.batch_keys.push_back(std::move(table_key));
+    state.batch_data.push_back(std::move(table_data));
+  }
+
+  // The first key/data pair receives the entry at `first`, the remaining ones
+  // are handed to tableEntryGetNext_n.
+  state.batch_pairs.clear();
+  for (size_t i = 1; i < state.batch_keys.size(); i++) {
+    state.batch_pairs.emplace_back(state.batch_keys[i].get(), state.batch_data[i].get());
+  }
+}
+
+void BfRtBackend::getBatch(DataplaneSession& session, RegisterState& state, uint64_t first, uint32_t count) {
+  bf_status_t bf_status;
+
+  // After a sync, the software shadow holds the hardware state of all cells
+  auto flag = bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_SW;
+
+  bf_status = state.batch_keys[0]->setValue(state.reg_index_key_id, first);
+  assert(bf_status == BF_SUCCESS);
+
+  bf_status = state.table->tableEntryGet(bfrtSession(session), switchd->device_target,
+                                         *state.batch_keys[0], flag, state.batch_data[0].get());
+  assert(bf_status == BF_SUCCESS);
+
+  if (count > 1) {
+    uint32_t num_returned = 0;
+    bf_status = state.table->tableEntryGetNext_n(bfrtSession(session), switchd->device_target,
+                                                 *state.batch_keys[0], count - 1, flag,
+                                                 &state.batch_pairs, &num_returned);
+    assert(bf_status == BF_SUCCESS);
+    assert(num_returned == count - 1);
+  }
+}
+
+void BfRtBackend::registerReadBatch(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                    uint32_t pipe, uint64_t* values) {
+  bf_status_t bf_status;
+  RegisterState& state = *registers[reg];
+
+  if (state.batch_keys.size() < count) {
+    registerReserve(reg, count);
+  }
+  getBatch(session, state, first, count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    bf_status = state.batch_data[i]->getValue(state.data_id, &state.values);
+    assert(bf_status == BF_SUCCESS);
+
+    values[i] = state.values.at(pipe);
+  }
+}
+
+void BfRtBackend::registerReadBatchPipes(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                         uint32_t pipes, uint64_t* values) {
+  bf_status_t bf_status;
+  RegisterState& state = *registers[reg];
+
+  if (state.batch_keys.size() < count) {
+    registerReserve(reg, count);
+  }
+  getBatch(session, state, first, count);
+
+  // Every data object already holds one value per pipe
+  for (uint32_t i = 0; i < count; i++) {
+    bf_status = state.batch_data[i]->getValue(state.data_id, &state.values);
+    assert(bf_status == BF_SUCCESS);
+    assert(state.values.size() >= pipes);
+
+    for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+      values[(size_t)pipe * count + i] = state.values[pipe];
+    }
+  }
+}
+
+dp_handle_t BfRtBackend::tableOpen(const std::string& name) {
+  std::unique_ptr<TableState> state(new TableState());
+
+  auto bf_status = switchd->bfrtInfo->bfrtTableFromNameGet(name, &state->table);
+  CHECK_F(bf_status == BF_SUCCESS, "Unknown table %s", name.c_str());
+
+  bf_status = state->table->keyAllocate(&state->key);
+  assert(bf_status == BF_SUCCESS);
+
+  tables.push_back(std::move(state));
+  return tables.size() - 1;
+}
+
+dp_id_t BfRtBackend::keyFieldId(dp_handle_t table, const std::string& name) {
+  bf_rt_id_t id;
+  auto bf_status = tables.at(table)->table->keyFieldIdGet(name, &id);
+  CHECK_F(bf_status == BF_SUCCESS, "Unknown key field %s", name.c_str());
+  return id;
+}
+
+dp_id_t BfRtBackend::actionId(dp_handle_t table, const std::string& name) {
+  TableState& state = *tables.at(table);
+
+  bf_rt_id_t id;
+  auto bf_status = state.table->actionIdGet(name, &id);
+  CHECK_F(bf_status == BF_SUCCESS, "Unknown action %s", name.c_str());
+
+  // One data object per action, reused for every entry
+  if (state.data.find(id) == state.data.end()) {
+    bf_status = state.table->dataAllocate(id, &state.data[id]);
+    assert(bf_status == BF_SUCCESS);
+  }
+  return id;
+}
+
+dp_id_t BfRtBackend::dataFieldId(dp_handle_t table, dp_id_t action, const std::string& name) {
+  bf_rt_id_t id;
+  auto bf_status = tables.at(table)->table->dataFieldIdGet(name, action, &id);
+  CHECK_F(bf_status == BF_SUCCESS, "Unknown data field %s", name.c_str());
+  return id;
+}
+
+size_t BfRtBackend::tableSize(dp_handle_t table) {
+  size_t size = 0;
+  auto bf_status = tables.at(table)->table->tableSizeGet(*switchd->session, switchd->device_target, &size);
+  assert(bf_status == BF_SUCCESS);
+  return size;
+}
+
+void BfRtBackend::setKey(TableState& state, const TableKey& key) {
+  auto bf_status = state.table->keyReset(state.key.get());
+  assert(bf_status == BF_SUCCESS);
+
+  for (uint32_t i = 0; i < key.count; i++) {
+    const TableKey::Field& field = key.fields[i];
+    if (field.is_range) {
+      bf_status = state.key->setValueRange(field.id, field.value, field.range_end);
+    } else {
+      bf_status = state.key->setValue(field.id, field.value);
+    }
+    assert(bf_status == BF_SUCCESS);
+  }
+}
+
+BfRtTableData& BfRtBackend::setData(TableState& state, const TableData& data) {
+  // The data object was allocated when the action id was resolved
+  BfRtTableData* table_data = state.data.at(data.action_id).get();
+
+  auto bf_status = state.table->dataReset(data.action_id, table_data);
+  assert(bf_status == BF_SUCCESS);
+
+  for (uint32_t i = 0; i < data.count; i++) {
+    bf_status = table_data->setValue(data.fields[i].id, data.fields[i].value);
+    assert(bf_status == BF_SUCCESS);
+  }
+  return *table_data;
+}
+
+void BfRtBackend::tableEntryAdd(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) {
+  TableState& state = *tables[table];
+
+  // BfRt copies the key and data objects on every add, so they are reused
+  setKey(state, key);
+  auto bf_status = state.table->tableEntryAdd(bfrtSession(session), switchd->device_target, *state.key, setData(state, data));
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtBackend::tableEntryModify(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) {
+  TableState& state = *tables[table];
+
+  setKey(state, key);
+  auto bf_status = state.table->tableEntryMod(bfrtSession(session), switchd->device_target, *state.key, setData(state, data));
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtBackend::tableEntryDelete(DataplaneSession& session, dp_handle_t table, const TableKey& key) {
+  TableState& state = *tables[table];
+
+  setKey(state, key);
+  auto bf_status = state.table->tableEntryDel(bfrtSession(session), switchd->device_target, *state.key);
+  assert(bf_status == BF_SUCCESS);
+}
+
+void BfRtBackend::setCpuPort(uint32_t port) {
+  auto bf_status = bf_tm_port_cpuport_set(switchd->device_target.dev_id, port);
+  CHECK_F(bf_status == BF_SUCCESS, "Failed to configure CPU port");
+}
+
+void BfRtBackend::addPort(uint64_t dev_port, uint32_t speed) {
+  bf_status_t status;
+
+  bf_pal_front_port_handle_t port_handle;
+  status = bf_pm_port_dev_port_to_front_panel_port_get(
+      switchd->device_target.dev_id, dev_port, &port_handle);
+  CHECK_F(status == BF_SUCCESS, "Failed to acquire port handle for port num %lu",
+          dev_port);
+
+  status = bf_pm_port_add(switchd->device_target.dev_id, &port_handle, (bf_port_speed_t)speed,
+                          BF_FEC_TYP_NONE);
+  CHECK_F(status == BF_SUCCESS, "Failed to add port %lu", dev_port);
+
+  status = bf_pm_port_enable(switchd->device_target.dev_id, &port_handle);
+  CHECK_F(status == BF_SUCCESS, "Failed to enable port %lu", dev_port);
+}
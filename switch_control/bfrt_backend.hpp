@@ -0,0 +1,110 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+#include <loguru.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "dataplane_backend.hpp"
+#include "switchd.hpp"
+
+class BfRtSessionHandle : public DataplaneSession {
+ public:
+  std::shared_ptr<bfrt::BfRtSession> session;
+
+  BfRtSessionHandle(std::shared_ptr<bfrt::BfRtSession> session) : session(session) {}
+
+  void beginBatch() override;
+  void endBatch() override;
+  void beginTransaction() override;
+  void commitTransaction() override;
+  void abortTransaction() override;
+  void completeOperations() override;
+};
+
+// Data plane backend on top of the BfRt API of the Tofino SDE
+class BfRtBackend : public DataplaneBackend {
+ private:
+  struct RegisterState {
+    const BfRtTable* table;
+    bf_rt_id_t reg_index_key_id;
+    bf_rt_id_t data_id;
+    size_t size;
+
+    // Register sync operation, allocated once and re-executed for every sync.
+    // Bound to the session of the last registerSyncStart(), the readout session.
+    std::unique_ptr<BfRtTableOperations> sync_ops;
+    bfrt::BfRtSession* sync_session;
+    std::mutex sync_mutex;
+    std::condition_variable sync_cv;
+    bool sync_done;
+
+    // Preallocated key/data objects for single and bulk reads
+    std::unique_ptr<BfRtTableKey> key;
+    std::unique_ptr<BfRtTableData> data;
+    // Writes come from the programming session while the readout reads, they get their own
+    std::unique_ptr<BfRtTableKey> write_key;
+    std::unique_ptr<BfRtTableData> write_data;
+    std::vector<std::unique_ptr<BfRtTableKey>> batch_keys;
+    std::vector<std::unique_ptr<BfRtTableData>> batch_data;
+    BfRtTable::keyDataPairs batch_pairs;
+    std::vector<uint64_t> values;
+  };
+
+  struct TableState {
+    const BfRtTable* table;
+    std::unique_ptr<BfRtTableKey> key;
+    std::map<bf_rt_id_t, std::unique_ptr<BfRtTableData>> data;
+  };
+
+  Switchd* switchd;
+  std::vector<std::unique_ptr<RegisterState>> registers;
+  std::vector<std::unique_ptr<TableState>> tables;
+
+  static bfrt::BfRtSession& bfrtSession(DataplaneSession& session);
+  void setKey(TableState& state, const TableKey& key);
+  BfRtTableData& setData(TableState& state, const TableData& data);
+  // Gets `count` cells from the software shadow into the batch data objects
+  void getBatch(DataplaneSession& session, RegisterState& state, uint64_t first, uint32_t count);
+
+ public:
+  BfRtBackend(Switchd* switchd);
+
+  std::shared_ptr<DataplaneSession> createSession() override;
+  uint32_t pipeCount() override;
+
+  dp_handle_t registerOpen(const std::string& name) override;
+  size_t registerSize(dp_handle_t reg) override;
+  uint64_t registerRead(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint32_t pipe) override;
+  void registerWrite(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint64_t value) override;
+  void registerWriteRange(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                          uint64_t value) override;
+  void registerSyncStart(DataplaneSession& session, dp_handle_t reg) override;
+  void registerSyncWait(dp_handle_t reg) override;
+  void registerReserve(dp_handle_t reg, uint32_t count) override;
+  void registerReadBatch(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                         uint32_t pipe, uint64_t* values) override;
+  void registerReadBatchPipes(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                              uint32_t pipes, uint64_t* values) override;
+
+  dp_handle_t tableOpen(const std::string& name) override;
+  dp_id_t keyFieldId(dp_handle_t table, const std::string& name) override;
+  dp_id_t actionId(dp_handle_t table, const std::string& name) override;
+  dp_id_t dataFieldId(dp_handle_t table, dp_id_t action, const std::string& name) override;
+  size_t tableSize(dp_handle_t table) override;
+  void tableEntryAdd(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) override;
+  void tableEntryModify(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) override;
+  void tableEntryDelete(DataplaneSession& session, dp_handle_t table, const TableKey& key) override;
+
+  void setCpuPort(uint32_t port) override;
+  void addPort(uint64_t dev_port, uint32_t speed) override;
+};
@@ -0,0 +1,81 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+  Fields of bit-packed P4 headers in network byte order. A field is described
+  once by its bit offset and width; everything else (bytes covered, shift,
+  mask, value type) is derived at compile time, so extract() and insert()
+  are fixed sequences of byte loads, shifts and masks without branches.
+*/
+template <unsigned Offset, unsigned Width>
+struct BitField {
+  static_assert(Width > 0 && Width <= 32, "Fields are at most 32 bits wide");
+
+  static constexpr unsigned offset = Offset;
+  static constexpr unsigned width = Width;
+  // Offset of the next field
+  static constexpr unsigned end = Offset + Width;
+
+  static constexpr unsigned first_byte = Offset / 8;
+  static constexpr unsigned bytes = (Offset + Width - 1) / 8 - first_byte + 1;
+  // Position of the field inside the big-endian word of `bytes` bytes
+  static constexpr unsigned shift = bytes * 8 - Offset % 8 - Width;
+  static constexpr uint64_t mask = (1ULL << Width) - 1;
+
+  typedef typename std::conditional<(Width <= 8), uint8_t,
+                                    typename std::conditional<(Width <= 16), uint16_t, uint32_t>::type>::type value_type;
+
+  static constexpr value_type extract(const uint8_t* data) {
+    uint64_t word = 0;
+    for (unsigned i = 0; i < bytes; i++) {
+      word = (word << 8) | data[first_byte + i];
+    }
+    return (value_type)((word >> shift) & mask);
+  }
+
+  // Leaves the bits of the neighbouring fields untouched
+  static constexpr void insert(uint8_t* data, uint64_t value) {
+    uint64_t word = 0;
+    for (unsigned i = 0; i < bytes; i++) {
+      word = (word << 8) | data[first_byte + i];
+    }
+    word = (word & ~(mask << shift)) | ((value & mask) << shift);
+    for (unsigned i = 0; i < bytes; i++) {
+      data[first_byte + i] = (uint8_t)(word >> (8 * (bytes - 1 - i)));
+    }
+  }
+};
+
+// A header made of `Fields`, which have to follow each other without gaps
+template <typename... Fields>
+struct BitLayout {
+  static constexpr unsigned bits = (Fields::width + ...);
+  static constexpr size_t size = (bits + 7) / 8;
+
+  static constexpr bool contiguous() {
+    unsigned offsets[] = {Fields::offset...};
+    unsigned widths[] = {Fields::width...};
+    unsigned next = 0;
+    for (size_t i = 0; i < sizeof...(Fields); i++) {
+      if (offsets[i] != next) {
+        return false;
+      }
+      next += widths[i];
+    }
+    return true;
+  }
+
+  static_assert(contiguous(), "Fields have to be listed in header order without gaps");
+};
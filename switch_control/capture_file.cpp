@@ -0,0 +1,266 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "capture_file.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#define PCAP_MAGIC_US 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_HEADER_SIZE 24
+#define PCAP_RECORD_HEADER_SIZE 16
+
+#define PCAPNG_SECTION_HEADER 0x0A0D0D0A
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_INTERFACE_DESCRIPTION 1
+#define PCAPNG_SIMPLE_PACKET 3
+#define PCAPNG_ENHANCED_PACKET 6
+#define PCAPNG_OPTION_END 0
+#define PCAPNG_OPTION_TSRESOL 9
+#define PCAPNG_OPTION_TSOFFSET 14
+
+static size_t pad4(size_t length) {
+  return (length + 3) & ~(size_t)3;
+}
+
+CaptureFile::CaptureFile()
+    : fd(-1), map(nullptr), map_size(0), position(0), pcapng(false), swapped(false), nanoseconds(false), truncated(false) {}
+
+CaptureFile::~CaptureFile() {
+  close();
+}
+
+void CaptureFile::close() {
+  if (map != nullptr) {
+    munmap((void*)map, map_size);
+    map = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  map_size = 0;
+  position = 0;
+  interfaces.clear();
+  truncated = false;
+}
+
+uint16_t CaptureFile::read16(const uint8_t* data) const {
+  uint16_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t CaptureFile::read32(const uint8_t* data) const {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return swapped ? __builtin_bswap32(value) : value;
+}
+
+bool CaptureFile::open(const std::string& path, std::string* error) {
+  close();
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < 12) {
+    *error = "file too small";
+    close();
+    return false;
+  }
+  map_size = info.st_size;
+  void* mapped = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    *error = strerror(errno);
+    map_size = 0;
+    close();
+    return false;
+  }
+  map = (const uint8_t*)mapped;
+  // Every byte is read exactly once, in order
+  madvise(mapped, map_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+  uint32_t magic;
+  memcpy(&magic, map, sizeof(magic));
+  if (magic == PCAPNG_SECTION_HEADER) {
+    pcapng = true;
+    if (!startSection(map, map_size)) {
+      *error = "invalid pcapng section header";
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  pcapng = false;
+  swapped = magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS);
+  magic = read32(map);
+  if ((magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) || map_size < PCAP_HEADER_SIZE) {
+    *error = "neither pcap nor pcapng";
+    close();
+    return false;
+  }
+  nanoseconds = magic == PCAP_MAGIC_NS;
+  position = PCAP_HEADER_SIZE;
+  return true;
+}
+
+bool CaptureFile::next(Packet* packet) {
+  if (map == nullptr) {
+    return false;
+  }
+  return pcapng ? nextPcapng(packet) : nextPcap(packet);
+}
+
+bool CaptureFile::nextPcap(Packet* packet) {
+  if (position + PCAP_RECORD_HEADER_SIZE > map_size) {
+    truncated = position != map_size;
+    return false;
+  }
+  const uint8_t* record = map + position;
+  uint32_t seconds = read32(record);
+  uint32_t fraction = read32(record + 4);
+  uint32_t captured = read32(record + 8);
+  if (position + PCAP_RECORD_HEADER_SIZE + captured > map_size) {
+    truncated = true;
+    return false;
+  }
+
+  packet->timestamp_ns = (int64_t)seconds * 1000000000 + (nanoseconds ? fraction : (int64_t)fraction * 1000);
+  packet->data = record + PCAP_RECORD_HEADER_SIZE;
+  packet->length = captured;
+  position += PCAP_RECORD_HEADER_SIZE + captured;
+  return true;
+}
+
+// `block` is a section header block, which also sets the byte order of the section
+bool CaptureFile::startSection(const uint8_t* block, size_t length) {
+  if (length < 28) {
+    return false;
+  }
+  uint32_t byte_order;
+  memcpy(&byte_order, block + 8, sizeof(byte_order));
+  if (byte_order != PCAPNG_BYTE_ORDER_MAGIC && byte_order != __builtin_bswap32(PCAPNG_BYTE_ORDER_MAGIC)) {
+    return false;
+  }
+  swapped = byte_order != PCAPNG_BYTE_ORDER_MAGIC;
+  // Interface ids restart in every section
+  interfaces.clear();
+  return true;
+}
+
+void CaptureFile::addInterface(const uint8_t* body, size_t length) {
+  // Microseconds unless the interface says otherwise
+  Interface interface = {false, 6, 0, 0};
+  if (length >= 8) {
+    interface.snaplen = read32(body + 4);
+  }
+
+  size_t offset = 8;
+  while (offset + 4 <= length) {
+    uint16_t code = read16(body + offset);
+    uint16_t option_length = read16(body + offset + 2);
+    const uint8_t* value = body + offset + 4;
+    if (code == PCAPNG_OPTION_END || offset + 4 + option_length > length) {
+      break;
+    }
+    if (code == PCAPNG_OPTION_TSRESOL && option_length >= 1) {
+      interface.binary = (value[0] & 0x80) != 0;
+      interface.exponent = value[0] & 0x7F;
+    } else if (code == PCAPNG_OPTION_TSOFFSET && option_length >= 8) {
+      uint64_t offset_s;
+      memcpy(&offset_s, value, sizeof(offset_s));
+      interface.offset_s = (int64_t)(swapped ? __builtin_bswap64(offset_s) : offset_s);
+    }
+    offset += 4 + pad4(option_length);
+  }
+  interfaces.push_back(interface);
+}
+
+int64_t CaptureFile::interfaceTime(const Interface& interface, uint64_t units) const {
+  int64_t offset_ns = interface.offset_s * 1000000000;
+  if (interface.binary) {
+    unsigned exponent = interface.exponent < 64 ? interface.exponent : 63;
+    unsigned __int128 scaled = (unsigned __int128)units * 1000000000;
+    return offset_ns + (int64_t)(scaled >> exponent);
+  }
+
+  if (interface.exponent <= 9) {
+    uint64_t scale = 1;
+    for (unsigned i = interface.exponent; i < 9; i++) {
+      scale *= 10;
+    }
+    return offset_ns + (int64_t)(units * scale);
+  }
+  for (unsigned i = 9; i < interface.exponent && units != 0; i++) {
+    units /= 10;
+  }
+  return offset_ns + (int64_t)units;
+}
+
+bool CaptureFile::nextPcapng(Packet* packet) {
+  while (position + 12 <= map_size) {
+    const uint8_t* block = map + position;
+    // The section header type reads the same in both byte orders and sets the order of the following blocks
+    uint32_t type = read32(block);
+    if (type == PCAPNG_SECTION_HEADER && !startSection(block, map_size - position)) {
+      truncated = true;
+      return false;
+    }
+
+    uint32_t length = read32(block + 4);
+    if (length < 12 || length % 4 != 0 || position + length > map_size) {
+      truncated = true;
+      return false;
+    }
+    const uint8_t* body = block + 8;
+    size_t body_length = length - 12;
+    position += length;
+
+    if (type == PCAPNG_INTERFACE_DESCRIPTION) {
+      addInterface(body, body_length);
+    } else if (type == PCAPNG_ENHANCED_PACKET && body_length >= 20) {
+      uint32_t interface_id = read32(body);
+      uint64_t units = ((uint64_t)read32(body + 4) << 32) | read32(body + 8);
+      uint32_t captured = read32(body + 12);
+      if (interface_id >= interfaces.size() || 20 + (size_t)captured > body_length) {
+        continue;
+      }
+      packet->timestamp_ns = interfaceTime(interfaces[interface_id], units);
+      packet->data = body + 20;
+      packet->length = captured;
+      return true;
+    } else if (type == PCAPNG_SIMPLE_PACKET && body_length >= 4 && !interfaces.empty()) {
+      // No timestamp, the packet is as long as the block allows
+      uint32_t original = read32(body);
+      size_t captured = body_length - 4;
+      if (original < captured) {
+        captured = original;
+      }
+      if (interfaces[0].snaplen != 0 && interfaces[0].snaplen < captured) {
+        captured = interfaces[0].snaplen;
+      }
+      packet->timestamp_ns = 0;
+      packet->data = body + 4;
+      packet->length = captured;
+      return true;
+    }
+  }
+  truncated = position != map_size;
+  return false;
+}
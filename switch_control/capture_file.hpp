@@ -0,0 +1,78 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+  Sequential reader of pcap and pcapng captures, e.g., of the CPU port. The
+  file is memory-mapped read-only and packets point straight into the
+  mapping, nothing is copied. pcap files may use either byte order and
+  micro- or nanosecond timestamps; pcapng files may contain several sections
+  and interfaces with their own timestamp resolution and offset.
+*/
+class CaptureFile {
+ public:
+  struct Packet {
+    // CLOCK_REALTIME nanoseconds of the capture
+    int64_t timestamp_ns;
+    const uint8_t* data;
+    uint32_t length;
+  };
+
+ private:
+  struct Interface {
+    // Timestamps count units of 10^-exponent or, if binary, 2^-exponent seconds
+    bool binary;
+    uint8_t exponent;
+    int64_t offset_s;
+    uint32_t snaplen;
+  };
+
+  int fd;
+  const uint8_t* map;
+  size_t map_size;
+  size_t position;
+
+  bool pcapng;
+  bool swapped;
+  bool nanoseconds;
+  std::vector<Interface> interfaces;
+  bool truncated;
+
+  uint16_t read16(const uint8_t* data) const;
+  uint32_t read32(const uint8_t* data) const;
+
+  bool nextPcap(Packet* packet);
+  bool nextPcapng(Packet* packet);
+  bool startSection(const uint8_t* block, size_t length);
+  void addInterface(const uint8_t* body, size_t length);
+  int64_t interfaceTime(const Interface& interface, uint64_t units) const;
+
+ public:
+  CaptureFile();
+  ~CaptureFile();
+  CaptureFile(const CaptureFile&) = delete;
+  CaptureFile& operator=(const CaptureFile&) = delete;
+
+  // Maps the file, returns false and sets `error` if it is neither pcap nor pcapng
+  bool open(const std::string& path, std::string* error);
+  void close();
+
+  // Next packet, false at the end of the file. Non-packet blocks are skipped.
+  bool next(Packet* packet);
+
+  size_t size() const { return map_size; }
+  // The file ended inside a record, e.g., a capture that is still being written
+  bool isTruncated() const { return truncated; }
+};
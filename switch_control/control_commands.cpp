@@ -0,0 +1,267 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "control_commands.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+
+#include "measurement_log.hpp"
+#include "rtt_class_plan.hpp"
+
+static bool parseNumber(const std::string& text, long* value) {
+  char* end = nullptr;
+  *value = strtol(text.c_str(), &end, 10);
+  return !text.empty() && *end == '\0';
+}
+
+// src_addr dst_addr src_port dst_port
+static bool parseTuple(const std::vector<std::string>& args, FlowTuple* tuple) {
+  long src_port, dst_port;
+  if (args.size() != 4 || !FlowTable::parseAddress(args[0], &tuple->src_addr) ||
+      !FlowTable::parseAddress(args[1], &tuple->dst_addr) || !parseNumber(args[2], &src_port) ||
+      !parseNumber(args[3], &dst_port) || src_port < 0 || src_port > 0xFFFF || dst_port < 0 || dst_port > 0xFFFF) {
+    return false;
+  }
+  tuple->src_port = (uint16_t)src_port;
+  tuple->dst_port = (uint16_t)dst_port;
+  return true;
+}
+
+static std::string diffSummary(const rtt_class_plan_diff& diff) {
+  return "ok: " + std::to_string(diff.added) + " added, " + std::to_string(diff.modified) + " modified, " +
+         std::to_string(diff.deleted) + " deleted, " + std::to_string(diff.unchanged) + " unchanged";
+}
+
+static void writeFlowState(std::ostringstream& out, const ControlContext* context, uint32_t flow_id,
+                           const FlowStateView::FlowState& state, int64_t now_ns) {
+  FlowTuple tuple = context->flows->tuple(flow_id);
+  out << flow_id << " " << FlowTable::addressToString(tuple.src_addr) << ":" << tuple.src_port << " "
+      << FlowTable::addressToString(tuple.dst_addr) << ":" << tuple.dst_port;
+
+  const FlowHotState& hot = state.hot;
+  out << " age_ms=" << (now_ns - hot.updated_ns) / 1000000 << " rtt=" << hot.rtt << " accumulator=" << hot.rtt_accumulator
+      << " measurements=" << hot.measurement_total << " classes=";
+  for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    out << (rtt_class > 0 ? "," : "") << state.class_total[rtt_class];
+  }
+  if (hot.source == FLOW_STATE_REPORT) {
+    out << " class=" << (int)hot.class_id;
+  }
+  out << "\n";
+}
+
+void addControlCommands(ControlServer* server, ControlContext* context) {
+  server->addCommand("status", "status: readout, reorder protection, classes and output state",
+                     [context](const std::vector<std::string>& args) {
+    std::ostringstream out;
+    out << "flows " << context->flows->activeCount() << "\n";
+    FlowManager::Stats flow_stats = context->flow_manager->stats();
+    out << "flow manager: " << flow_stats.added << " added, " << flow_stats.removed << " removed, "
+        << flow_stats.rejected << " rejected, " << flow_stats.batches << " batches, max. install latency "
+        << flow_stats.max_install_latency_us << " us\n";
+    out << "reorder protection " << context->tsc->tables->reorderProtection() << "\n";
+    out << "class ranges " << context->tsc->tables->installedRTTClassPlan().size() << "\n";
+    out << "output " << context->output_path << "\n";
+    for (auto& stats : context->pipeline->stats()) {
+      out << "output queue: " << stats.written << " written, " << stats.dropped << " dropped, max. occupancy "
+          << stats.max_occupancy << "\n";
+    }
+    if (context->scheduler != nullptr) {
+      out << "requested period " << context->scheduler->requestedPeriod() / 1000 << " us\n";
+      out << context->scheduler->publishedReport() << "\n";
+    }
+    return out.str();
+  });
+
+  server->addCommand("interval", "interval <us>: change the readout period",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    long period_us;
+    if (context->scheduler == nullptr) {
+      return "error: no register readout in report mode";
+    }
+    if (args.size() != 1 || !parseNumber(args[0], &period_us) || period_us <= 0) {
+      return "error: usage interval <us>";
+    }
+    // Applied by the readout thread after its current cycle
+    context->scheduler->requestPeriod((int64_t)period_us * 1000);
+    return "ok";
+  });
+
+  server->addCommand("reorder", "reorder <0|1|2>: none, QBit or Consec reorder protection",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    long variant;
+    if (args.size() != 1 || !parseNumber(args[0], &variant) || variant < 0 || variant > 2) {
+      return "error: usage reorder <0|1|2>";
+    }
+    if (!context->tsc->spinbit_enabled) {
+      return "error: spin bit measurements are disabled";
+    }
+    context->tsc->setSpinReorderProtection((int)variant);
+    return "ok";
+  });
+
+  server->addCommand("range", "range <min_ms> <max_ms>: grease detection plus one custom RTT class",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    long min_latency, max_latency;
+    if (args.size() != 2 || !parseNumber(args[0], &min_latency) || !parseNumber(args[1], &max_latency) ||
+        min_latency <= 0 || max_latency < min_latency || 4 * max_latency > 0xFFFF) {
+      return "error: usage range <min_ms> <max_ms>";
+    }
+    return diffSummary(context->tsc->applyRTTClassPlan(defaultRttClassPlan(0, min_latency, max_latency)));
+  });
+
+  server->addCommand("plan", "plan [file]: load a class plan, by default the one given at startup",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    std::string path = args.empty() ? context->class_plan_file : args[0];
+    std::vector<rtt_class_range> plan;
+    if (path.empty()) {
+      return "error: usage plan <file>";
+    }
+    if (!loadRttClassPlan(path, &plan)) {
+      return "error: cannot load " + path + ", keeping the installed class plan";
+    }
+    return diffSummary(context->tsc->applyRTTClassPlan(plan));
+  });
+
+  server->addCommand("classes", "classes: installed RTT class ranges",
+                     [context](const std::vector<std::string>& args) {
+    std::ostringstream out;
+    for (auto& range : context->tsc->tables->installedRTTClassPlan()) {
+      out << range.accumulator_min << " " << range.accumulator_max << " " << range.rtt_min << " " << range.rtt_max
+          << " " << (int)range.rtt_class << "\n";
+    }
+    return out.str();
+  });
+
+  server->addCommand("add", "add <src_addr> <dst_addr> <src_port> <dst_port>: track a flow under a free flow id",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    FlowTuple tuple;
+    uint32_t flow_id;
+    if (!parseTuple(args, &tuple)) {
+      return "error: usage add <src_addr> <dst_addr> <src_port> <dst_port>";
+    }
+    if (!context->flow_manager->addFlow(tuple, &flow_id)) {
+      return "error: no free flow id";
+    }
+    // Installed by the flow manager within its batch delay
+    return "ok: flow " + std::to_string(flow_id);
+  });
+
+  server->addCommand("remove", "remove <src_addr> <dst_addr> <src_port> <dst_port>: stop tracking a flow",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    FlowTuple tuple;
+    if (!parseTuple(args, &tuple)) {
+      return "error: usage remove <src_addr> <dst_addr> <src_port> <dst_port>";
+    }
+    if (!context->flow_manager->removeFlow(tuple)) {
+      return "error: flow is not tracked";
+    }
+    return "ok";
+  });
+
+  server->addCommand("flows", "flows: latest sample of every flow",
+                     [context](const std::vector<std::string>& args) {
+    std::ostringstream out;
+    int64_t now_ns = monotonicNanoseconds();
+    for (auto& flow : context->flow_state->flowStates()) {
+      writeFlowState(out, context, flow.first, flow.second, now_ns);
+    }
+    return out.str();
+  });
+
+  server->addCommand("flow", "flow <id>: latest sample of one flow",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    long flow_id;
+    FlowStateView::FlowState state;
+    if (args.size() != 1 || !parseNumber(args[0], &flow_id) || flow_id < 0) {
+      return "error: usage flow <id>";
+    }
+    if (!context->flow_state->flowState((uint32_t)flow_id, &state)) {
+      return "error: no samples of flow " + args[0];
+    }
+    std::ostringstream out;
+    writeFlowState(out, context, (uint32_t)flow_id, state, monotonicNanoseconds());
+    return out.str();
+  });
+
+  server->addCommand("quantiles", "quantiles [id]: p50/p90/p99/p99.9 RTT of the sliding window and lifetime",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    long flow_id;
+    if (context->sketches == nullptr) {
+      return "error: RTT sketches are disabled, see --sketch_flows";
+    }
+    if (args.size() > 1 || (args.size() == 1 && (!parseNumber(args[0], &flow_id) || flow_id < 0))) {
+      return "error: usage quantiles [id]";
+    }
+
+    std::vector<uint32_t> flow_ids = args.empty() ? context->sketches->flows() : std::vector<uint32_t>{(uint32_t)flow_id};
+    std::ostringstream out;
+    for (uint32_t id : flow_ids) {
+      RttHistogram window, lifetime;
+      if (!context->sketches->quantiles(id, &window, &lifetime)) {
+        return "error: no samples of flow " + std::to_string(id);
+      }
+      out << id << " window n=" << window.total << " p50=" << window.quantile(0.5) << " p90=" << window.quantile(0.9)
+          << " p99=" << window.quantile(0.99) << " p99.9=" << window.quantile(0.999) << " lifetime n=" << lifetime.total
+          << " p50=" << lifetime.quantile(0.5) << " p90=" << lifetime.quantile(0.9) << " p99=" << lifetime.quantile(0.99)
+          << " p99.9=" << lifetime.quantile(0.999) << "\n";
+    }
+    if (context->sketches->rejectedFlows() > 0) {
+      out << "flows without sketch: " << context->sketches->rejectedFlows() << "\n";
+    }
+    return out.str();
+  });
+
+  server->addCommand("filters", "filters [id]: windowed minimum, smoothed RTT and RTT variation",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    long flow_id;
+    if (context->filters == nullptr) {
+      return "error: RTT filters are disabled, see --rtt_filters";
+    }
+    if (args.size() > 1 || (args.size() == 1 && (!parseNumber(args[0], &flow_id) || flow_id < 0))) {
+      return "error: usage filters [id]";
+    }
+
+    std::vector<uint32_t> flow_ids = args.empty() ? context->filters->flows() : std::vector<uint32_t>{(uint32_t)flow_id};
+    std::ostringstream out;
+    for (uint32_t id : flow_ids) {
+      RttFilterValues values;
+      if (!context->filters->values(id, &values)) {
+        return "error: no samples of flow " + std::to_string(id);
+      }
+      out << id << " n=" << values.samples << " latest=" << values.latest_rtt << " min=" << values.min_rtt
+          << " srtt=" << values.srtt << " rttvar=" << values.rttvar << "\n";
+    }
+    return out.str();
+  });
+
+  server->addCommand("rotate", "rotate [path]: continue the output in path, or move the current file aside",
+                     [context](const std::vector<std::string>& args) -> std::string {
+    if (args.size() > 1) {
+      return "error: usage rotate [path]";
+    }
+
+    if (args.empty()) {
+      // The writer keeps appending to the renamed file until the end of the cycle
+      std::string rotated = context->output_path + "." + std::to_string(time(nullptr));
+      if (rename(context->output_path.c_str(), rotated.c_str()) != 0) {
+        return "error: cannot rename " + context->output_path;
+      }
+      context->pipeline->reopen(context->output_sink, context->output_path);
+      return "ok: previous output in " + rotated;
+    }
+
+    context->output_path = args[0];
+    context->pipeline->reopen(context->output_sink, context->output_path);
+    return "ok";
+  });
+}
@@ -0,0 +1,52 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "control_server.hpp"
+#include "flow_manager.hpp"
+#include "flow_table.hpp"
+#include "measurement_output.hpp"
+#include "output_pipeline.hpp"
+#include "readout_scheduler.hpp"
+#include "rtt_filters.hpp"
+#include "rtt_sketch.hpp"
+#include "tofino_switch_control.hpp"
+
+// Everything the control commands reconfigure or query
+struct ControlContext {
+  TofinoSwitchControl* tsc;
+  const FlowTable* flows;
+  // Installs and removes flows at runtime
+  FlowManager* flow_manager;
+  const FlowStateView* flow_state;
+  // nullptr without sketches
+  const RttSketchOutput* sketches;
+  // nullptr without RTT filters
+  const RttFilterOutput* filters;
+  OutputPipeline* pipeline;
+  // Pipeline sink of the measurement file and its current path
+  size_t output_sink;
+  std::string output_path;
+  // nullptr in report mode
+  ReadoutScheduler* scheduler;
+  std::string class_plan_file;
+};
+
+/*
+  Registers the live reconfiguration commands:
+    status, interval <us>, reorder <0|1|2>, range <min_ms> <max_ms>,
+    plan [file], classes, add <flow>, remove <flow>, flows, flow <id>,
+    quantiles [id], filters [id], rotate [path]
+  with <flow> as src_addr dst_addr src_port dst_port, like in the flow file.
+  `context` has to outlive the server.
+*/
+void addControlCommands(ControlServer* server, ControlContext* context);
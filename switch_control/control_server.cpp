@@ -0,0 +1,254 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "control_server.hpp"
+
+#include <loguru.hpp>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+// Clients sending longer lines are disconnected
+#define CONTROL_MAX_LINE 4096
+#define CONTROL_MAX_EVENTS 16
+
+ControlServer::ControlServer(const std::string& socket_path)
+    : socket_path(socket_path), listen_fd(-1), epoll_fd(-1), stop_fd(-1) {
+  addCommand("help", "help", [this](const std::vector<std::string>& args) {
+    std::string result;
+    for (auto& command : commands) {
+      result += command.second.usage + "\n";
+    }
+    return result;
+  });
+}
+
+ControlServer::~ControlServer() {
+  stop();
+}
+
+void ControlServer::addCommand(const std::string& name, const std::string& usage, Handler handler) {
+  commands[name] = Command{usage, handler};
+}
+
+void ControlServer::start() {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  CHECK_F(socket_path.size() < sizeof(addr.sun_path), "Control socket path %s is too long", socket_path.c_str());
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  // A socket left behind by a previous run would make bind() fail
+  unlink(socket_path.c_str());
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  CHECK_F(listen_fd >= 0, "Failed to open control socket: %s", strerror(errno));
+  int status = bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr));
+  CHECK_F(status == 0, "Failed to bind control socket %s: %s", socket_path.c_str(), strerror(errno));
+  status = listen(listen_fd, 8);
+  CHECK_F(status == 0, "Failed to listen on control socket: %s", strerror(errno));
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  CHECK_F(epoll_fd >= 0, "Failed to create epoll instance: %s", strerror(errno));
+  stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  CHECK_F(stop_fd >= 0, "Failed to create eventfd: %s", strerror(errno));
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = listen_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+  event.data.fd = stop_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
+
+  server_thread = std::thread(&ControlServer::serverLoop, this);
+  LOG_F(INFO, "Control socket listening on %s", socket_path.c_str());
+}
+
+void ControlServer::stop() {
+  if (!server_thread.joinable()) {
+    return;
+  }
+
+  uint64_t one = 1;
+  if (write(stop_fd, &one, sizeof(one)) != sizeof(one)) {
+    LOG_F(WARNING, "Failed to wake the control thread: %s", strerror(errno));
+  }
+  server_thread.join();
+
+  for (auto& client : clients) {
+    close(client.first);
+  }
+  clients.clear();
+  close(listen_fd);
+  close(epoll_fd);
+  close(stop_fd);
+  unlink(socket_path.c_str());
+}
+
+void ControlServer::serverLoop() {
+  struct epoll_event events[CONTROL_MAX_EVENTS];
+
+  while (true) {
+    int count = epoll_wait(epoll_fd, events, CONTROL_MAX_EVENTS, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ABORT_F("Control loop failed: %s", strerror(errno));
+    }
+
+    for (int i = 0; i < count; i++) {
+      int fd = events[i].data.fd;
+      if (fd == stop_fd) {
+        return;
+      }
+      if (fd == listen_fd) {
+        acceptClients();
+        continue;
+      }
+
+      if (events[i].events & EPOLLERR) {
+        closeClient(fd);
+        continue;
+      }
+      if (events[i].events & (EPOLLIN | EPOLLHUP)) {
+        readClient(fd);
+      }
+      // The client may have been closed while reading
+      if ((events[i].events & EPOLLOUT) && clients.count(fd) > 0) {
+        writeClient(fd);
+      }
+    }
+  }
+}
+
+void ControlServer::acceptClients() {
+  while (true) {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        LOG_F(WARNING, "Failed to accept control client: %s", strerror(errno));
+      }
+      return;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    clients[fd] = Client{"", "", false};
+  }
+}
+
+void ControlServer::readClient(int fd) {
+  Client& client = clients[fd];
+  char buffer[1024];
+  bool finished = false;
+
+  while (true) {
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length > 0) {
+      client.input.append(buffer, length);
+      continue;
+    }
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    // End of input or error, lines received so far are still answered
+    finished = true;
+    break;
+  }
+
+  size_t line_end;
+  while ((line_end = client.input.find('\n')) != std::string::npos) {
+    std::string line = client.input.substr(0, line_end);
+    client.input.erase(0, line_end + 1);
+    client.output += execute(line);
+  }
+  if (client.input.size() > CONTROL_MAX_LINE) {
+    closeClient(fd);
+    return;
+  }
+
+  client.finished = finished;
+  writeClient(fd);
+}
+
+void ControlServer::writeClient(int fd) {
+  Client& client = clients[fd];
+
+  while (!client.output.empty()) {
+    // MSG_NOSIGNAL: a client that went away must not raise SIGPIPE
+    ssize_t length = send(fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        closeClient(fd);
+        return;
+      }
+      break;
+    }
+    client.output.erase(0, length);
+  }
+
+  if (client.output.empty() && client.finished) {
+    closeClient(fd);
+    return;
+  }
+
+  // Only wait for writability while a response is pending
+  struct epoll_event event;
+  if (client.finished) {
+    event.events = EPOLLOUT;
+  } else {
+    event.events = client.output.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT;
+  }
+  event.data.fd = fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+void ControlServer::closeClient(int fd) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  close(fd);
+  clients.erase(fd);
+}
+
+std::string ControlServer::execute(const std::string& line) {
+  std::istringstream stream(line);
+  std::vector<std::string> words;
+  std::string word;
+  while (stream >> word) {
+    words.push_back(word);
+  }
+  if (words.empty()) {
+    return "\n";
+  }
+
+  auto command = commands.find(words[0]);
+  if (command == commands.end()) {
+    return "error: unknown command " + words[0] + ", try help\n\n";
+  }
+
+  std::string result = command->second.handler(std::vector<std::string>(words.begin() + 1, words.end()));
+  if (!result.empty() && result.back() != '\n') {
+    result += "\n";
+  }
+  return result + "\n";
+}
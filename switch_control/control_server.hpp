@@ -0,0 +1,68 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Line-based command interface on a Unix domain stream socket. One thread
+  serves all clients from a non-blocking epoll loop; every received line is
+  split into words, dispatched to the registered handler and answered with
+  the handler's text followed by an empty line. Handlers run on the control
+  thread, so they must not wait for the readout.
+*/
+class ControlServer {
+ public:
+  // Receives the words after the command name, returns the response text
+  using Handler = std::function<std::string(const std::vector<std::string>& args)>;
+
+ private:
+  struct Command {
+    std::string usage;
+    Handler handler;
+  };
+
+  struct Client {
+    std::string input;
+    std::string output;
+    // The client stopped sending, it is closed once the output is sent
+    bool finished;
+  };
+
+  std::string socket_path;
+  int listen_fd;
+  int epoll_fd;
+  // Wakes the loop on stop()
+  int stop_fd;
+
+  std::map<std::string, Command> commands;
+  std::map<int, Client> clients;
+  std::thread server_thread;
+
+  void serverLoop();
+  void acceptClients();
+  void readClient(int fd);
+  void writeClient(int fd);
+  void closeClient(int fd);
+  std::string execute(const std::string& line);
+
+ public:
+  ControlServer(const std::string& socket_path);
+  ~ControlServer();
+
+  // All commands have to be added before start()
+  void addCommand(const std::string& name, const std::string& usage, Handler handler);
+  void start();
+  void stop();
+};
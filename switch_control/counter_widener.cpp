@@ -0,0 +1,56 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "counter_widener.hpp"
+
+#include <loguru.hpp>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+CounterWidener::CounterWidener(size_t size, uint32_t counter_bits)
+    : counter_mask(counter_bits >= 64 ? ~0ULL : (1ULL << counter_bits) - 1), previous(size, 0), totals(size, 0) {}
+
+void CounterWidener::update(size_t first, const uint64_t* current, size_t count) {
+  CHECK_F(first + count <= totals.size(), "Counters [%zu, %zu) exceed the widener size %zu", first, first + count,
+          totals.size());
+
+  uint64_t* prev = previous.data() + first;
+  uint64_t* total = totals.data() + first;
+  size_t i = 0;
+
+  // (current - previous) & mask is the delta modulo 2^counter_bits, also across a wraparound
+#if defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi64x(counter_mask);
+  for (; i + 4 <= count; i += 4) {
+    __m256i cur = _mm256_loadu_si256((const __m256i*)(current + i));
+    __m256i old = _mm256_loadu_si256((const __m256i*)(prev + i));
+    __m256i sum = _mm256_loadu_si256((const __m256i*)(total + i));
+    sum = _mm256_add_epi64(sum, _mm256_and_si256(_mm256_sub_epi64(cur, old), mask));
+    _mm256_storeu_si256((__m256i*)(total + i), sum);
+    _mm256_storeu_si256((__m256i*)(prev + i), cur);
+  }
+#elif defined(__SSE2__)
+  const __m128i mask = _mm_set1_epi64x(counter_mask);
+  for (; i + 2 <= count; i += 2) {
+    __m128i cur = _mm_loadu_si128((const __m128i*)(current + i));
+    __m128i old = _mm_loadu_si128((const __m128i*)(prev + i));
+    __m128i sum = _mm_loadu_si128((const __m128i*)(total + i));
+    sum = _mm_add_epi64(sum, _mm_and_si128(_mm_sub_epi64(cur, old), mask));
+    _mm_storeu_si128((__m128i*)(total + i), sum);
+    _mm_storeu_si128((__m128i*)(prev + i), cur);
+  }
+#endif
+
+  for (; i < count; i++) {
+    total[i] += (current[i] - prev[i]) & counter_mask;
+    prev[i] = current[i];
+  }
+}
@@ -0,0 +1,48 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+  Widens narrow, wrapping hardware counters into 64-bit totals. Every update
+  adds the difference to the previous snapshot modulo 2^counter_bits, so a
+  counter may wrap at most once between two snapshots. Deltas are computed in
+  one vectorized pass over contiguous counters.
+*/
+class CounterWidener {
+ private:
+  uint64_t counter_mask;
+  std::vector<uint64_t> previous;
+  std::vector<uint64_t> totals;
+
+ public:
+  CounterWidener(size_t size, uint32_t counter_bits);
+
+  // Accounts the snapshot of the `count` counters starting at `first`
+  void update(size_t first, const uint64_t* current, size_t count);
+  // Takes `current` as the previous snapshot of counter `index` without accounting it,
+  // e.g., for counters first seen in the middle of a run
+  void seed(size_t index, uint64_t current) { previous[index] = current & counter_mask; }
+  // Starts counter `index` over at zero, e.g., once the hardware counter of a recycled flow was cleared
+  void reset(size_t index) {
+    previous[index] = 0;
+    totals[index] = 0;
+  }
+  // Keeps the totals of the `count` counters starting at `first` after their hardware counters were cleared
+  void rebase(size_t first, size_t count) { std::fill(previous.begin() + first, previous.begin() + first + count, 0); }
+
+  uint64_t total(size_t index) const { return totals[index]; }
+  const uint64_t* totalsData() const { return totals.data(); }
+  size_t size() const { return totals.size(); }
+};
@@ -0,0 +1,128 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+  Abstraction of the data plane as seen by the control plane: registers,
+  match-action tables and sessions. BfRtBackend talks to the Tofino through
+  the SDE, SimBackend keeps the spintracker program state in memory.
+
+  Names are resolved to handles/ids once at setup; all operations on the
+  readout and programming paths only use these. Operations are synchronous
+  and abort on failure, like the rest of the control plane.
+
+  A session is used by one thread at a time (see DataplaneSessions). Across
+  sessions, one may sync and read a register while another writes its
+  cells; operations on the same table must not run concurrently.
+*/
+typedef uint32_t dp_handle_t;
+typedef uint32_t dp_id_t;
+
+#define MAX_KEY_FIELDS 8
+#define MAX_DATA_FIELDS 8
+
+// Match key of a table entry, fixed size so building it never allocates
+struct TableKey {
+  struct Field {
+    dp_id_t id;
+    uint64_t value;
+    // Inclusive end of range fields
+    uint64_t range_end;
+    bool is_range;
+  };
+
+  Field fields[MAX_KEY_FIELDS];
+  uint32_t count = 0;
+
+  void clear() { count = 0; }
+  void setExact(dp_id_t id, uint64_t value) { fields[count++] = Field{id, value, value, false}; }
+  void setRange(dp_id_t id, uint64_t start, uint64_t end) { fields[count++] = Field{id, start, end, true}; }
+};
+
+// Action and action parameters of a table entry
+struct TableData {
+  struct Field {
+    dp_id_t id;
+    uint64_t value;
+  };
+
+  dp_id_t action_id = 0;
+  Field fields[MAX_DATA_FIELDS];
+  uint32_t count = 0;
+
+  void setAction(dp_id_t id) {
+    action_id = id;
+    count = 0;
+  }
+  void set(dp_id_t id, uint64_t value) { fields[count++] = Field{id, value}; }
+};
+
+class DataplaneSession {
+ public:
+  virtual ~DataplaneSession() = default;
+
+  // Operations between begin and end are sent to the device together
+  virtual void beginBatch() = 0;
+  virtual void endBatch() = 0;
+  // Operations between begin and commit become visible atomically
+  virtual void beginTransaction() = 0;
+  virtual void commitTransaction() = 0;
+  virtual void abortTransaction() = 0;
+  virtual void completeOperations() = 0;
+};
+
+class DataplaneBackend {
+ public:
+  virtual ~DataplaneBackend() = default;
+
+  virtual std::shared_ptr<DataplaneSession> createSession() = 0;
+  virtual uint32_t pipeCount() = 0;
+
+  // Registers, indexed by cell; reads return the value of one pipe
+  virtual dp_handle_t registerOpen(const std::string& name) = 0;
+  virtual size_t registerSize(dp_handle_t reg) = 0;
+  virtual uint64_t registerRead(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint32_t pipe) = 0;
+  virtual void registerWrite(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint64_t value) = 0;
+  // Sets `count` cells starting at `first` in all pipes to `value`, one write per
+  // cell within the batch or transaction open on the session
+  virtual void registerWriteRange(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                  uint64_t value) = 0;
+  // Copies the register state of all pipes from the device; start/wait allow overlapping syncs
+  virtual void registerSyncStart(DataplaneSession& session, dp_handle_t reg) = 0;
+  virtual void registerSyncWait(dp_handle_t reg) = 0;
+  // Preallocates whatever registerReadBatch needs for `count` cells
+  virtual void registerReserve(dp_handle_t reg, uint32_t count) = 0;
+  // Reads `count` cells of the last synced state with one multi-entry get
+  virtual void registerReadBatch(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                 uint32_t pipe, uint64_t* values) = 0;
+  // The same get for the first `pipes` pipes, the value of `pipe` and cell
+  // first + i is stored at values[pipe * count + i]
+  virtual void registerReadBatchPipes(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                      uint32_t pipes, uint64_t* values) = 0;
+
+  // Tables
+  virtual dp_handle_t tableOpen(const std::string& name) = 0;
+  virtual dp_id_t keyFieldId(dp_handle_t table, const std::string& name) = 0;
+  virtual dp_id_t actionId(dp_handle_t table, const std::string& name) = 0;
+  virtual dp_id_t dataFieldId(dp_handle_t table, dp_id_t action, const std::string& name) = 0;
+  virtual size_t tableSize(dp_handle_t table) = 0;
+  virtual void tableEntryAdd(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) = 0;
+  virtual void tableEntryModify(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) = 0;
+  virtual void tableEntryDelete(DataplaneSession& session, dp_handle_t table, const TableKey& key) = 0;
+
+  // Ports
+  virtual void setCpuPort(uint32_t port) = 0;
+  virtual void addPort(uint64_t dev_port, uint32_t speed) = 0;
+};
@@ -0,0 +1,55 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <memory>
+
+#include "dataplane_backend.hpp"
+
+/*
+  Sessions of the control plane, one per path. A session executes one
+  operation at a time and an open batch or transaction holds it until it
+  ends, so on a shared session the register syncs and gets of the readout
+  queue behind flow table batches, recycleFlows() transactions and class
+  plan swaps. With its own session, the readout only waits for the device.
+
+  Threading contract:
+    readout      used only by the readout thread, through the TofinoRegisters
+    programming  used by all threads programming tables (flow manager, which
+                 also runs the class plan reloads, control socket, and the
+                 main thread during setup), through TofinoTables, which
+                 serializes them with its programming_mutex
+
+  Both paths access the same registers: the readout syncs and reads them,
+  recycleFlows() and resetCounters() write them. Backends have to allow this
+  across sessions (see DataplaneBackend). `shared` puts both paths on one
+  session, only for comparisons.
+*/
+class DataplaneSessions {
+ private:
+  std::shared_ptr<DataplaneSession> readout_session;
+  std::shared_ptr<DataplaneSession> programming_session;
+
+ public:
+  DataplaneSessions(DataplaneBackend* backend, bool shared = false)
+      : readout_session(backend->createSession()),
+        programming_session(shared ? readout_session : backend->createSession()) {}
+
+  DataplaneSession* readout() const { return readout_session.get(); }
+  DataplaneSession* programming() const { return programming_session.get(); }
+  bool shared() const { return readout_session == programming_session; }
+
+  void completeOperations() {
+    programming_session->completeOperations();
+    if (!shared()) {
+      readout_session->completeOperations();
+    }
+  }
+};
@@ -0,0 +1,48 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "flow_id_allocator.hpp"
+
+#include <loguru.hpp>
+
+#include <algorithm>
+
+FlowIdAllocator::FlowIdAllocator(uint32_t capacity) : in_use(capacity, false) {
+  // Stack of free ids, the lowest id on top
+  free_ids.reserve(capacity);
+  for (uint32_t flow_id = capacity; flow_id > 0; flow_id--) {
+    free_ids.push_back(flow_id - 1);
+  }
+}
+
+bool FlowIdAllocator::allocate(uint32_t* flow_id) {
+  if (free_ids.empty()) {
+    return false;
+  }
+  *flow_id = free_ids.back();
+  free_ids.pop_back();
+  in_use[*flow_id] = true;
+  return true;
+}
+
+bool FlowIdAllocator::reserve(uint32_t flow_id) {
+  if (flow_id >= in_use.size() || in_use[flow_id]) {
+    return false;
+  }
+  // Reservations only happen at startup, a linear search is fine here
+  free_ids.erase(std::find(free_ids.begin(), free_ids.end(), flow_id));
+  in_use[flow_id] = true;
+  return true;
+}
+
+void FlowIdAllocator::release(uint32_t flow_id) {
+  CHECK_F(flow_id < in_use.size() && in_use[flow_id], "Releasing unallocated flow id %u", flow_id);
+  in_use[flow_id] = false;
+  free_ids.push_back(flow_id);
+}
@@ -0,0 +1,35 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/*
+  Free-list allocator for flow ids in [0, capacity). Allocation and release
+  are O(1); released ids are handed out again before untouched ones.
+*/
+class FlowIdAllocator {
+ private:
+  std::vector<uint32_t> free_ids;
+  std::vector<bool> in_use;
+
+ public:
+  FlowIdAllocator(uint32_t capacity);
+
+  // Returns false if all ids are in use
+  bool allocate(uint32_t* flow_id);
+  // Takes a specific id out of the free list, returns false if it is in use
+  bool reserve(uint32_t flow_id);
+  void release(uint32_t flow_id);
+
+  uint32_t capacity() const { return in_use.size(); }
+  uint32_t available() const { return free_ids.size(); }
+};
@@ -0,0 +1,263 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "flow_manager.hpp"
+
+#include <algorithm>
+
+#include "instrumentation.hpp"
+
+FlowManager::FlowManager(TofinoTables* tables, FlowTable* flows, uint32_t capacity, size_t max_batch_size,
+                         std::chrono::microseconds max_batch_delay)
+    : tables(tables),
+      flows(flows),
+      max_batch_size(max_batch_size),
+      max_batch_delay(max_batch_delay),
+      allocator(capacity),
+      busy(false),
+      running(false),
+      manager_stats{} {
+  flow_ids.reserve(capacity);
+  pending_adds.reserve(max_batch_size);
+  pending_removes.reserve(max_batch_size);
+}
+
+FlowManager::~FlowManager() {
+  stop();
+}
+
+void FlowManager::start() {
+  running = true;
+  programming_thread = std::thread(&FlowManager::programmingLoop, this);
+}
+
+void FlowManager::stop() {
+  if (!running.exchange(false)) {
+    return;
+  }
+  pending_cv.notify_all();
+  programming_thread.join();
+}
+
+bool FlowManager::addFlow(const FlowTuple& tuple, uint32_t* flow_id) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  auto existing = flow_ids.find(tuple);
+  if (existing != flow_ids.end()) {
+    *flow_id = existing->second;
+    return true;
+  }
+
+  if (!allocator.allocate(flow_id)) {
+    manager_stats.rejected++;
+    return false;
+  }
+
+  flow_ids.emplace(tuple, *flow_id);
+  pending_adds.push_back(PendingFlow{tuple, *flow_id, std::chrono::steady_clock::now()});
+  if (pending_adds.size() + pending_removes.size() >= max_batch_size || pending_adds.size() == 1) {
+    pending_cv.notify_one();
+  }
+  return true;
+}
+
+bool FlowManager::addFlow(const FlowTuple& tuple, uint32_t flow_id) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (flow_ids.count(tuple) != 0 || !allocator.reserve(flow_id)) {
+    manager_stats.rejected++;
+    return false;
+  }
+
+  flow_ids.emplace(tuple, flow_id);
+  pending_adds.push_back(PendingFlow{tuple, flow_id, std::chrono::steady_clock::now()});
+  pending_cv.notify_one();
+  return true;
+}
+
+bool FlowManager::reserveFlowId(uint32_t flow_id) {
+  std::unique_lock<std::mutex> lock(mutex);
+  return allocator.reserve(flow_id);
+}
+
+bool FlowManager::removeFlow(const FlowTuple& tuple) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  auto existing = flow_ids.find(tuple);
+  if (existing == flow_ids.end()) {
+    return false;
+  }
+
+  uint32_t flow_id = existing->second;
+  flow_ids.erase(existing);
+
+  // A flow that is not installed yet is simply dropped from the queue
+  for (auto pending = pending_adds.begin(); pending != pending_adds.end(); pending++) {
+    if (pending->flow_id == flow_id) {
+      pending_adds.erase(pending);
+      allocator.release(flow_id);
+      return true;
+    }
+  }
+
+  pending_removes.push_back(PendingFlow{tuple, flow_id, std::chrono::steady_clock::now()});
+  pending_cv.notify_one();
+  return true;
+}
+
+void FlowManager::post(Task task) {
+  std::unique_lock<std::mutex> lock(mutex);
+  pending_tasks.push_back(std::move(task));
+  pending_cv.notify_one();
+}
+
+void FlowManager::setRecycleHandler(RecycleHandler handler) {
+  std::unique_lock<std::mutex> lock(mutex);
+  recycle_handler = std::move(handler);
+}
+
+void FlowManager::flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  pending_cv.notify_one();
+  idle_cv.wait(lock, [this] {
+    return (pending_adds.empty() && pending_removes.empty() && pending_tasks.empty() && !busy) || !running;
+  });
+}
+
+void FlowManager::programmingLoop() {
+  PROBE_THREAD_NAME("flow manager");
+  std::vector<PendingFlow> adds;
+  std::vector<PendingFlow> removes;
+  adds.reserve(max_batch_size);
+  removes.reserve(max_batch_size);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (running) {
+    pending_cv.wait(lock, [this] {
+      return !pending_adds.empty() || !pending_removes.empty() || !pending_tasks.empty() || !running;
+    });
+    if (!running) {
+      break;
+    }
+
+    // Tasks do not wait for a batch to fill
+    if (!pending_tasks.empty()) {
+      std::vector<Task> tasks;
+      tasks.swap(pending_tasks);
+      busy = true;
+
+      lock.unlock();
+      for (auto& task : tasks) {
+        task();
+      }
+      lock.lock();
+
+      busy = false;
+      if (pending_adds.empty() && pending_removes.empty() && pending_tasks.empty()) {
+        idle_cv.notify_all();
+      }
+      continue;
+    }
+
+    // Give a burst the chance to fill the batch, but never delay the oldest request by more than max_batch_delay
+    auto oldest = pending_adds.empty() ? pending_removes.front().enqueued : pending_adds.front().enqueued;
+    pending_cv.wait_until(lock, oldest + max_batch_delay, [this] {
+      return pending_adds.size() + pending_removes.size() >= max_batch_size || !running;
+    });
+
+    // Cap the batch, anything beyond max_batch_size goes into the next one
+    size_t num_removes = std::min(pending_removes.size(), max_batch_size);
+    size_t num_adds = std::min(pending_adds.size(), max_batch_size - num_removes);
+    removes.assign(pending_removes.begin(), pending_removes.begin() + num_removes);
+    pending_removes.erase(pending_removes.begin(), pending_removes.begin() + num_removes);
+    adds.assign(pending_adds.begin(), pending_adds.begin() + num_adds);
+    pending_adds.erase(pending_adds.begin(), pending_adds.begin() + num_adds);
+    busy = true;
+
+    lock.unlock();
+    applyBatch(adds, removes);
+    lock.lock();
+
+    for (auto& removed : removes) {
+      allocator.release(removed.flow_id);
+    }
+    adds.clear();
+    removes.clear();
+    busy = false;
+
+    if (pending_adds.empty() && pending_removes.empty() && pending_tasks.empty()) {
+      idle_cv.notify_all();
+    }
+  }
+  idle_cv.notify_all();
+}
+
+void FlowManager::applyBatch(std::vector<PendingFlow>& adds, std::vector<PendingFlow>& removes) {
+  // Removals first, so a tuple that was removed and added again within one batch ends up installed
+  if (!removes.empty()) {
+    std::vector<FlowTuple> tuples;
+    tuples.reserve(removes.size());
+    for (auto& removed : removes) {
+      flows->remove(removed.flow_id);
+      tuples.push_back(removed.tuple);
+    }
+    tables->flowTableDeleteEntries(tuples.data(), tuples.size());
+
+    // Once no packet maps to them anymore, the ids get cleared registers for their next flow
+    std::vector<uint32_t> flow_ids;
+    flow_ids.reserve(removes.size());
+    for (auto& removed : removes) {
+      flow_ids.push_back(removed.flow_id);
+    }
+    tables->recycleFlows(flow_ids.data(), flow_ids.size());
+
+    RecycleHandler handler;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      handler = recycle_handler;
+    }
+    if (handler) {
+      handler(flow_ids.data(), flow_ids.size());
+    }
+  }
+
+  if (!adds.empty()) {
+    std::vector<flow_entry> entries;
+    entries.reserve(adds.size());
+    for (auto& added : adds) {
+      entries.push_back(flow_entry{added.tuple, added.flow_id});
+    }
+    tables->flowTableAddEntries(entries.data(), entries.size());
+
+    for (auto& added : adds) {
+      flows->add(added.flow_id, added.tuple);
+    }
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  uint64_t latency_us = 0;
+  if (!adds.empty()) {
+    latency_us = std::chrono::duration_cast<std::chrono::microseconds>(now - adds.front().enqueued).count();
+  }
+  if (!removes.empty()) {
+    latency_us = std::max<uint64_t>(
+        latency_us, std::chrono::duration_cast<std::chrono::microseconds>(now - removes.front().enqueued).count());
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  manager_stats.added += adds.size();
+  manager_stats.removed += removes.size();
+  manager_stats.batches++;
+  manager_stats.max_install_latency_us = std::max(manager_stats.max_install_latency_us, latency_us);
+}
+
+FlowManager::Stats FlowManager::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return manager_stats;
+}
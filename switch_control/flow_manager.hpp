@@ -0,0 +1,108 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "flow_id_allocator.hpp"
+#include "flow_table.hpp"
+#include "tofino_tables.hpp"
+
+/*
+  Registers and removes flows at runtime. Requests are queued and installed
+  into flow_id_v4 by a programming thread, which groups them into one BfRt
+  batch once `max_batch_size` requests are pending or the oldest one has
+  waited for `max_batch_delay`. A flow appears in the FlowTable (and thus in
+  the readout) as soon as its entry is installed. The registers of removed
+  flows are cleared in one transaction per batch before their ids are freed.
+  Other programming, e.g., class plan reloads, can be posted to the same
+  thread and runs between two batches.
+*/
+class FlowManager {
+ public:
+  // Called on the programming thread with the ids of a batch of removed flows
+  // once their registers are cleared, before the ids can be allocated again
+  typedef std::function<void(const uint32_t* flow_ids, size_t count)> RecycleHandler;
+  typedef std::function<void()> Task;
+
+  struct Stats {
+    uint64_t added;
+    uint64_t removed;
+    uint64_t rejected;
+    uint64_t batches;
+    uint64_t max_install_latency_us;
+  };
+
+ private:
+  struct PendingFlow {
+    FlowTuple tuple;
+    uint32_t flow_id;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  TofinoTables* tables;
+  FlowTable* flows;
+
+  size_t max_batch_size;
+  std::chrono::microseconds max_batch_delay;
+
+  std::mutex mutex;
+  std::condition_variable pending_cv;
+  std::condition_variable idle_cv;
+  FlowIdAllocator allocator;
+  std::unordered_map<FlowTuple, uint32_t, FlowTupleHash> flow_ids;
+  std::vector<PendingFlow> pending_adds;
+  std::vector<PendingFlow> pending_removes;
+  std::vector<Task> pending_tasks;
+  RecycleHandler recycle_handler;
+  bool busy;
+
+  std::thread programming_thread;
+  std::atomic<bool> running;
+
+  Stats manager_stats;
+
+  void programmingLoop();
+  void applyBatch(std::vector<PendingFlow>& adds, std::vector<PendingFlow>& removes);
+
+ public:
+  FlowManager(TofinoTables* tables, FlowTable* flows, uint32_t capacity, size_t max_batch_size = 1024,
+              std::chrono::microseconds max_batch_delay = std::chrono::milliseconds(1));
+  ~FlowManager();
+
+  void start();
+  void stop();
+
+  // Queues the flow for installation. Returns false if no flow id is free;
+  // an already registered tuple keeps its id.
+  bool addFlow(const FlowTuple& tuple, uint32_t* flow_id);
+  // Queues the flow with a fixed id, e.g., when restoring a flow file
+  bool addFlow(const FlowTuple& tuple, uint32_t flow_id);
+  // Keeps the id from being allocated, e.g., flow id 0 defined statically by the P4 program
+  bool reserveFlowId(uint32_t flow_id);
+  bool removeFlow(const FlowTuple& tuple);
+  // Runs `task` on the programming thread between two batches, e.g., a class
+  // plan swap requested from a thread that must not wait for the device
+  void post(Task task);
+  // Lets state kept per flow id outside the dataplane, e.g., in the outputs, follow the recycling
+  void setRecycleHandler(RecycleHandler handler);
+
+  // Blocks until all queued requests are installed and all posted tasks ran
+  void flush();
+
+  Stats stats();
+};
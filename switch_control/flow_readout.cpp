@@ -0,0 +1,300 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "flow_readout.hpp"
+
+#include <algorithm>
+
+#include "instrumentation.hpp"
+
+static_assert(NUM_RTT_CLASSES == 1 << RTT_CLASS_BITS, "The class counters of consecutive flows must be contiguous");
+
+FlowReadout::FlowReadout(TofinoSwitchControl* tsc, const FlowTable* flows, int pipe_id)
+    : tsc(tsc),
+      flows(flows),
+      pipe_id(pipe_id),
+      pipes(pipe_id == READOUT_ALL_PIPES ? tsc->spin_measurement_register->pipeCount() : 1),
+      flow_capacity(tsc->spin_measurement_register->size()),
+      class_capacity(tsc->spin_rtt_class_counter_register->size()),
+      measurement_totals((size_t)tsc->spin_measurement_counter_register->size() * pipes, MEASUREMENT_COUNTER_BITS),
+      class_totals((size_t)class_capacity * pipes, RTT_CLASS_COUNTER_BITS),
+      period_ns(0) {
+  CHECK_F(tsc->spin_measurement_counter_register->size() == flow_capacity,
+          "Measurement and counter registers differ in size");
+
+  rtt_values.resize((size_t)flow_capacity * pipes);
+  counter_values.resize((size_t)flow_capacity * pipes);
+  accumulator_values.resize((size_t)flow_capacity * pipes);
+  raw_values.resize((size_t)flow_capacity * pipes);
+  class_values.resize((size_t)flow_capacity * NUM_RTT_CLASSES * pipes);
+  active.reserve(flow_capacity);
+  active_generations.reserve(flow_capacity);
+  read_generations.resize(flow_capacity, 0);
+  read.reserve(flow_capacity);
+  runs.reserve(flow_capacity);
+  flow_samples.reserve((size_t)flow_capacity * (pipe_id == READOUT_ALL_PIPES ? pipes + 1 : 1));
+  if (pipe_id == READOUT_ALL_PIPES) {
+    ingress_pipe.resize(flow_capacity);
+    previous_totals.resize((size_t)flow_capacity * pipes);
+  }
+
+  tsc->spin_measurement_register->reserveSnapshot(flow_capacity);
+  tsc->spin_measurement_counter_register->reserveSnapshot(flow_capacity);
+  tsc->spin_ring_buffer_register->reserveSnapshot(flow_capacity);
+  tsc->spin_raw_timestamp_register->reserveSnapshot(flow_capacity);
+  tsc->spin_rtt_class_counter_register->reserveSnapshot(flow_capacity * NUM_RTT_CLASSES);
+}
+
+void FlowReadout::enableTiers(const ReadoutTierConfig& config) {
+  tiers.reset(new ReadoutTiers(flow_capacity, config, 4 + NUM_RTT_CLASSES));
+  previous_totals.resize((size_t)flow_capacity * pipes);
+  if (pipe_id == READOUT_ALL_PIPES) {
+    run_values.resize((size_t)flow_capacity * NUM_RTT_CLASSES * pipes);
+  }
+}
+
+FlowSample FlowReadout::pipeSample(uint32_t flow_id, uint32_t pipe, uint32_t offset, uint32_t count) const {
+  size_t index = (size_t)pipe * count + offset;
+
+  FlowSample sample;
+  sample.flow_id = flow_id;
+  sample.pipe = pipe_id == READOUT_ALL_PIPES ? pipe : pipe_id;
+  sample.per_pipe = false;
+  sample.measurement_count = (uint16_t)counter_values[index];
+  sample.rtt = (uint16_t)rtt_values[index];
+  sample.rtt_accumulator = (uint16_t)accumulator_values[index];
+  sample.raw_timestamp = (uint16_t)raw_values[index];
+  sample.measurement_total = measurement_totals.total((size_t)pipe * flow_capacity + flow_id);
+
+  for (uint32_t rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    sample.class_current[rtt_class] = (uint8_t)class_values[index * NUM_RTT_CLASSES + rtt_class];
+    sample.class_sum[rtt_class] = class_totals.total((size_t)pipe * class_capacity + RTT_CLASS_INDEX(flow_id, rtt_class));
+  }
+  return sample;
+}
+
+void FlowReadout::planRuns() {
+  runs.clear();
+  if (!tiers) {
+    // Only the id range covered by registered flows is read
+    runs.emplace_back(read.front(), read.back() - read.front() + 1);
+    return;
+  }
+
+  for (uint32_t flow_id : read) {
+    if (!runs.empty() && flow_id - (runs.back().first + runs.back().second) <= READOUT_RUN_GAP) {
+      runs.back().second = flow_id - runs.back().first + 1;
+    } else {
+      runs.emplace_back(flow_id, 1);
+    }
+  }
+
+  // Active flows within a run are read along with the due ones
+  read.clear();
+  auto flow = active.begin();
+  for (auto& run : runs) {
+    flow = std::lower_bound(flow, active.end(), run.first);
+    for (; flow != active.end() && *flow < run.first + run.second; ++flow) {
+      read.push_back(*flow);
+    }
+  }
+}
+
+void FlowReadout::snapshotRuns(TofinoRegister* reg, uint32_t cells, uint32_t first, uint32_t count, uint64_t* values) {
+  for (auto& run : runs) {
+    uint64_t run_first = (uint64_t)run.first * cells;
+    uint32_t run_cells = run.second * cells;
+    size_t offset = (size_t)(run.first - first) * cells;
+
+    if (pipe_id != READOUT_ALL_PIPES) {
+      reg->snapshot(run_first, run_cells, pipe_id, values + offset, false);
+    } else if (runs.size() == 1) {
+      reg->snapshotPipes(run_first, run_cells, values, false);
+    } else {
+      // A get returns the run pipe by pipe, scatter it to the layout of the whole range
+      reg->snapshotPipes(run_first, run_cells, run_values.data(), false);
+      for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+        std::copy_n(run_values.data() + (size_t)pipe * run_cells, run_cells, values + (size_t)pipe * count * cells + offset);
+      }
+    }
+  }
+}
+
+void FlowReadout::readout() {
+  flow_samples.clear();
+  read.clear();
+
+  flows->copyActiveFlows(active, active_generations);
+  if (active.empty()) {
+    return;
+  }
+  CHECK_F(active.back() < flow_capacity, "Flow id %u exceeds the register size", active.back());
+
+  // Reused ids continue from their cleared hardware counters
+  for (size_t i = 0; i < active.size(); i++) {
+    uint32_t flow_id = active[i];
+    if (active_generations[i] == read_generations[flow_id]) {
+      continue;
+    }
+    read_generations[flow_id] = active_generations[i];
+    for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+      measurement_totals.reset((size_t)pipe * flow_capacity + flow_id);
+      for (uint32_t rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+        class_totals.reset((size_t)pipe * class_capacity + RTT_CLASS_INDEX(flow_id, rtt_class));
+      }
+    }
+    if (pipe_id == READOUT_ALL_PIPES) {
+      ingress_pipe[flow_id] = 0;
+    }
+    if (tiers) {
+      tiers->reset(flow_id);
+    }
+  }
+
+  if (tiers) {
+    tiers->plan(active, period_ns, &read);
+    if (read.empty()) {
+      return;
+    }
+  } else {
+    read.assign(active.begin(), active.end());
+  }
+  planRuns();
+
+  uint32_t first = runs.front().first;
+  uint32_t count = runs.back().first + runs.back().second - first;
+
+  TofinoRegister* registers[] = {
+      tsc->spin_measurement_register, tsc->spin_measurement_counter_register, tsc->spin_ring_buffer_register,
+      tsc->spin_raw_timestamp_register, tsc->spin_rtt_class_counter_register};
+
+  {
+    PROBE_SCOPE(PROBE_READOUT_SYNC);
+    // Let the hardware syncs of all registers run concurrently
+    for (auto reg : registers) {
+      reg->startSync();
+    }
+    for (auto reg : registers) {
+      reg->waitSync();
+    }
+  }
+
+  {
+    PROBE_SCOPE(PROBE_READOUT_GET);
+    snapshotRuns(tsc->spin_measurement_register, 1, first, count, rtt_values.data());
+    snapshotRuns(tsc->spin_measurement_counter_register, 1, first, count, counter_values.data());
+    snapshotRuns(tsc->spin_ring_buffer_register, 1, first, count, accumulator_values.data());
+    snapshotRuns(tsc->spin_raw_timestamp_register, 1, first, count, raw_values.data());
+    snapshotRuns(tsc->spin_rtt_class_counter_register, NUM_RTT_CLASSES, first, count, class_values.data());
+
+    // The counters that advance in this cycle tell the ingress pipe and the activity of a flow
+    if (pipe_id == READOUT_ALL_PIPES || tiers) {
+      for (size_t i = 0; i < read.size(); i++) {
+        for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+          previous_totals[i * pipes + pipe] = measurement_totals.total((size_t)pipe * flow_capacity + read[i]);
+        }
+      }
+    }
+  }
+
+  {
+    PROBE_SCOPE(PROBE_READOUT_WIDEN);
+    // Widen the counters of every run in one pass each
+    for (auto& run : runs) {
+      size_t offset = run.first - first;
+      for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+        measurement_totals.update((size_t)pipe * flow_capacity + run.first,
+                                  counter_values.data() + (size_t)pipe * count + offset, run.second);
+        class_totals.update((size_t)pipe * class_capacity + RTT_CLASS_INDEX(run.first, 0),
+                            class_values.data() + ((size_t)pipe * count + offset) * NUM_RTT_CLASSES,
+                            (size_t)run.second * NUM_RTT_CLASSES);
+      }
+    }
+  }
+
+  PROBE_SCOPE(PROBE_READOUT_SAMPLES);
+  if (pipe_id != READOUT_ALL_PIPES) {
+    for (size_t i = 0; i < read.size(); i++) {
+      uint32_t flow_id = read[i];
+      if (tiers) {
+        tiers->update(flow_id, measurement_totals.total(flow_id) - previous_totals[i]);
+      }
+      flow_samples.push_back(pipeSample(flow_id, 0, flow_id - first, count));
+    }
+    return;
+  }
+
+  for (size_t i = 0; i < read.size(); i++) {
+    uint32_t flow_id = read[i];
+    uint32_t offset = flow_id - first;
+
+    // Flows without new measurements stay with their previous pipe
+    uint64_t largest_delta = 0;
+    uint64_t flow_delta = 0;
+    for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+      uint64_t delta = measurement_totals.total((size_t)pipe * flow_capacity + flow_id) - previous_totals[i * pipes + pipe];
+      flow_delta += delta;
+      if (delta > largest_delta) {
+        largest_delta = delta;
+        ingress_pipe[flow_id] = pipe;
+      }
+    }
+    if (tiers) {
+      tiers->update(flow_id, flow_delta);
+    }
+
+    // Registers of the ingress pipe, totals of all pipes
+    FlowSample merged = pipeSample(flow_id, ingress_pipe[flow_id], offset, count);
+    merged.measurement_total = 0;
+    for (uint32_t rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+      merged.class_sum[rtt_class] = 0;
+    }
+    for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+      merged.measurement_total += measurement_totals.total((size_t)pipe * flow_capacity + flow_id);
+      for (uint32_t rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+        merged.class_sum[rtt_class] += class_totals.total((size_t)pipe * class_capacity + RTT_CLASS_INDEX(flow_id, rtt_class));
+      }
+    }
+    flow_samples.push_back(merged);
+
+    for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+      if (measurement_totals.total((size_t)pipe * flow_capacity + flow_id) > 0) {
+        FlowSample sample = pipeSample(flow_id, pipe, offset, count);
+        sample.per_pipe = true;
+        flow_samples.push_back(sample);
+      }
+    }
+  }
+}
+
+bool FlowReadout::resetCounters(TofinoTables* tables) {
+  if (read.empty()) {
+    return true;
+  }
+  if (!tables->resetCounters(read.data(), read.size())) {
+    return false;
+  }
+
+  // The same runs of consecutive ids as the transaction
+  size_t run_start = 0;
+  while (run_start < read.size()) {
+    size_t run_end = run_start + 1;
+    while (run_end < read.size() && read[run_end] == read[run_end - 1] + 1) {
+      run_end++;
+    }
+    uint32_t first = read[run_start];
+    uint32_t count = run_end - run_start;
+    for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+      measurement_totals.rebase((size_t)pipe * flow_capacity + first, count);
+      class_totals.rebase((size_t)pipe * class_capacity + RTT_CLASS_INDEX(first, 0), (size_t)count * NUM_RTT_CLASSES);
+    }
+    run_start = run_end;
+  }
+  return true;
+}
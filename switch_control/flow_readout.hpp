@@ -0,0 +1,124 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "counter_widener.hpp"
+#include "flow_table.hpp"
+#include "readout_tiers.hpp"
+#include "spintracker_params.hpp"
+#include "tofino_switch_control.hpp"
+
+// FlowReadout pipe id to read all pipes with the same gets
+#define READOUT_ALL_PIPES -1
+// Largest id gap between two due flows that are still gotten in one run
+#define READOUT_RUN_GAP 8
+
+// Register values of one flow after a readout cycle
+struct FlowSample {
+  uint32_t flow_id;
+  // Pipe the flow ingresses on, or the pipe of a per-pipe sample
+  uint8_t pipe;
+  // Values of a single pipe following the merged sample of the flow
+  bool per_pipe;
+  uint16_t measurement_count;
+  uint16_t rtt;
+  uint16_t rtt_accumulator;
+  uint16_t raw_timestamp;
+  uint8_t class_current[NUM_RTT_CLASSES];
+  // Totals of the 8-bit measurement and class counters since the start
+  uint64_t measurement_total;
+  uint64_t class_sum[NUM_RTT_CLASSES];
+};
+
+/*
+  Reads the spin bit registers of all registered flows. Every cycle snapshots
+  the id range covered by the flow table with one sync per register and
+  widens the per-flow measurement and class counters to 64-bit totals. A
+  flow id that was removed and registered again starts over at zero totals,
+  its registers were cleared when it was recycled.
+
+  With READOUT_ALL_PIPES, every get keeps the values of all pipes. A flow is
+  attributed to the pipe whose measurement counter advanced most in the
+  cycle, i.e., the pipe it ingresses on. Its merged sample carries the
+  registers of that pipe and the totals summed over all pipes, followed by
+  one per-pipe sample for every pipe that measured the flow.
+
+  With readout tiers enabled, only the flows due in a cycle are read and
+  sampled. Due flows less than READOUT_RUN_GAP ids apart are gotten in one
+  run together with the active flows in between; a cycle without due flows
+  skips the register syncs altogether.
+*/
+class FlowReadout {
+ private:
+  TofinoSwitchControl* tsc;
+  const FlowTable* flows;
+  int pipe_id;
+  // Pipes kept from every get, 1 for a single pipe
+  uint32_t pipes;
+  uint32_t flow_capacity;
+  uint32_t class_capacity;
+
+  // Snapshot buffers, indexed by pipe * count + flow id - first read flow id
+  std::vector<uint64_t> rtt_values;
+  std::vector<uint64_t> counter_values;
+  std::vector<uint64_t> accumulator_values;
+  std::vector<uint64_t> raw_values;
+  std::vector<uint64_t> class_values;
+
+  // Indexed by pipe * flow_capacity + flow_id, and by pipe * class_capacity + flow_id << RTT_CLASS_BITS | class
+  CounterWidener measurement_totals;
+  CounterWidener class_totals;
+
+  // READOUT_ALL_PIPES only: attributed pipe per flow id, and the gets of a run before they are scattered
+  std::vector<uint8_t> ingress_pipe;
+  std::vector<uint64_t> run_values;
+  // Per-pipe measurement totals of the read flows before the cycle
+  std::vector<uint64_t> previous_totals;
+
+  std::unique_ptr<ReadoutTiers> tiers;
+  int64_t period_ns;
+
+  std::vector<uint32_t> active;
+  // Flows read in the cycle, and the runs of ids they are gotten in as first id and count
+  std::vector<uint32_t> read;
+  std::vector<std::pair<uint32_t, uint32_t>> runs;
+  // Generation of every active id, and the generation each id was last read with
+  std::vector<uint32_t> active_generations;
+  std::vector<uint32_t> read_generations;
+  std::vector<FlowSample> flow_samples;
+
+  FlowSample pipeSample(uint32_t flow_id, uint32_t pipe, uint32_t offset, uint32_t count) const;
+  void planRuns();
+  // Gets the runs of `reg`, `cells` cells per flow, into `values` laid out for the `count` ids from `first`
+  void snapshotRuns(TofinoRegister* reg, uint32_t cells, uint32_t first, uint32_t count, uint64_t* values);
+
+ public:
+  // `pipe_id` is a pipe or READOUT_ALL_PIPES
+  FlowReadout(TofinoSwitchControl* tsc, const FlowTable* flows, int pipe_id);
+
+  // Reads only the flows due in their activity tier from now on
+  void enableTiers(const ReadoutTierConfig& config);
+  // Length of the readout cycles, refills the read budget of the tiers
+  void setPeriod(int64_t ns) { period_ns = ns; }
+  const ReadoutTiers* readoutTiers() const { return tiers.get(); }
+
+  void readout();
+  // Clears the hardware measurement and class counters of the flows read in the
+  // last cycle and continues their totals from zero, so the 8-bit counters do
+  // not wrap between cycles. Increments since the sync of the cycle are lost;
+  // flows the cycle did not read keep their counters.
+  // False if the tables were busy and nothing was reset, retry after the next cycle.
+  bool resetCounters(TofinoTables* tables);
+  const std::vector<FlowSample>& samples() const { return flow_samples; }
+};
@@ -0,0 +1,73 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "flow_state_store.hpp"
+
+#include <loguru.hpp>
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstring>
+
+#define HUGE_PAGE_SIZE (2 << 20)
+
+static size_t alignTo(size_t offset, size_t alignment) {
+  return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+FlowStateStore::FlowStateStore(uint32_t capacity) : capacity(capacity), huge_pages(false), active_count(0) {
+  size_t words = (capacity + 63) / 64;
+  size_t summary_words = (words + 63) / 64;
+
+  size_t class_current_offset = alignTo((size_t)capacity * sizeof(FlowHotState), 64);
+  size_t class_total_offset = alignTo(class_current_offset + (size_t)capacity * NUM_RTT_CLASSES, 64);
+  size_t active_offset = alignTo(class_total_offset + (size_t)capacity * NUM_RTT_CLASSES * sizeof(uint64_t), 64);
+  size_t summary_offset = alignTo(active_offset + words * sizeof(uint64_t), 64);
+  map_size = alignTo(summary_offset + summary_words * sizeof(uint64_t), HUGE_PAGE_SIZE);
+
+  // Reserved huge pages first, they are populated right away
+  void* mapped = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                      -1, 0);
+  if (mapped != MAP_FAILED) {
+    huge_pages = true;
+  } else {
+    mapped = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK_F(mapped != MAP_FAILED, "Cannot allocate the flow state of %u flows: %s", capacity, strerror(errno));
+    // Transparent huge pages, if enabled; touching every page afterwards allocates it now
+    madvise(mapped, map_size, MADV_HUGEPAGE);
+    memset(mapped, 0, map_size);
+  }
+
+  map = (uint8_t*)mapped;
+  hot = (FlowHotState*)map;
+  class_current = map + class_current_offset;
+  class_total = (uint64_t*)(map + class_total_offset);
+  active = (uint64_t*)(map + active_offset);
+  active_summary = (uint64_t*)(map + summary_offset);
+}
+
+FlowStateStore::~FlowStateStore() {
+  munmap(map, map_size);
+}
+
+void FlowStateStore::deactivate(uint32_t flow_id) {
+  if (!isActive(flow_id)) {
+    return;
+  }
+  active[flow_id / 64] &= ~(1ULL << (flow_id % 64));
+  if (active[flow_id / 64] == 0) {
+    active_summary[flow_id / 4096] &= ~(1ULL << (flow_id / 64 % 64));
+  }
+  active_count--;
+
+  memset(&hot[flow_id], 0, sizeof(FlowHotState));
+  memset(classCurrent(flow_id), 0, NUM_RTT_CLASSES);
+  memset(classTotals(flow_id), 0, NUM_RTT_CLASSES * sizeof(uint64_t));
+}
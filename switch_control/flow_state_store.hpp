@@ -0,0 +1,121 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "spintracker_params.hpp"
+
+enum FlowStateSource : uint8_t {
+  FLOW_STATE_NONE = 0,
+  // Register readout
+  FLOW_STATE_SAMPLE = 1,
+  // Mirrored measurement report
+  FLOW_STATE_REPORT = 2,
+};
+
+// Fields touched by every update, two flows per cache line
+struct FlowHotState {
+  // CLOCK_MONOTONIC nanoseconds of the last update
+  int64_t updated_ns;
+  uint64_t measurement_total;
+  uint16_t rtt;
+  uint16_t rtt_accumulator;
+  // Last value of the wrapping measurement counter
+  uint16_t measurement_count;
+  // Raw timestamp register of a sample, switch time of a report
+  uint16_t time;
+  uint8_t class_id;
+  uint8_t pipe;
+  uint8_t source;
+  uint8_t padding[5];
+};
+
+static_assert(sizeof(FlowHotState) == 32, "Hot flow state has to tile cache lines");
+
+/*
+  Latest state of every flow id, indexed directly by flow id and sized for
+  all MAX_FLOW_IDS flows up front, so memory use is fixed (memoryBytes()).
+
+  Struct of arrays in one mapping: the hot records, then the class counters
+  (current values and totals), which are only read by queries, then a
+  bitmap of the active flows with a summary bit per bitmap word. Iterating
+  the active flows touches the summary, the non-empty bitmap words and the
+  active flows only. The mapping uses huge pages if the system has them
+  reserved and transparent huge pages otherwise, and is populated at
+  construction, so updates never fault.
+
+  Not synchronized, callers serialize updates and reads.
+*/
+class FlowStateStore {
+ private:
+  uint32_t capacity;
+  uint8_t* map;
+  size_t map_size;
+  bool huge_pages;
+
+  FlowHotState* hot;
+  uint8_t* class_current;  // capacity x NUM_RTT_CLASSES
+  uint64_t* class_total;   // capacity x NUM_RTT_CLASSES
+  uint64_t* active;
+  uint64_t* active_summary;
+  size_t active_count;
+
+ public:
+  explicit FlowStateStore(uint32_t capacity = MAX_FLOW_IDS);
+  ~FlowStateStore();
+  FlowStateStore(const FlowStateStore&) = delete;
+  FlowStateStore& operator=(const FlowStateStore&) = delete;
+
+  // Marks the flow active, its state is left as is
+  FlowHotState& activate(uint32_t flow_id) {
+    uint64_t bit = 1ULL << (flow_id % 64);
+    if ((active[flow_id / 64] & bit) == 0) {
+      active[flow_id / 64] |= bit;
+      active_summary[flow_id / 4096] |= 1ULL << (flow_id / 64 % 64);
+      active_count++;
+    }
+    return hot[flow_id];
+  }
+  // Clears the state of the flow
+  void deactivate(uint32_t flow_id);
+
+  bool isActive(uint32_t flow_id) const {
+    return flow_id < capacity && (active[flow_id / 64] & (1ULL << (flow_id % 64))) != 0;
+  }
+  const FlowHotState& hotState(uint32_t flow_id) const { return hot[flow_id]; }
+  uint8_t* classCurrent(uint32_t flow_id) { return class_current + (size_t)flow_id * NUM_RTT_CLASSES; }
+  const uint8_t* classCurrent(uint32_t flow_id) const { return class_current + (size_t)flow_id * NUM_RTT_CLASSES; }
+  uint64_t* classTotals(uint32_t flow_id) { return class_total + (size_t)flow_id * NUM_RTT_CLASSES; }
+  const uint64_t* classTotals(uint32_t flow_id) const { return class_total + (size_t)flow_id * NUM_RTT_CLASSES; }
+
+  // Calls `visit(flow_id)` for every active flow in ascending order
+  template <typename Visitor>
+  void forEachActive(Visitor visit) const {
+    for (size_t summary_word = 0; summary_word * 4096 < capacity; summary_word++) {
+      uint64_t words = active_summary[summary_word];
+      while (words != 0) {
+        size_t word = summary_word * 64 + __builtin_ctzll(words);
+        words &= words - 1;
+        uint64_t bits = active[word];
+        while (bits != 0) {
+          visit((uint32_t)(word * 64 + __builtin_ctzll(bits)));
+          bits &= bits - 1;
+        }
+      }
+    }
+  }
+
+  size_t activeCount() const { return active_count; }
+  uint32_t size() const { return capacity; }
+  size_t memoryBytes() const { return map_size; }
+  bool hugePages() const { return huge_pages; }
+};
@@ -0,0 +1,134 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "flow_table.hpp"
+
+#include <arpa/inet.h>
+#include <loguru.hpp>
+
+#include <fstream>
+#include <sstream>
+
+FlowTable::FlowTable(uint32_t max_flows)
+    : tuples(max_flows), registered((max_flows + 63) / 64, 0), generations(max_flows, 0), active_count(0) {}
+
+void FlowTable::add(uint32_t flow_id, const FlowTuple& tuple) {
+  CHECK_F(flow_id < tuples.size(), "Flow id %u exceeds the flow id space", flow_id);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  tuples[flow_id] = tuple;
+  uint64_t bit = 1ULL << (flow_id % 64);
+  if ((registered[flow_id / 64] & bit) == 0) {
+    registered[flow_id / 64] |= bit;
+    active_count++;
+  }
+}
+
+void FlowTable::remove(uint32_t flow_id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  uint64_t bit = 1ULL << (flow_id % 64);
+  if (flow_id >= tuples.size() || (registered[flow_id / 64] & bit) == 0) {
+    return;
+  }
+  registered[flow_id / 64] &= ~bit;
+  generations[flow_id]++;
+  active_count--;
+}
+
+bool FlowTable::contains(uint32_t flow_id) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return flow_id < tuples.size() && (registered[flow_id / 64] & (1ULL << (flow_id % 64))) != 0;
+}
+
+FlowTuple FlowTable::tuple(uint32_t flow_id) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return tuples.at(flow_id);
+}
+
+void FlowTable::copyActiveFlows(std::vector<uint32_t>& ids) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  ids.clear();
+  for (size_t word = 0; word < registered.size(); word++) {
+    uint64_t bits = registered[word];
+    while (bits != 0) {
+      ids.push_back(word * 64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+}
+
+void FlowTable::copyActiveFlows(std::vector<uint32_t>& ids, std::vector<uint32_t>& id_generations) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  ids.clear();
+  id_generations.clear();
+  for (size_t word = 0; word < registered.size(); word++) {
+    uint64_t bits = registered[word];
+    while (bits != 0) {
+      uint32_t flow_id = word * 64 + __builtin_ctzll(bits);
+      ids.push_back(flow_id);
+      id_generations.push_back(generations[flow_id]);
+      bits &= bits - 1;
+    }
+  }
+}
+
+size_t FlowTable::activeCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return active_count;
+}
+
+void FlowTable::loadFromFile(const std::string& path) {
+  std::ifstream file(path);
+  CHECK_F(file.is_open(), "Cannot open flow file %s", path.c_str());
+
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    uint32_t flow_id;
+    std::string src_addr, dst_addr;
+    uint32_t src_port, dst_port;
+    if (!(fields >> flow_id >> src_addr >> dst_addr >> src_port >> dst_port)) {
+      LOG_F(WARNING, "Skipping malformed flow in %s:%d", path.c_str(), line_number);
+      continue;
+    }
+
+    uint32_t src, dst;
+    if (!parseAddress(src_addr, &src) || !parseAddress(dst_addr, &dst)) {
+      LOG_F(WARNING, "Skipping flow with invalid address in %s:%d", path.c_str(), line_number);
+      continue;
+    }
+
+    add(flow_id, FlowTuple{src, dst, (uint16_t)src_port, (uint16_t)dst_port});
+  }
+
+  LOG_F(INFO, "Loaded %zu flows from %s", activeCount(), path.c_str());
+}
+
+std::string FlowTable::addressToString(uint32_t addr) {
+  char buffer[INET_ADDRSTRLEN];
+  struct in_addr in;
+  in.s_addr = htonl(addr);
+  inet_ntop(AF_INET, &in, buffer, sizeof(buffer));
+  return std::string(buffer);
+}
+
+bool FlowTable::parseAddress(const std::string& text, uint32_t* addr) {
+  struct in_addr in;
+  if (inet_pton(AF_INET, text.c_str(), &in) != 1) {
+    return false;
+  }
+  *addr = ntohl(in.s_addr);
+  return true;
+}
@@ -0,0 +1,77 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "spintracker_params.hpp"
+
+// Five-tuple matched by Flow_ID_Static.flow_id_v4 (the protocol is always UDP)
+struct FlowTuple {
+  uint32_t src_addr;
+  uint32_t dst_addr;
+  uint16_t src_port;
+  uint16_t dst_port;
+
+  bool operator==(const FlowTuple& other) const {
+    return src_addr == other.src_addr && dst_addr == other.dst_addr && src_port == other.src_port &&
+           dst_port == other.dst_port;
+  }
+};
+
+struct FlowTupleHash {
+  size_t operator()(const FlowTuple& tuple) const {
+    uint64_t addrs = ((uint64_t)tuple.src_addr << 32) | tuple.dst_addr;
+    uint64_t ports = ((uint64_t)tuple.src_port << 16) | tuple.dst_port;
+    return std::hash<uint64_t>()(addrs ^ (ports * 0x9E3779B97F4A7C15ULL));
+  }
+};
+
+/*
+  Maps flow ids to the five-tuples they are registered for and keeps a bitmap
+  of the registered ids for iterating the active flows. Flows may be added
+  and removed while the readout iterates them; the generation of an id tells
+  the readout that it belongs to a new flow.
+*/
+class FlowTable {
+ private:
+  mutable std::mutex mutex;
+  std::vector<FlowTuple> tuples;
+  std::vector<uint64_t> registered;
+  // Incremented whenever a flow id is removed
+  std::vector<uint32_t> generations;
+  size_t active_count;
+
+ public:
+  FlowTable(uint32_t max_flows = MAX_FLOW_IDS);
+
+  void add(uint32_t flow_id, const FlowTuple& tuple);
+  void remove(uint32_t flow_id);
+  bool contains(uint32_t flow_id) const;
+  FlowTuple tuple(uint32_t flow_id) const;
+
+  // Copies the sorted ids of all registered flows, reusing the capacity of `ids`
+  void copyActiveFlows(std::vector<uint32_t>& ids) const;
+  // The same with the generation of every id, which changes when the id is removed and may be reused
+  void copyActiveFlows(std::vector<uint32_t>& ids, std::vector<uint32_t>& id_generations) const;
+  size_t activeCount() const;
+  uint32_t maxFlows() const { return tuples.size(); }
+
+  // One flow per line: flow_id src_addr dst_addr src_port dst_port
+  void loadFromFile(const std::string& path);
+
+  static std::string addressToString(uint32_t addr);
+  // Dotted IPv4 address in host byte order; false if malformed
+  static bool parseAddress(const std::string& text, uint32_t* addr);
+};
@@ -0,0 +1,242 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "instrumentation.hpp"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const char* PROBE_NAMES[NUM_PROBES] = {
+    "register_read",       "register_write",        "register_sync_start",      "register_sync_wait",
+    "register_get",        "table_rtt_class_entry", "table_rtt_class_plan",     "table_reorder_protection",
+    "table_flow_add",      "table_flow_delete",     "table_recycle_flows",      "table_reset_counters",
+    "session_complete",    "setup_dataplane",       "loop_wait",                "loop_readout",
+    "readout_sync",        "readout_get",           "readout_widen",            "readout_samples",
+    "loop_push",           "loop_commit",           "output_write",
+};
+
+namespace {
+
+// Written by the owning thread only, read by summaries
+struct ProbeCounters {
+  std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum_ns;
+  std::atomic<uint64_t> min_ns;
+  std::atomic<uint64_t> max_ns;
+};
+
+struct TraceEvent {
+  uint64_t start;
+  uint64_t duration;
+  uint32_t arg;
+  uint16_t probe;
+};
+
+struct ThreadProbes {
+  std::string name;
+  long tid;
+  ProbeCounters probes[NUM_PROBES];
+  // Ring of the last events, next_event counts all events ever recorded
+  std::vector<TraceEvent> events;
+  std::atomic<uint64_t> next_event;
+};
+
+struct Clock {
+  uint64_t start_ticks;
+  double ns_per_tick;
+  // Fixed-point ns_per_tick, 32 fractional bits
+  uint64_t ns_multiplier;
+};
+
+std::once_flag calibrated;
+Clock clock_state;
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadProbes>> registry;
+std::atomic<uint32_t> trace_events(0);
+
+thread_local ThreadProbes* thread_probes = nullptr;
+
+int64_t steadyNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void calibrateClock() {
+  uint64_t ticks = Instrumentation::now();
+  int64_t ns = steadyNanoseconds();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  uint64_t elapsed_ticks = Instrumentation::now() - ticks;
+  int64_t elapsed_ns = steadyNanoseconds() - ns;
+
+  clock_state.start_ticks = ticks;
+  clock_state.ns_per_tick = elapsed_ticks > 0 ? (double)elapsed_ns / elapsed_ticks : 1.0;
+  clock_state.ns_multiplier = (uint64_t)(clock_state.ns_per_tick * 4294967296.0);
+}
+
+uint64_t ticksToNanoseconds(uint64_t ticks) {
+  return (uint64_t)(((unsigned __int128)ticks * clock_state.ns_multiplier) >> 32);
+}
+
+ThreadProbes* threadProbes() {
+  if (thread_probes != nullptr) {
+    return thread_probes;
+  }
+  std::call_once(calibrated, calibrateClock);
+
+  std::unique_ptr<ThreadProbes> probes(new ThreadProbes());
+  probes->tid = syscall(SYS_gettid);
+  probes->name = "thread " + std::to_string(probes->tid);
+  for (auto& counters : probes->probes) {
+    for (auto& bucket : counters.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    counters.count.store(0, std::memory_order_relaxed);
+    counters.sum_ns.store(0, std::memory_order_relaxed);
+    counters.min_ns.store(UINT64_MAX, std::memory_order_relaxed);
+    counters.max_ns.store(0, std::memory_order_relaxed);
+  }
+  probes->events.resize(trace_events.load(std::memory_order_relaxed));
+  probes->next_event.store(0, std::memory_order_relaxed);
+
+  // Threads are few and long-lived, their probes stay registered for the final summary
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  registry.push_back(std::move(probes));
+  thread_probes = registry.back().get();
+  return thread_probes;
+}
+
+// Single writer, a plain load and store is enough
+inline void increment(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+const char* Instrumentation::probeName(Probe probe) {
+  return probe < NUM_PROBES ? PROBE_NAMES[probe] : "unknown";
+}
+
+void Instrumentation::calibrate() {
+  std::call_once(calibrated, calibrateClock);
+}
+
+void Instrumentation::enableTrace(uint32_t events) {
+  trace_events.store(events, std::memory_order_relaxed);
+}
+
+void Instrumentation::setThreadName(const std::string& name) {
+  ThreadProbes* probes = threadProbes();
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  probes->name = name;
+}
+
+void Instrumentation::record(Probe probe, uint64_t start, uint64_t end, uint32_t arg) {
+  ThreadProbes* probes = threadProbes();
+  uint64_t ticks = end - start;
+  uint64_t ns = ticksToNanoseconds(ticks);
+
+  ProbeCounters& counters = probes->probes[probe];
+  increment(counters.buckets[LatencyHistogram::bucketIndex(ns)], 1);
+  increment(counters.count, 1);
+  increment(counters.sum_ns, ns);
+  if (ns < counters.min_ns.load(std::memory_order_relaxed)) {
+    counters.min_ns.store(ns, std::memory_order_relaxed);
+  }
+  if (ns > counters.max_ns.load(std::memory_order_relaxed)) {
+    counters.max_ns.store(ns, std::memory_order_relaxed);
+  }
+
+  if (!probes->events.empty()) {
+    uint64_t index = probes->next_event.load(std::memory_order_relaxed);
+    probes->events[index % probes->events.size()] = TraceEvent{start, ticks, arg, probe};
+    probes->next_event.store(index + 1, std::memory_order_release);
+  }
+}
+
+static void mergeCounters(const ProbeCounters& counters, LatencyHistogram* histogram) {
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+  for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    buckets[i] = counters.buckets[i].load(std::memory_order_relaxed);
+  }
+  histogram->merge(buckets, counters.count.load(std::memory_order_relaxed),
+                   counters.sum_ns.load(std::memory_order_relaxed), counters.min_ns.load(std::memory_order_relaxed),
+                   counters.max_ns.load(std::memory_order_relaxed));
+}
+
+std::string Instrumentation::summary(bool per_thread) {
+  std::lock_guard<std::mutex> lock(registry_mutex);
+
+  std::string result = "Probes (" + std::to_string(registry.size()) + " threads)";
+  for (uint32_t probe = 0; probe < NUM_PROBES; probe++) {
+    LatencyHistogram merged;
+    for (auto& probes : registry) {
+      mergeCounters(probes->probes[probe], &merged);
+    }
+    if (merged.count() == 0) {
+      continue;
+    }
+    result += std::string("\n  ") + PROBE_NAMES[probe] + ": " + merged.summary();
+
+    for (size_t i = 0; per_thread && i < registry.size(); i++) {
+      LatencyHistogram thread_histogram;
+      mergeCounters(registry[i]->probes[probe], &thread_histogram);
+      if (thread_histogram.count() > 0) {
+        result += "\n    " + registry[i]->name + ": " + thread_histogram.summary();
+      }
+    }
+  }
+  return result;
+}
+
+bool Instrumentation::writeChromeTrace(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  long pid = getpid();
+  fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  bool first = true;
+  for (auto& probes : registry) {
+    fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %ld, \"tid\": %ld, \"args\": {\"name\": \"%s\"}}",
+            first ? "" : ",\n", pid, probes->tid, probes->name.c_str());
+    first = false;
+
+    if (probes->events.empty()) {
+      continue;
+    }
+    uint64_t end = probes->next_event.load(std::memory_order_acquire);
+    uint64_t begin = end > probes->events.size() ? end - probes->events.size() : 0;
+    for (uint64_t index = begin; index < end; index++) {
+      const TraceEvent& event = probes->events[index % probes->events.size()];
+      // Microseconds since calibration, ticks before it count as 0
+      double start_us = event.start > clock_state.start_ticks
+                            ? ticksToNanoseconds(event.start - clock_state.start_ticks) / 1e3
+                            : 0.0;
+      fprintf(file,
+              ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %ld, \"tid\": %ld, \"ts\": %.3f, \"dur\": %.3f, "
+              "\"args\": {\"arg\": %u}}",
+              probeName((Probe)event.probe), pid, probes->tid, start_us, ticksToNanoseconds(event.duration) / 1e3,
+              event.arg);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,136 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "latency_histogram.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*
+  Timing of the data plane calls and readout loop stages, compiled in with
+  -DWITH_INSTRUMENTATION=ON (SPINTRACKER_INSTRUMENTATION). Without it, the
+  PROBE_* macros expand to nothing.
+
+  PROBE_SCOPE(probe) times the enclosing scope with the TSC. Every thread
+  records into its own histograms and call counts, written only by that
+  thread with relaxed atomics, so recording takes no locks and summaries
+  can be taken at any time. With a trace enabled, every call is also kept
+  in a per-thread ring of the last events, which writeChromeTrace() dumps
+  in the Chrome trace event format (chrome://tracing, Perfetto).
+*/
+enum Probe : uint16_t {
+  // TofinoRegister
+  PROBE_REGISTER_READ,
+  PROBE_REGISTER_WRITE,
+  PROBE_REGISTER_SYNC_START,
+  PROBE_REGISTER_SYNC_WAIT,
+  PROBE_REGISTER_GET,
+  // TofinoTables
+  PROBE_TABLE_RTT_CLASS_ENTRY,
+  PROBE_TABLE_RTT_CLASS_PLAN,
+  PROBE_TABLE_REORDER_PROTECTION,
+  PROBE_TABLE_FLOW_ADD,
+  PROBE_TABLE_FLOW_DELETE,
+  PROBE_TABLE_RECYCLE_FLOWS,
+  PROBE_TABLE_RESET_COUNTERS,
+  // TofinoSwitchControl
+  PROBE_SESSION_COMPLETE,
+  PROBE_SETUP_DATAPLANE,
+  // Readout loop
+  PROBE_LOOP_WAIT,
+  PROBE_LOOP_READOUT,
+  PROBE_READOUT_SYNC,
+  PROBE_READOUT_GET,
+  PROBE_READOUT_WIDEN,
+  PROBE_READOUT_SAMPLES,
+  PROBE_LOOP_PUSH,
+  PROBE_LOOP_COMMIT,
+  // Output writer threads, per batch of records
+  PROBE_OUTPUT_WRITE,
+  NUM_PROBES
+};
+
+class Instrumentation {
+ public:
+  static constexpr bool enabled() {
+#ifdef SPINTRACKER_INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+  }
+
+  static const char* probeName(Probe probe);
+
+  // Measures the TSC frequency, done on first use otherwise; takes about 20 ms
+  static void calibrate();
+  // Keeps the last `events` calls of every thread for writeChromeTrace(), call before the threads record
+  static void enableTrace(uint32_t events);
+  // Name of the calling thread in summaries and traces
+  static void setThreadName(const std::string& name);
+
+  // Records a call of `probe` from `start` to `end` (now() ticks) on the calling thread
+  static void record(Probe probe, uint64_t start, uint64_t end, uint32_t arg);
+
+  // Calls and latencies of every probe since the start, merged over all threads, and per thread with `per_thread`
+  static std::string summary(bool per_thread = false);
+  // Writes the traced events of all threads; threads that are still recording may overwrite events being written
+  static bool writeChromeTrace(const std::string& path);
+};
+
+// Times its lifetime as one call of `probe`; `arg`, e.g., a register handle, is kept in traces
+class ProbeScope {
+ private:
+  uint64_t start;
+  Probe probe;
+  uint32_t arg;
+
+ public:
+  explicit ProbeScope(Probe probe, uint32_t arg = 0) : start(Instrumentation::now()), probe(probe), arg(arg) {}
+  ~ProbeScope() { Instrumentation::record(probe, start, Instrumentation::now(), arg); }
+  ProbeScope(const ProbeScope&) = delete;
+  ProbeScope& operator=(const ProbeScope&) = delete;
+};
+
+#define PROBE_CONCAT_(a, b) a##b
+#define PROBE_CONCAT(a, b) PROBE_CONCAT_(a, b)
+
+#ifdef SPINTRACKER_INSTRUMENTATION
+#define PROBE_SCOPE(probe) ProbeScope PROBE_CONCAT(probe_scope_, __LINE__)(probe)
+#define PROBE_SCOPE_ARG(probe, arg) ProbeScope PROBE_CONCAT(probe_scope_, __LINE__)(probe, arg)
+#define PROBE_THREAD_NAME(name) Instrumentation::setThreadName(name)
+#else
+#define PROBE_SCOPE(probe) \
+  do {                     \
+  } while (0)
+#define PROBE_SCOPE_ARG(probe, arg) \
+  do {                              \
+  } while (0)
+#define PROBE_THREAD_NAME(name) \
+  do {                          \
+  } while (0)
+#endif
@@ -0,0 +1,112 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "latency_histogram.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+uint32_t LatencyHistogram::bucketIndex(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  // Position of the highest bit selects the power of two, the following bits the sub-bucket
+  uint32_t exponent = 63 - __builtin_clzll(value);
+  uint32_t sub_bucket = (value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(uint32_t index) {
+  if (index < HISTOGRAM_SUB_BUCKETS) {
+    return index;
+  }
+  uint32_t exponent = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKET_BITS - 1;
+  uint64_t sub_bucket = index % HISTOGRAM_SUB_BUCKETS;
+  uint64_t width = 1ULL << (exponent - HISTOGRAM_SUB_BUCKET_BITS);
+  return (1ULL << exponent) + (sub_bucket + 1) * width - 1;
+}
+
+void LatencyHistogram::record(uint64_t value_ns) {
+  buckets[bucketIndex(value_ns)]++;
+  total_count++;
+  total_sum += value_ns;
+  if (value_ns < min_value) {
+    min_value = value_ns;
+  }
+  if (value_ns > max_value) {
+    max_value = value_ns;
+  }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    buckets[i] += other.buckets[i];
+  }
+  total_count += other.total_count;
+  total_sum += other.total_sum;
+  if (other.min_value < min_value) {
+    min_value = other.min_value;
+  }
+  if (other.max_value > max_value) {
+    max_value = other.max_value;
+  }
+}
+
+void LatencyHistogram::merge(const uint64_t* bucket_counts, uint64_t count, uint64_t sum, uint64_t min, uint64_t max) {
+  if (count == 0) {
+    return;
+  }
+  for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    buckets[i] += bucket_counts[i];
+  }
+  total_count += count;
+  total_sum += sum;
+  if (min < min_value) {
+    min_value = min;
+  }
+  if (max > max_value) {
+    max_value = max;
+  }
+}
+
+void LatencyHistogram::reset() {
+  memset(buckets, 0, sizeof(buckets));
+  total_count = 0;
+  total_sum = 0;
+  min_value = UINT64_MAX;
+  max_value = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+  if (total_count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(q * (total_count - 1)) + 1;
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      uint64_t bound = bucketUpperBound(i);
+      return bound < max_value ? bound : max_value;
+    }
+  }
+  return max_value;
+}
+
+std::string LatencyHistogram::summary() const {
+  char line[256];
+  snprintf(line, sizeof(line), "n=%lu min=%.1f mean=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f us",
+           total_count, min() / 1e3, mean() / 1e3, percentile(0.5) / 1e3, percentile(0.9) / 1e3,
+           percentile(0.99) / 1e3, percentile(0.999) / 1e3, max() / 1e3);
+  return std::string(line);
+}
@@ -0,0 +1,54 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+  Fixed-size log-linear histogram for durations in nanoseconds: every power of
+  two is split into HISTOGRAM_SUB_BUCKETS buckets, so recorded values are
+  accurate to 1/HISTOGRAM_SUB_BUCKETS. Recording is O(1) and never allocates.
+*/
+#define HISTOGRAM_SUB_BUCKET_BITS 2
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+class LatencyHistogram {
+ private:
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+  uint64_t total_count;
+  uint64_t total_sum;
+  uint64_t min_value;
+  uint64_t max_value;
+
+  static uint64_t bucketUpperBound(uint32_t index);
+
+ public:
+  LatencyHistogram();
+
+  static uint32_t bucketIndex(uint64_t value);
+
+  void record(uint64_t value_ns);
+  void merge(const LatencyHistogram& other);
+  // Adds values counted elsewhere, e.g., in atomic buckets; `bucket_counts` holds HISTOGRAM_BUCKETS counts
+  void merge(const uint64_t* bucket_counts, uint64_t count, uint64_t sum, uint64_t min, uint64_t max);
+  void reset();
+
+  uint64_t count() const { return total_count; }
+  uint64_t min() const { return total_count == 0 ? 0 : min_value; }
+  uint64_t max() const { return max_value; }
+  double mean() const { return total_count == 0 ? 0 : (double)total_sum / total_count; }
+  // Upper bound of the bucket holding the q-quantile, 0 <= q <= 1
+  uint64_t percentile(double q) const;
+
+  // One-line summary, values in microseconds
+  std::string summary() const;
+};
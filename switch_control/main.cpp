@@ -8,13 +8,31 @@
 */
 
 #include "tofino_switch_control.hpp"
+#include "sim_backend.hpp"
+#ifndef SPINTRACKER_NO_SDE
+#include "bfrt_backend.hpp"
+#endif
+#include "report_receiver.hpp"
+#include "flow_readout.hpp"
+#include "flow_manager.hpp"
+#include "flow_table.hpp"
+#include "measurement_output.hpp"
+#include "output_pipeline.hpp"
+#include "readout_scheduler.hpp"
+#include "control_server.hpp"
+#include "control_commands.hpp"
+#include "output_sinks.hpp"
+#include "report_replay.hpp"
+#include "instrumentation.hpp"
 #include <chrono>
 #include <thread>
 #include <cmath>
 #include <math.h>
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <numeric>
+#include <algorithm>
 #include <fstream>
 #include <getopt.h>
 #include <sys/time.h> 
@@ -24,13 +42,105 @@
 
 TofinoSwitchControl* tsc;
 
+// Last calls of every thread kept for --trace_file
+#define TRACE_EVENTS_PER_THREAD (1 << 16)
+
 bool LOOP_RUNNING = true;
+volatile sig_atomic_t STATS_REQUESTED = 0;
+volatile sig_atomic_t PLAN_RELOAD_REQUESTED = 0;
 
 void stopTheMainLoop(int sig_num) {
    std::cout << "Interrupt signal (" << sig_num << ") received." << std::endl;
    LOOP_RUNNING = false;
 }
 
+void requestStats(int sig_num) {
+   STATS_REQUESTED = 1;
+}
+
+void requestPlanReload(int sig_num) {
+   PLAN_RELOAD_REQUESTED = 1;
+}
+
+// Swaps in the class plan from the file, keeps the installed one if the file is invalid
+void reloadClassPlan(const std::string& class_plan_file) {
+	std::vector<rtt_class_range> plan;
+	if (class_plan_file.empty() || !loadRttClassPlan(class_plan_file, &plan)){
+		std::cout << "Keeping the installed class plan." << std::endl;
+		return;
+	}
+	rtt_class_plan_diff diff = tsc->applyRTTClassPlan(plan);
+	std::cout << "Class plan: " << diff.added << " added, " << diff.modified << " modified, " << diff.deleted << " deleted, " << diff.unchanged << " unchanged." << std::endl;
+}
+
+
+void printReplaySummary(const ReportReplay::Summary& summary) {
+	double seconds = summary.seconds > 0 ? summary.seconds : 1e-9;
+	std::cout << "Replayed " << summary.reports << " reports from " << summary.packets << " packets (" << summary.malformed << " malformed) in " << summary.files << " files";
+	if (summary.truncated_files > 0){
+		std::cout << ", " << summary.truncated_files << " truncated";
+	}
+	std::cout << "." << std::endl;
+	std::cout << "Flows: " << summary.flows << ", measurements: " << summary.measurements << ", missing reports: " << summary.missing << std::endl;
+	std::cout << std::fixed << std::setprecision(3) << "Took " << summary.seconds << "s: " << summary.bytes / seconds / 1e6 << " MB/s, " << summary.packets / seconds / 1e6 << " Mpackets/s, " << summary.reports / seconds / 1e6 << " Mreports/s" << std::endl;
+	for (size_t worker = 0; worker < summary.worker_reports.size(); worker++){
+		std::cout << "Worker " << worker << ": " << summary.worker_reports[worker] << " reports" << std::endl;
+	}
+	for (auto& stats : summary.outputs) {
+		std::cout << "Output: " << stats.written << " records written, max. queue occupancy " << stats.max_occupancy << std::endl;
+	}
+}
+
+
+// Call latencies every `period_s` seconds, 0 disables the periodic summary
+void printProbeSummary(int period_s, int64_t* next_summary_ns) {
+	if (!Instrumentation::enabled() || period_s <= 0){
+		return;
+	}
+	int64_t now_ns = monotonicNanoseconds();
+	if (now_ns < *next_summary_ns){
+		return;
+	}
+	*next_summary_ns = now_ns + (int64_t) period_s * 1000000000;
+	std::cout << Instrumentation::summary() << std::endl;
+}
+
+void finishInstrumentation(const std::string& trace_file) {
+	if (!Instrumentation::enabled()){
+		return;
+	}
+	std::cout << Instrumentation::summary(true) << std::endl;
+	if (!trace_file.empty()){
+		if (Instrumentation::writeChromeTrace(trace_file)){
+			std::cout << "Trace written to " << trace_file << std::endl;
+		} else{
+			std::cout << "Cannot write the trace to " << trace_file << std::endl;
+		}
+	}
+}
+
+
+void printTierStats(const FlowReadout* readout) {
+	if (readout != nullptr && readout->readoutTiers() != nullptr) {
+		std::cout << readout->readoutTiers()->report() << std::endl;
+	}
+}
+
+
+void printEventStats(const EventOutput* events) {
+	if (events != nullptr) {
+		auto stats = events->stats();
+		std::cout << "Events: " << stats.written << " of " << stats.seen << " samples and reports written, " << stats.changes << " RTT changes detected" << std::endl;
+	}
+}
+
+
+void printPipelineStats(OutputPipeline& pipeline) {
+	for (auto& stats : pipeline.stats()) {
+		std::cout << "Output: " << stats.written << " records written, " << stats.dropped << " dropped, max. queue occupancy " << stats.max_occupancy << std::endl;
+	}
+}
+
 
 int main(int argc, char** argv) {
 
@@ -39,9 +149,40 @@ int main(int argc, char** argv) {
   	int spinbit_reorderingprotection = 0;
 	int pipe_id = 1;
 	int readout_sleep_ms = 5;
+	int readout_period_us = 0;
+	int readout_cpu = -1;
+	int readout_fifo_priority = 0;
 	int configured_rtt = 0;
 	int min_latency = 0;
 	int max_latency = 0;
+	std::string report_interface;
+	std::string flow_file;
+	std::string output_format = "csv";
+	int output_queue = 1 << 16;
+	std::string output_policy = "block";
+	int report_offset = 0;
+	std::string class_plan_file;
+	std::string backend_name = "bfrt";
+	std::string sim_latency = "tofino";
+	int sim_rtt_ms = 0;
+	std::string control_socket;
+	int sketch_flows = 0;
+	int sketch_window_s = 60;
+	std::string sketch_file;
+	std::string stats_shm;
+	std::vector<std::string> replay_files;
+	int replay_workers = 1;
+	int counter_reset_cycles = 0;
+	std::string trace_file;
+	int probe_summary_s = 0;
+	std::string readout_tiers;
+	long max_reads_per_s = 0;
+	long readout_min_rtt_us = 0;
+	std::string output_events;
+	std::string change_detector;
+	int rtt_filters_s = 0;
+	std::string rtt_filter_gains;
+	std::string rtt_filter_file;
 
 	static const struct option long_options[] =
     {
@@ -53,13 +194,44 @@ int main(int argc, char** argv) {
         { "configured_rtt", 			required_argument, 		0, 'd' },
 		{ "min_latency", 				required_argument, 		0, 'm' },
         { "max_latency", 				required_argument, 		0, 'n' },
+        { "report_interface", 			required_argument, 		0, 'i' },
+        { "report_offset", 				required_argument, 		0, 'o' },
+        { "flows", 						required_argument, 		0, 'l' },
+        { "readout_period_us", 			required_argument, 		0, 'u' },
+        { "readout_cpu", 				required_argument, 		0, 'C' },
+        { "readout_fifo_priority", 		required_argument, 		0, 'R' },
+        { "output_format", 				required_argument, 		0, 'F' },
+        { "output_queue", 				required_argument, 		0, 'Q' },
+        { "output_policy", 				required_argument, 		0, 'P' },
+        { "class_plan", 				required_argument, 		0, 'K' },
+        { "backend", 					required_argument, 		0, 'B' },
+        { "sim_latency", 				required_argument, 		0, 'L' },
+        { "sim_rtt_ms", 				required_argument, 		0, 'T' },
+        { "control_socket", 			required_argument, 		0, 'S' },
+        { "sketch_flows", 				required_argument, 		0, 'x' },
+        { "sketch_window_s", 			required_argument, 		0, 'w' },
+        { "sketch_file", 				required_argument, 		0, 'y' },
+        { "stats_shm", 					required_argument, 		0, 'M' },
+        { "replay", 					required_argument, 		0, 'X' },
+        { "replay_workers", 			required_argument, 		0, 'W' },
+        { "counter_reset_cycles", 		required_argument, 		0, 'Z' },
+        { "trace_file", 				required_argument, 		0, 'E' },
+        { "probe_summary_s", 			required_argument, 		0, 'I' },
+        { "readout_tiers", 				required_argument, 		0, 'A' },
+        { "max_reads_per_s", 			required_argument, 		0, 'G' },
+        { "readout_min_rtt_us", 		required_argument, 		0, 'D' },
+        { "output_events", 				required_argument, 		0, 'J' },
+        { "change_detector", 			required_argument, 		0, 'V' },
+        { "rtt_filters", 				required_argument, 		0, 'H' },
+        { "rtt_filter_gains", 			required_argument, 		0, 'Y' },
+        { "rtt_filter_file", 			required_argument, 		0, 'N' },
         0
     };
 
 	while (true)
     {
 
-        const auto opt = getopt_long(argc, argv, "f:sr:p:c:d:m:n:", long_options, nullptr);
+        const auto opt = getopt_long(argc, argv, "f:sr:p:c:d:m:n:i:o:l:u:C:R:F:Q:P:K:B:L:T:S:x:w:y:M:X:W:Z:E:I:A:G:D:J:V:H:Y:N:", long_options, nullptr);
 
         if (-1 == opt)
             break;
@@ -83,7 +255,11 @@ int main(int argc, char** argv) {
 
         case 'p':
 			pipe_id = std::atoi(optarg);
-			std::cout << "Use pipe ID " << std::to_string(pipe_id) << std::endl;
+			if (pipe_id == READOUT_ALL_PIPES){
+				std::cout << "Read all pipes" << std::endl;
+			}else{
+				std::cout << "Use pipe ID " << std::to_string(pipe_id) << std::endl;
+			}
             break;
 
         case 'c':
@@ -108,6 +284,161 @@ int main(int argc, char** argv) {
 			std::cout << "A maximum value of " << std::to_string(max_latency) << " was configured." << std::endl;
             break;
 
+		case 'i':
+			report_interface = std::string(optarg);
+			std::cout << "Receive measurement reports on " << report_interface << std::endl;
+            break;
+
+		case 'o':
+			report_offset = std::atoi(optarg);
+			std::cout << "Measurement reports start at byte " << std::to_string(report_offset) << std::endl;
+            break;
+
+		case 'l':
+			flow_file = std::string(optarg);
+			std::cout << "Read flows from " << flow_file << std::endl;
+            break;
+
+		case 'u':
+			readout_period_us = std::atoi(optarg);
+			std::cout << "Use readout_period_us " << std::to_string(readout_period_us) << std::endl;
+            break;
+
+		case 'C':
+			readout_cpu = std::atoi(optarg);
+			std::cout << "Pin the readout to CPU " << std::to_string(readout_cpu) << std::endl;
+            break;
+
+		case 'R':
+			readout_fifo_priority = std::atoi(optarg);
+			std::cout << "Run the readout with SCHED_FIFO priority " << std::to_string(readout_fifo_priority) << std::endl;
+            break;
+
+		case 'F':
+			output_format = std::string(optarg);
+			std::cout << "Write " << output_format << " output" << std::endl;
+            break;
+
+		case 'Q':
+			output_queue = std::atoi(optarg);
+			std::cout << "Queue up to " << std::to_string(output_queue) << " records per output" << std::endl;
+            break;
+
+		case 'P':
+			output_policy = std::string(optarg);
+			std::cout << "Use output policy " << output_policy << std::endl;
+            break;
+
+		case 'K':
+			class_plan_file = std::string(optarg);
+			std::cout << "Read the RTT class plan from " << class_plan_file << std::endl;
+            break;
+
+		case 'B':
+			backend_name = std::string(optarg);
+			std::cout << "Use the " << backend_name << " backend" << std::endl;
+            break;
+
+		case 'L':
+			sim_latency = std::string(optarg);
+			std::cout << "Simulate " << sim_latency << " access latencies" << std::endl;
+            break;
+
+		case 'T':
+			sim_rtt_ms = std::atoi(optarg);
+			std::cout << "Simulate flows with an RTT of " << std::to_string(sim_rtt_ms) << "ms" << std::endl;
+            break;
+
+		case 'S':
+			control_socket = std::string(optarg);
+			std::cout << "Accept control commands on " << control_socket << std::endl;
+            break;
+
+		case 'x':
+			sketch_flows = std::atoi(optarg);
+			std::cout << "Keep RTT quantile sketches for up to " << std::to_string(sketch_flows) << " flows" << std::endl;
+            break;
+
+		case 'w':
+			sketch_window_s = std::atoi(optarg);
+			std::cout << "Use a sliding quantile window of " << std::to_string(sketch_window_s) << "s" << std::endl;
+            break;
+
+		case 'y':
+			sketch_file = std::string(optarg);
+			std::cout << "Write RTT quantiles to " << sketch_file << std::endl;
+            break;
+
+		case 'M':
+			stats_shm = std::string(optarg);
+			std::cout << "Publish flow state in shared memory " << stats_shm << std::endl;
+            break;
+
+		case 'X':
+			replay_files.push_back(std::string(optarg));
+			std::cout << "Replay reports from " << replay_files.back() << std::endl;
+            break;
+
+		case 'W':
+			replay_workers = std::atoi(optarg);
+			std::cout << "Replay with " << std::to_string(replay_workers) << " workers" << std::endl;
+            break;
+
+		case 'Z':
+			counter_reset_cycles = std::atoi(optarg);
+			std::cout << "Clear the measurement counters every " << std::to_string(counter_reset_cycles) << " readout cycles" << std::endl;
+            break;
+
+		case 'E':
+			trace_file = std::string(optarg);
+			std::cout << "Write a trace of the last data plane calls to " << trace_file << std::endl;
+            break;
+
+		case 'I':
+			probe_summary_s = std::atoi(optarg);
+			std::cout << "Print the call latencies every " << std::to_string(probe_summary_s) << "s" << std::endl;
+            break;
+
+		case 'A':
+			readout_tiers = std::string(optarg);
+			std::cout << "Read hot, warm and idle flows every " << readout_tiers << " readout cycles" << std::endl;
+            break;
+
+		case 'G':
+			max_reads_per_s = std::atol(optarg);
+			std::cout << "Read at most " << std::to_string(max_reads_per_s) << " register cells per second" << std::endl;
+            break;
+
+		case 'D':
+			readout_min_rtt_us = std::atol(optarg);
+			std::cout << "Read every flow before it can measure at an RTT of " << std::to_string(readout_min_rtt_us) << " us for half its counter range" << std::endl;
+            break;
+
+		case 'J':
+			output_events = std::string(optarg);
+			std::cout << "Write only " << output_events << " events" << std::endl;
+            break;
+
+		case 'V':
+			change_detector = std::string(optarg);
+			std::cout << "Detect RTT changes with tolerance,threshold " << change_detector << std::endl;
+            break;
+
+		case 'H':
+			rtt_filters_s = std::atoi(optarg);
+			std::cout << "Filter the RTT samples with a minimum over " << std::to_string(rtt_filters_s) << "s" << std::endl;
+            break;
+
+		case 'Y':
+			rtt_filter_gains = std::string(optarg);
+			std::cout << "Use the smoothed RTT and variation gains " << rtt_filter_gains << std::endl;
+            break;
+
+		case 'N':
+			rtt_filter_file = std::string(optarg);
+			std::cout << "Write the RTT filters to " << rtt_filter_file << std::endl;
+            break;
+
         case 'h': // -h or --help
         case '?': // Unrecognized option
         default:
@@ -131,11 +462,89 @@ int main(int argc, char** argv) {
 		std::cout << " Disabled." << std::endl;
 	}
 
-	tsc = new TofinoSwitchControl(file_path, spinbit_enabled, spinbit_reorderingprotection);
+	// Probes are compiled in with -DWITH_INSTRUMENTATION=ON
+	if (Instrumentation::enabled()){
+		if (!trace_file.empty()){
+			Instrumentation::enableTrace(TRACE_EVENTS_PER_THREAD);
+		}
+		Instrumentation::calibrate();
+		PROBE_THREAD_NAME("main");
+	} else if (!trace_file.empty() || probe_summary_s > 0){
+		std::cout << "Built without instrumentation, call latencies are not recorded." << std::endl;
+	}
+	int64_t next_probe_summary_ns = monotonicNanoseconds() + (int64_t) probe_summary_s * 1000000000;
+
+	// Sinks of the live modes and of every replay worker
+	OutputSinkConfig sink_config{output_format, file_path, true, nullptr, false, output_events, change_detector, !control_socket.empty(), (uint32_t) sketch_flows, sketch_window_s, sketch_file, rtt_filters_s, rtt_filter_gains, rtt_filter_file, stats_shm};
+
+	// Replay mode: captured reports are processed offline, without a data plane
+	if (!replay_files.empty()){
+		// Without a control socket, there is nothing to rotate the output or query the flow state
+		OutputSinkConfig replay_sinks = sink_config;
+		replay_sinks.rotatable = false;
+		replay_sinks.reports = true;
+		replay_sinks.flow_state = false;
+		ReplayConfig replay_config{(size_t) report_offset, (unsigned) std::max(replay_workers, 1), replay_sinks, (size_t) output_queue};
+		ReportReplay replay(replay_config);
+		ReportReplay::Summary summary;
+		std::string error;
+		if (!replay.run(replay_files, &summary, &error)){
+			std::cout << "Cannot replay: " << error << std::endl;
+			return 1;
+		}
+		printReplaySummary(summary);
+		return 0;
+	}
+
+	// The simulated backend runs the whole control plane without a Tofino
+	DataplaneBackend* backend = nullptr;
+	SimBackend* sim = nullptr;
+	if (backend_name == "sim"){
+		sim = new SimBackend(sim_latency == "none" ? SimConfig() : SimConfig::tofino());
+		backend = sim;
+	} else if (backend_name == "bfrt"){
+#ifndef SPINTRACKER_NO_SDE
+		Switchd* switchd = new Switchd("spintracker");
+		switchd->start();
+		LOG_F(INFO, "BFRT Switchd initialization finished");
+		backend = new BfRtBackend(switchd);
+#else
+		std::cout << "Built without the SDE, only the sim backend is available." << std::endl;
+		return 1;
+#endif
+	} else{
+		std::cout << "Unknown backend " << backend_name << std::endl;
+		return 1;
+	}
+
+	tsc = new TofinoSwitchControl(backend, file_path, spinbit_enabled, spinbit_reorderingprotection);
 	tsc->initializeDataplaneInterfaces();
 	tsc->setupDataplane();
 	tsc->setSpinReorderProtection();
 
+	// Flows from the flow file are installed into flow_id_v4 at runtime.
+	// Without a flow file, only flow id 0 (statically defined in the P4 program) is exported.
+	FlowTable flow_table;
+	FlowManager flow_manager(tsc->tables, &flow_table, tsc->tables->flowTableSize());
+	flow_manager.start();
+	if (flow_file.empty()){
+		flow_table.add(0, FlowTuple{0, 0, 0, 0});
+		flow_manager.reserveFlowId(0);
+	} else{
+		FlowTable file_flows;
+		file_flows.loadFromFile(flow_file);
+
+		std::vector<uint32_t> flow_ids;
+		file_flows.copyActiveFlows(flow_ids);
+		for (uint32_t flow_id : flow_ids){
+			if (!flow_manager.addFlow(file_flows.tuple(flow_id), flow_id)){
+				LOG_F(WARNING, "Cannot register flow %u", flow_id);
+			}
+		}
+		flow_manager.flush();
+		std::cout << "Installed " << flow_table.activeCount() << " flows." << std::endl;
+	}
+
 
 	struct sigaction sigHandler;
 
@@ -147,112 +556,244 @@ int main(int argc, char** argv) {
 	sigaction(SIGTERM, &sigHandler, NULL);
 	sigaction(SIGHUP, &sigHandler, NULL);
 
-	std::ofstream statsFile (file_path);
-	if (statsFile.is_open()){
-		std::cout << "Stats output file is ready" << std::endl;
-		statsFile << "timestamp_us, spinbit_counter, spinbit_RTT, spinbit_ringbuffer, spinbit_raw, class0_curr, class0_sum, class1_curr, class1_sum, class2_curr, class2_sum\n";
-	}
+	struct sigaction statsHandler;
 
-	uint16_t spin_RTT_value_uint = 0;
-	uint16_t spin_measurements_uint = 0;
-	uint16_t spin_ring_accumulator_uint = 0;
-	uint16_t spin_raw_uint = 0;
+	statsHandler.sa_handler = requestStats;
+	sigemptyset(&statsHandler.sa_mask);
+	statsHandler.sa_flags = 0;
 
-	uint16_t spin_class_values_0class_sum_uint = 0;
-	uint16_t spin_class_values_1class_sum_uint = 0;
-	uint16_t spin_class_values_2class_sum_uint = 0;
-	uint8_t spin_class_values_0class_uint = 0;
-	uint8_t spin_class_values_1class_uint = 0;
-	uint8_t spin_class_values_2class_uint = 0;
-	uint8_t spin_class_values_0class_uint_prev = 0;
-	uint8_t spin_class_values_1class_uint_prev = 0;
-	uint8_t spin_class_values_2class_uint_prev = 0;
+	sigaction(SIGUSR1, &statsHandler, NULL);
 
-  	auto current_time = std::chrono::system_clock::now();
-	std::time_t time_string;
-	struct tm * timeStruct;
-	char time_Char[25];
+	struct sigaction planHandler;
 
+	planHandler.sa_handler = requestPlanReload;
+	sigemptyset(&planHandler.sa_mask);
+	planHandler.sa_flags = 0;
 
-	std::cout << "RTT Classification Table: " << std::endl;
-	std::cout << "Grease Detection until " << 5 << "ms." << std::endl;
-	tsc->RTTClassTableSetEntry((uint16_t) 0, (uint16_t) 0xFFFF, (uint16_t) 0, (uint16_t) 5, 0);
+	sigaction(SIGUSR2, &planHandler, NULL);
 
-	if (min_latency != 0 && max_latency != 0) {
-		std::cout << "Configure custom range." << std::endl;
-		std::cout << "Expected range: (" << (uint16_t)(4 * min_latency) <<  ", " << (uint16_t)(4 * max_latency) << ") , (" << (uint16_t)(min_latency) << ", " << (uint16_t)(max_latency) << ")." << std::endl;
-		tsc->RTTClassTableSetEntry((uint16_t) (4 * min_latency), (uint16_t) (4 * max_latency), (uint16_t) (min_latency), (uint16_t) (max_latency), 1);
+	// Outputs are written by their own threads, the readout only enqueues records
+	OutputPipeline pipeline(output_queue, OutputPipeline::parsePolicy(output_policy));
+	sink_config.flows = &flow_table;
+	sink_config.reports = !report_interface.empty();
+	OutputSinks sinks;
+	std::string sink_error;
+	if (!createOutputSinks(sink_config, &pipeline, &sinks, &sink_error)){
+		std::cout << sink_error << std::endl;
+		return 1;
+	}
+	if (sinks.output->isOpen()){
+		std::cout << "Stats output file is ready" << std::endl;
+	}else{
+		std::cout << "Something wrong with the stats file." << std::endl;
+	}
+	EventOutput* events = sinks.events;
+	if (events != nullptr){
+		std::cout << "Event filter uses " << events->memoryBytes() / (1 << 20) << " MiB." << std::endl;
+	}
+	// Latest state per flow for the control socket queries
+	FlowStateView* flow_state = sinks.flow_state;
+	if (flow_state != nullptr){
+		std::cout << "Flow state uses " << flow_state->flowStore().memoryBytes() / (1 << 20) << " MiB" << (flow_state->flowStore().hugePages() ? " of huge pages." : ".") << std::endl;
+	}
+	// Removed flows leave the flow state, the stats segment, the filters and the sketches, in order with the samples.
+	// Every exit stops the flow manager before the pipeline goes away.
+	flow_manager.setRecycleHandler([&pipeline](const uint32_t* flow_ids, size_t count){ pipeline.releaseFlows(flow_ids, count); });
+	// Per-flow RTT quantiles
+	RttSketchOutput* sketches = sinks.sketches;
+	if (sketches != nullptr){
+		std::cout << "RTT sketches use " << sketches->memoryBytes() / 1024 << " KiB." << std::endl;
+	}
+	// Windowed minimum and smoothed RTT of every flow, over the individual samples
+	RttFilterOutput* filters = sinks.filters;
+	if (filters != nullptr){
+		std::cout << "RTT filters use " << filters->memoryBytes() / (1 << 20) << " MiB." << std::endl;
+	}
+	pipeline.start();
 
+	std::cout << "RTT Classification Table: " << std::endl;
+	std::vector<rtt_class_range> class_plan;
+	if (!class_plan_file.empty()){
+		CHECK_F(loadRttClassPlan(class_plan_file, &class_plan), "Cannot load the class plan %s", class_plan_file.c_str());
 	} else{
-		std::cout << "Expected range: (" << (uint16_t)(0.9 * 4 * configured_rtt) <<  ", " << (uint16_t)(1.1 * 4 * configured_rtt) << ") , (" << (uint16_t)(0.9 * configured_rtt) << ", " << (uint16_t)(1.1 * configured_rtt) << ")." << std::endl;
-		tsc->RTTClassTableSetEntry((uint16_t) (0.9 * 4 * configured_rtt), (uint16_t) (1.1 * 4 * configured_rtt), (uint16_t) (0.9 * configured_rtt), (uint16_t) (1.1 * configured_rtt), 1);
+		std::cout << "Grease Detection until " << 5 << "ms." << std::endl;
+		class_plan = defaultRttClassPlan(configured_rtt, min_latency, max_latency);
+		if (min_latency != 0 && max_latency != 0) {
+			std::cout << "Configure custom range." << std::endl;
+		}
+		std::cout << "Expected range: (" << class_plan[1].accumulator_min <<  ", " << class_plan[1].accumulator_max << ") , (" << class_plan[1].rtt_min << ", " << class_plan[1].rtt_max << ")." << std::endl;
 	}
+	tsc->applyRTTClassPlan(class_plan);
 
-	int counter = 0;
-  	while (LOOP_RUNNING) {
+	// The period is taken from readout_period_us if given, otherwise from readout_sleep_ms
+	int64_t readout_period_ns = readout_period_us > 0 ? (int64_t) readout_period_us * 1000 : (int64_t) readout_sleep_ms * 1000000;
+	std::unique_ptr<ReadoutScheduler> scheduler;
+	if (report_interface.empty()){
+		scheduler.reset(new ReadoutScheduler(readout_period_ns));
+	}
 
-		if (spinbit_enabled){
-			spin_RTT_value_uint = (uint16_t) tsc->spin_measurement_register->read(0, pipe_id);
+	// Commands run on the control thread, the readout only picks up a new period between cycles
+	ControlContext control_context{tsc, &flow_table, &flow_manager, flow_state, sketches, filters, &pipeline, 0, file_path, scheduler.get(), class_plan_file};
+	std::unique_ptr<ControlServer> control;
+	if (!control_socket.empty()){
+		control.reset(new ControlServer(control_socket));
+		addControlCommands(control.get(), &control_context);
+		control->start();
+	}
+
+	int simulated_rtt_ms = sim_rtt_ms > 0 ? sim_rtt_ms : (configured_rtt > 0 ? configured_rtt : 20);
+
+	// Report mode: every sample arrives as a mirrored packet, no register polling
+	if (!report_interface.empty() && sim != nullptr){
+		// The simulator hands its mirrored reports over directly
+		sim->setReportHandler([&pipeline](const MirrorReport& report) {
+			int64_t timestamp_ns = monotonicNanoseconds();
+			pipeline.pushReport(timestamp_ns, report);
+			pipeline.commit(timestamp_ns);
+		});
+		sim->startTraffic(simulated_rtt_ms, pipe_id);
+
+		while (LOOP_RUNNING) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (PLAN_RELOAD_REQUESTED){
+				PLAN_RELOAD_REQUESTED = 0;
+				flow_manager.post([class_plan_file]{ reloadClassPlan(class_plan_file); });
+			}
+			printProbeSummary(probe_summary_s, &next_probe_summary_ns);
+		}
+		sim->stopTraffic();
+		control.reset();
+		flow_manager.stop();
+
+		std::cout << "Simulated " << sim->packetCount() << " packets and " << sim->reportCount() << " reports." << std::endl;
+		pipeline.stop();
+		printPipelineStats(pipeline);
+		printEventStats(events);
+		finishInstrumentation(trace_file);
+		return 0;
+	} else if (!report_interface.empty()){
+		ReportReceiver receiver(report_interface, report_offset, [&pipeline](const MirrorReport* reports, size_t count) {
+			int64_t timestamp_ns = monotonicNanoseconds();
+			for (size_t i = 0; i < count; i++){
+				pipeline.pushReport(timestamp_ns, reports[i]);
+			}
+			pipeline.commit(timestamp_ns);
+		});
+		receiver.start();
+
+		while (LOOP_RUNNING) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (PLAN_RELOAD_REQUESTED){
+				PLAN_RELOAD_REQUESTED = 0;
+				flow_manager.post([class_plan_file]{ reloadClassPlan(class_plan_file); });
+			}
+			printProbeSummary(probe_summary_s, &next_probe_summary_ns);
+		}
+		receiver.stop();
+		control.reset();
+		flow_manager.stop();
+
+		auto stats = receiver.stats();
+		std::cout << "Received " << stats.reports << " reports in " << stats.blocks << " blocks (" << stats.malformed << " malformed, " << stats.kernel_drops << " dropped by the kernel)." << std::endl;
+		pipeline.stop();
+		printPipelineStats(pipeline);
+		printEventStats(events);
+		finishInstrumentation(trace_file);
+		return 0;
+	}
 
-			spin_measurements_uint = (uint16_t) tsc->spin_measurement_counter_register->read(0, pipe_id);
+	if (sim != nullptr){
+		sim->startTraffic(simulated_rtt_ms, pipe_id);
+	}
+
+	FlowReadout* readout = nullptr;
+	if (spinbit_enabled){
+		readout = new FlowReadout(tsc, &flow_table, pipe_id);
+	}
+	// A read budget alone keeps the default intervals
+	if (readout != nullptr && (!readout_tiers.empty() || max_reads_per_s > 0)){
+		ReadoutTierConfig tier_config;
+		if (!readout_tiers.empty() && !ReadoutTiers::parseIntervals(readout_tiers, &tier_config)){
+			std::cout << "Invalid readout tiers " << readout_tiers << ", expected hot,warm,idle cycles" << std::endl;
+			return 1;
+		}
+		tier_config.max_reads_per_s = (uint64_t) std::max(max_reads_per_s, 0L);
+		if (readout_min_rtt_us > 0){
+			tier_config.min_rtt_ns = (int64_t) readout_min_rtt_us * 1000;
+		}
+		readout->enableTiers(tier_config);
+	}
+
+	int cycles_since_reset = 0;
 
-			spin_ring_accumulator_uint = (uint16_t) tsc->spin_ring_buffer_register->read(0, pipe_id);
+	ReadoutScheduler::configureThread(readout_cpu, readout_fifo_priority);
+	scheduler->start();
 
-			spin_raw_uint = (uint16_t) tsc->spin_raw_timestamp_register->read(0, pipe_id);
+  	while (LOOP_RUNNING) {
 
-			spin_class_values_0class_uint = (uint8_t) tsc->spin_rtt_class_counter_register->read(0, pipe_id);
-			spin_class_values_1class_uint = (uint8_t) tsc->spin_rtt_class_counter_register->read(1, pipe_id);
-			spin_class_values_2class_uint = (uint8_t) tsc->spin_rtt_class_counter_register->read(2, pipe_id);
+		{
+			PROBE_SCOPE(PROBE_LOOP_WAIT);
+			scheduler->waitForNextCycle();
+		}
+		if (!LOOP_RUNNING){
+			break;
 		}
 
+		if (spinbit_enabled){
+			PROBE_SCOPE(PROBE_LOOP_READOUT);
+			readout->setPeriod(scheduler->requestedPeriod());
+			readout->readout();
+		}
+
+		int64_t timestamp_ns = monotonicNanoseconds();
 
-		if (spin_class_values_0class_uint != spin_class_values_0class_uint_prev){
-			if (spin_class_values_0class_uint < spin_class_values_0class_uint_prev){
-				spin_class_values_0class_sum_uint += (255 - (spin_class_values_0class_uint_prev - spin_class_values_0class_uint));
-			} else{
-				spin_class_values_0class_sum_uint += (spin_class_values_0class_uint - spin_class_values_0class_uint_prev);
+		{
+			PROBE_SCOPE(PROBE_LOOP_PUSH);
+			for (size_t i = 0; readout != nullptr && i < readout->samples().size(); i++){
+				pipeline.pushFlowSample(timestamp_ns, readout->samples()[i]);
 			}
-			spin_class_values_0class_uint_prev = spin_class_values_0class_uint;
 		}
-
-		if (spin_class_values_1class_uint != spin_class_values_1class_uint_prev){
-			
-			if (spin_class_values_1class_uint < spin_class_values_1class_uint_prev){
-				spin_class_values_1class_sum_uint += (255 - (spin_class_values_1class_uint_prev - spin_class_values_1class_uint));
-			} else{
-				spin_class_values_1class_sum_uint += (spin_class_values_1class_uint - spin_class_values_1class_uint_prev);
+		{
+			PROBE_SCOPE(PROBE_LOOP_COMMIT);
+			pipeline.commit(timestamp_ns);
+		}
+		scheduler->cycleDone();
+
+		if (STATS_REQUESTED){
+			STATS_REQUESTED = 0;
+			std::cout << scheduler->report() << std::endl;
+			printTierStats(readout);
+			printPipelineStats(pipeline);
+			printEventStats(events);
+			if (Instrumentation::enabled()){
+				std::cout << Instrumentation::summary() << std::endl;
 			}
-			spin_class_values_1class_uint_prev = spin_class_values_1class_uint;
 		}
+		printProbeSummary(probe_summary_s, &next_probe_summary_ns);
 
-		if (spin_class_values_2class_uint != spin_class_values_2class_uint_prev){
-			if (spin_class_values_2class_uint < spin_class_values_2class_uint_prev){
-				spin_class_values_2class_sum_uint += (255 - (spin_class_values_2class_uint_prev - spin_class_values_2class_uint));
-			} else{
-				spin_class_values_2class_sum_uint += (spin_class_values_2class_uint - spin_class_values_2class_uint_prev);
+		// Between two cycles, the transactions cannot interleave with a register sync.
+		// While another thread programs, the reset moves to the next cycle instead of stalling the readout.
+		if (spinbit_enabled && counter_reset_cycles > 0 && ++cycles_since_reset >= counter_reset_cycles){
+			if (readout->resetCounters(tsc->tables)){
+				cycles_since_reset = 0;
 			}
-			spin_class_values_2class_uint_prev = spin_class_values_2class_uint;
 		}
-
-		current_time = std::chrono::system_clock::now();
-		time_string = std::chrono::system_clock::to_time_t(current_time);
-		timeStruct = localtime(&time_string);
-
-		strftime(time_Char, 25, "%Y-%m-%d %H:%M:%S", timeStruct);
-
-		struct timeval timeStamp;
-		gettimeofday(&timeStamp, NULL);
-		unsigned long long us = timeStamp.tv_usec;
-		std::string timestampString = std::to_string(us);
-
-		if (statsFile.is_open()){
-			statsFile << time_Char << std::right << std::setfill('0') << std::setw(6) << timestampString;
-			statsFile << "," << spin_measurements_uint << "," << spin_RTT_value_uint << "," << spin_ring_accumulator_uint << "," << spin_raw_uint << "," << std::to_string(spin_class_values_0class_uint) << "," << spin_class_values_0class_sum_uint  << "," << std::to_string(spin_class_values_1class_uint) << "," << spin_class_values_1class_sum_uint << "," << std::to_string(spin_class_values_2class_uint) << "," << spin_class_values_2class_sum_uint << "\n";
-			statsFile.flush();
-		}else{
-			std::cout << "Something wrong with the stats file." << std::endl;
+		// The swap runs on the programming thread, the readout only hands it over
+		if (PLAN_RELOAD_REQUESTED){
+			PLAN_RELOAD_REQUESTED = 0;
+			flow_manager.post([class_plan_file]{ reloadClassPlan(class_plan_file); });
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(readout_sleep_ms));
 	}
+	if (sim != nullptr){
+		sim->stopTraffic();
+	}
+	control.reset();
+	flow_manager.stop();
+	pipeline.stop();
+	std::cout << scheduler->report() << std::endl;
+	printTierStats(readout);
+	printPipelineStats(pipeline);
+	printEventStats(events);
+	finishInstrumentation(trace_file);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "measurement_log.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#define COLUMN(record, field, column_type)                                                                   \
+  LogColumn { #field, column_type, (uint8_t)(sizeof(record::field) / LOG_TYPE_SIZE(column_type)), (uint16_t)offsetof(record, field) }
+#define LOG_TYPE_SIZE(column_type) (1u << ((column_type) - 1))
+
+std::vector<LogColumn> flowRecordColumns() {
+  return {
+      COLUMN(FlowRecord, timestamp_ns, LOG_U64),
+      COLUMN(FlowRecord, flow_id, LOG_U32),
+      COLUMN(FlowRecord, measurement_count, LOG_U16),
+      COLUMN(FlowRecord, rtt, LOG_U16),
+      COLUMN(FlowRecord, rtt_accumulator, LOG_U16),
+      COLUMN(FlowRecord, raw_timestamp, LOG_U16),
+      COLUMN(FlowRecord, class_current, LOG_U8),
+      COLUMN(FlowRecord, class_sum, LOG_U64),
+      COLUMN(FlowRecord, measurement_total, LOG_U64),
+      COLUMN(FlowRecord, pipe, LOG_U8),
+      COLUMN(FlowRecord, per_pipe, LOG_U8),
+  };
+}
+
+std::vector<LogColumn> reportRecordColumns() {
+  return {
+      COLUMN(ReportRecord, timestamp_ns, LOG_U64),
+      COLUMN(ReportRecord, flow_id, LOG_U32),
+      COLUMN(ReportRecord, measurement_count, LOG_U8),
+      COLUMN(ReportRecord, current_time, LOG_U16),
+      COLUMN(ReportRecord, current_rtt, LOG_U16),
+      COLUMN(ReportRecord, rtt_accumulator, LOG_U16),
+      COLUMN(ReportRecord, class_counter, LOG_U8),
+      COLUMN(ReportRecord, class_id, LOG_U8),
+  };
+}
+
+int64_t monotonicNanoseconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int64_t realtimeNanoseconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t len) {
+  while (len > 0) {
+    ssize_t written = write(fd, data, len);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+BinaryLogWriter::BinaryLogWriter(size_t buffer_size) : fd(-1), buffer(buffer_size), buffer_used(0), record_size(0), records(0) {}
+
+BinaryLogWriter::~BinaryLogWriter() {
+  close();
+}
+
+bool BinaryLogWriter::open(const std::string& path, const char* record_name, const std::vector<LogColumn>& columns, uint32_t record_size) {
+  close();
+
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  this->record_size = record_size;
+  this->records = 0;
+  // Whole records per block
+  buffer.resize(buffer.size() - buffer.size() % record_size);
+
+  LogFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC));
+  header.version = LOG_FILE_VERSION;
+  header.header_size = sizeof(LogFileHeader) + columns.size() * sizeof(LogColumn);
+  header.record_size = record_size;
+  header.column_count = columns.size();
+  strncpy(header.record_name, record_name, sizeof(header.record_name) - 1);
+  header.monotonic_ns = monotonicNanoseconds();
+  header.realtime_ns = realtimeNanoseconds();
+
+  return writeAll(fd, (const uint8_t*)&header, sizeof(header)) &&
+         writeAll(fd, (const uint8_t*)columns.data(), columns.size() * sizeof(LogColumn));
+}
+
+bool BinaryLogWriter::append(const void* record) {
+  if (buffer_used + record_size > buffer.size() && !flush()) {
+    return false;
+  }
+  memcpy(buffer.data() + buffer_used, record, record_size);
+  buffer_used += record_size;
+  records++;
+  return true;
+}
+
+bool BinaryLogWriter::flush() {
+  if (fd < 0 || buffer_used == 0) {
+    return fd >= 0;
+  }
+  bool success = writeAll(fd, buffer.data(), buffer_used);
+  buffer_used = 0;
+  return success;
+}
+
+void BinaryLogWriter::close() {
+  if (fd < 0) {
+    return;
+  }
+  flush();
+  ::close(fd);
+  fd = -1;
+}
+
+BinaryLogReader::BinaryLogReader() : fd(-1), map(nullptr), map_size(0), file_header(nullptr) {}
+
+BinaryLogReader::~BinaryLogReader() {
+  if (map != nullptr) {
+    munmap((void*)map, map_size);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool BinaryLogReader::open(const std::string& path, std::string* error) {
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(LogFileHeader)) {
+    *error = "file too small";
+    return false;
+  }
+
+  map_size = file_stat.st_size;
+  void* mapped = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    *error = strerror(errno);
+    return false;
+  }
+  map = (const uint8_t*)mapped;
+  madvise(mapped, map_size, MADV_SEQUENTIAL);
+
+  file_header = (const LogFileHeader*)map;
+  if (memcmp(file_header->magic, LOG_FILE_MAGIC, sizeof(LOG_FILE_MAGIC)) != 0) {
+    *error = "not a measurement log";
+    return false;
+  }
+  if (file_header->version != LOG_FILE_VERSION) {
+    *error = "unsupported version " + std::to_string(file_header->version);
+    return false;
+  }
+  if (file_header->record_size == 0 || file_header->header_size > map_size ||
+      file_header->header_size != sizeof(LogFileHeader) + file_header->column_count * sizeof(LogColumn)) {
+    *error = "corrupt header";
+    return false;
+  }
+
+  auto columns = (const LogColumn*)(map + sizeof(LogFileHeader));
+  file_columns.assign(columns, columns + file_header->column_count);
+  for (auto& column : file_columns) {
+    if (column.type < LOG_U8 || column.type > LOG_U64 ||
+        column.offset + column.count * LOG_TYPE_SIZE(column.type) > file_header->record_size) {
+      *error = "corrupt column descriptor";
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t BinaryLogReader::recordCount() const {
+  // A trailing partial record (e.g., after a crash) is ignored
+  return (map_size - file_header->header_size) / file_header->record_size;
+}
+
+const uint8_t* BinaryLogReader::record(size_t index) const {
+  return map + file_header->header_size + index * file_header->record_size;
+}
+
+uint64_t BinaryLogReader::value(const uint8_t* record, const LogColumn& column, size_t element) {
+  const uint8_t* field = record + column.offset + element * LOG_TYPE_SIZE(column.type);
+  switch (column.type) {
+    case LOG_U8:
+      return *field;
+    case LOG_U16: {
+      uint16_t value;
+      memcpy(&value, field, sizeof(value));
+      return value;
+    }
+    case LOG_U32: {
+      uint32_t value;
+      memcpy(&value, field, sizeof(value));
+      return value;
+    }
+    default: {
+      uint64_t value;
+      memcpy(&value, field, sizeof(value));
+      return value;
+    }
+  }
+}
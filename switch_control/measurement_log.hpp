@@ -0,0 +1,139 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "spintracker_params.hpp"
+
+/*
+  Binary measurement log: a typed file header describing the columns,
+  followed by fixed-size records. Timestamps are CLOCK_MONOTONIC
+  nanoseconds; the header stores a wall-clock anchor for converting them.
+  tools/spinlog_convert turns the logs into CSV.
+*/
+#define LOG_FILE_MAGIC "SPINLOG"
+#define LOG_FILE_VERSION 1
+
+enum LogColumnType : uint8_t {
+  LOG_U8 = 1,
+  LOG_U16 = 2,
+  LOG_U32 = 3,
+  LOG_U64 = 4,
+};
+
+struct LogColumn {
+  char name[28];
+  uint8_t type;
+  // Number of consecutive values, e.g., one per RTT class
+  uint8_t count;
+  uint16_t offset;
+};
+
+struct LogFileHeader {
+  char magic[8];
+  uint32_t version;
+  // Size of this header including the column descriptors
+  uint32_t header_size;
+  uint32_t record_size;
+  uint32_t column_count;
+  char record_name[32];
+  // Wall clock (CLOCK_REALTIME) at `monotonic_ns`
+  int64_t realtime_ns;
+  int64_t monotonic_ns;
+};
+
+// One row of the register readout
+struct FlowRecord {
+  uint64_t timestamp_ns;
+  uint64_t measurement_total;
+  uint64_t class_sum[NUM_RTT_CLASSES];
+  uint32_t flow_id;
+  uint16_t measurement_count;
+  uint16_t rtt;
+  uint16_t rtt_accumulator;
+  uint16_t raw_timestamp;
+  uint8_t class_current[NUM_RTT_CLASSES];
+  uint8_t pipe;
+  uint8_t per_pipe;
+  uint8_t padding[2];
+};
+
+// One mirrored measurement report
+struct ReportRecord {
+  uint64_t timestamp_ns;
+  uint32_t flow_id;
+  uint16_t current_time;
+  uint16_t current_rtt;
+  uint16_t rtt_accumulator;
+  uint8_t measurement_count;
+  uint8_t class_counter;
+  uint8_t class_id;
+  uint8_t padding[3];
+};
+
+static_assert(sizeof(FlowRecord) == 104, "FlowRecord has to stay packed");
+static_assert(sizeof(ReportRecord) == 24, "ReportRecord has to stay packed");
+
+std::vector<LogColumn> flowRecordColumns();
+std::vector<LogColumn> reportRecordColumns();
+
+int64_t monotonicNanoseconds();
+
+class BinaryLogWriter {
+ private:
+  int fd;
+  std::vector<uint8_t> buffer;
+  size_t buffer_used;
+  uint32_t record_size;
+  uint64_t records;
+
+ public:
+  // Records are collected in a buffer of `buffer_size` bytes and written as one block
+  BinaryLogWriter(size_t buffer_size = 1 << 20);
+  ~BinaryLogWriter();
+
+  bool open(const std::string& path, const char* record_name, const std::vector<LogColumn>& columns, uint32_t record_size);
+  bool isOpen() const { return fd >= 0; }
+
+  // `record` has to point to record_size bytes
+  bool append(const void* record);
+  bool flush();
+  void close();
+
+  uint64_t recordsWritten() const { return records; }
+};
+
+class BinaryLogReader {
+ private:
+  int fd;
+  const uint8_t* map;
+  size_t map_size;
+
+  const LogFileHeader* file_header;
+  std::vector<LogColumn> file_columns;
+
+ public:
+  BinaryLogReader();
+  ~BinaryLogReader();
+
+  // Maps the file, returns false and sets `error` for files that are not measurement logs
+  bool open(const std::string& path, std::string* error);
+
+  const LogFileHeader& header() const { return *file_header; }
+  const std::vector<LogColumn>& columns() const { return file_columns; }
+  size_t recordCount() const;
+  const uint8_t* record(size_t index) const;
+
+  static uint64_t value(const uint8_t* record, const LogColumn& column, size_t element);
+};
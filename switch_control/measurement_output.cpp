@@ -0,0 +1,261 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "measurement_output.hpp"
+
+#include <loguru.hpp>
+
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+
+MeasurementOutput* MeasurementOutput::create(const std::string& format, const std::string& path, const FlowTable* flows, bool reports) {
+  if (format == "binary") {
+    return new BinaryOutput(path, reports);
+  }
+  CHECK_F(format == "csv", "Unknown output format %s", format.c_str());
+  return new CsvOutput(path, flows, reports);
+}
+
+CsvOutput::CsvOutput(const std::string& path, const FlowTable* flows, bool reports)
+    : file(path), flows(flows), reports(reports) {
+  struct timespec realtime;
+  clock_gettime(CLOCK_REALTIME, &realtime);
+  wallclock_offset_ns = (int64_t)realtime.tv_sec * 1000000000 + realtime.tv_nsec - monotonicNanoseconds();
+
+  writeHeader();
+}
+
+void CsvOutput::writeHeader() {
+  if (!file.is_open()) {
+    return;
+  }
+
+  if (reports) {
+    file << "timestamp_us, flow_id, measurement_count, switch_time, spinbit_RTT, spinbit_ringbuffer, class_counter, class_id\n";
+  } else {
+    file << "timestamp_us, flow_id, src_addr, dst_addr, src_port, dst_port, spinbit_counter, spinbit_RTT, spinbit_ringbuffer, spinbit_raw";
+    for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+      file << ", class" << rtt_class << "_curr, class" << rtt_class << "_sum";
+    }
+    file << ", spinbit_total, pipe, per_pipe\n";
+  }
+}
+
+void CsvOutput::writeTimestamp(int64_t timestamp_ns) {
+  int64_t wallclock_ns = timestamp_ns + wallclock_offset_ns;
+  time_t seconds = wallclock_ns / 1000000000;
+  struct tm time_struct;
+  localtime_r(&seconds, &time_struct);
+
+  char time_char[25];
+  strftime(time_char, 25, "%Y-%m-%d %H:%M:%S", &time_struct);
+  file << time_char << std::right << std::setfill('0') << std::setw(6) << (wallclock_ns % 1000000000) / 1000;
+}
+
+void CsvOutput::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  FlowTuple tuple = flows->tuple(sample.flow_id);
+
+  writeTimestamp(timestamp_ns);
+  file << "," << sample.flow_id << "," << FlowTable::addressToString(tuple.src_addr) << "," << FlowTable::addressToString(tuple.dst_addr) << "," << tuple.src_port << "," << tuple.dst_port;
+  file << "," << sample.measurement_count << "," << sample.rtt << "," << sample.rtt_accumulator << "," << sample.raw_timestamp;
+  for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    file << "," << std::to_string(sample.class_current[rtt_class]) << "," << sample.class_sum[rtt_class];
+  }
+  file << "," << sample.measurement_total << "," << std::to_string(sample.pipe) << "," << sample.per_pipe << "\n";
+}
+
+void CsvOutput::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  writeTimestamp(timestamp_ns);
+  file << "," << report.flow_id << "," << std::to_string(report.measurement_count) << "," << report.current_time << "," << report.current_rtt << "," << report.rtt_accumulator_value << "," << std::to_string(report.class_counter) << "," << std::to_string(report.class_id) << "\n";
+}
+
+void CsvOutput::commit() {
+  file.flush();
+}
+
+void CsvOutput::close() {
+  file.close();
+}
+
+bool CsvOutput::reopen(const std::string& path) {
+  file.close();
+  file.clear();
+  file.open(path);
+  writeHeader();
+  return file.is_open();
+}
+
+BinaryOutput::BinaryOutput(const std::string& path, bool reports) : reports(reports) {
+  reopen(path);
+}
+
+void BinaryOutput::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  FlowRecord record;
+  memset(&record, 0, sizeof(record));
+  record.timestamp_ns = timestamp_ns;
+  record.flow_id = sample.flow_id;
+  record.measurement_count = sample.measurement_count;
+  record.rtt = sample.rtt;
+  record.rtt_accumulator = sample.rtt_accumulator;
+  record.raw_timestamp = sample.raw_timestamp;
+  memcpy(record.class_current, sample.class_current, sizeof(record.class_current));
+  memcpy(record.class_sum, sample.class_sum, sizeof(record.class_sum));
+  record.measurement_total = sample.measurement_total;
+  record.pipe = sample.pipe;
+  record.per_pipe = sample.per_pipe;
+  writer.append(&record);
+}
+
+void BinaryOutput::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  ReportRecord record;
+  memset(&record, 0, sizeof(record));
+  record.timestamp_ns = timestamp_ns;
+  record.flow_id = report.flow_id;
+  record.current_time = report.current_time;
+  record.current_rtt = report.current_rtt;
+  record.rtt_accumulator = report.rtt_accumulator_value;
+  record.measurement_count = report.measurement_count;
+  record.class_counter = report.class_counter;
+  record.class_id = report.class_id;
+  writer.append(&record);
+}
+
+void BinaryOutput::close() {
+  writer.close();
+}
+
+bool BinaryOutput::reopen(const std::string& path) {
+  // Flushes the buffered records into the previous file
+  writer.close();
+  if (reports) {
+    return writer.open(path, "report", reportRecordColumns(), sizeof(ReportRecord));
+  }
+  return writer.open(path, "flow", flowRecordColumns(), sizeof(FlowRecord));
+}
+
+void FlowStateView::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  if (sample.per_pipe || sample.flow_id >= store.size()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  FlowHotState& hot = store.activate(sample.flow_id);
+  hot.updated_ns = timestamp_ns;
+  hot.measurement_total = sample.measurement_total;
+  hot.rtt = sample.rtt;
+  hot.rtt_accumulator = sample.rtt_accumulator;
+  hot.measurement_count = sample.measurement_count;
+  hot.time = sample.raw_timestamp;
+  hot.class_id = 0;
+  hot.pipe = sample.pipe;
+  hot.source = FLOW_STATE_SAMPLE;
+  memcpy(store.classCurrent(sample.flow_id), sample.class_current, sizeof(sample.class_current));
+  memcpy(store.classTotals(sample.flow_id), sample.class_sum, sizeof(sample.class_sum));
+}
+
+void FlowStateView::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  if (report.flow_id >= store.size()) {
+    return;
+  }
+  uint8_t rtt_class = report.class_id % NUM_RTT_CLASSES;
+  std::lock_guard<std::mutex> lock(mutex);
+  FlowHotState& hot = store.activate(report.flow_id);
+  hot.updated_ns = timestamp_ns;
+  hot.measurement_total++;
+  hot.rtt = report.current_rtt;
+  hot.rtt_accumulator = report.rtt_accumulator_value;
+  hot.measurement_count = report.measurement_count;
+  hot.time = report.current_time;
+  hot.class_id = report.class_id;
+  hot.source = FLOW_STATE_REPORT;
+  store.classCurrent(report.flow_id)[rtt_class] = report.class_counter;
+  store.classTotals(report.flow_id)[rtt_class]++;
+}
+
+void FlowStateView::commit() {
+  std::lock_guard<std::mutex> lock(mutex);
+  commits++;
+}
+
+void FlowStateView::copyState(uint32_t flow_id, FlowState* state) const {
+  state->hot = store.hotState(flow_id);
+  memcpy(state->class_current, store.classCurrent(flow_id), sizeof(state->class_current));
+  memcpy(state->class_total, store.classTotals(flow_id), sizeof(state->class_total));
+}
+
+bool FlowStateView::flowState(uint32_t flow_id, FlowState* state) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!store.isActive(flow_id)) {
+    return false;
+  }
+  copyState(flow_id, state);
+  return true;
+}
+
+std::vector<std::pair<uint32_t, FlowStateView::FlowState>> FlowStateView::flowStates() const {
+  std::vector<std::pair<uint32_t, FlowState>> result;
+  std::lock_guard<std::mutex> lock(mutex);
+  result.resize(store.activeCount());
+  size_t i = 0;
+  store.forEachActive([&](uint32_t flow_id) {
+    result[i].first = flow_id;
+    copyState(flow_id, &result[i].second);
+    i++;
+  });
+  return result;
+}
+
+void FlowStateView::releaseFlow(uint32_t flow_id) {
+  if (flow_id >= store.size()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  store.deactivate(flow_id);
+}
+
+uint64_t FlowStateView::commitCount() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return commits;
+}
+
+ShmStatsOutput::ShmStatsOutput(const std::string& name, uint32_t capacity) {
+  std::string error;
+  if (!writer.create(name, capacity, &error)) {
+    LOG_F(WARNING, "Cannot create the shared-memory segment %s: %s", name.c_str(), error.c_str());
+  }
+}
+
+void ShmStatsOutput::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  if (sample.per_pipe) {
+    return;
+  }
+  writer.update(sample.flow_id, timestamp_ns, sample.rtt, sample.rtt_accumulator, 0, sample.measurement_total,
+                sample.class_sum);
+}
+
+void ShmStatsOutput::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  ReportTotals& totals = report_totals[report.flow_id];
+  totals.measurements++;
+  totals.classes[report.class_id % NUM_RTT_CLASSES]++;
+  writer.update(report.flow_id, timestamp_ns, report.current_rtt, report.rtt_accumulator_value, report.class_id,
+                totals.measurements, totals.classes);
+}
+
+void ShmStatsOutput::commit() {
+  writer.commit(monotonicNanoseconds());
+}
+
+void ShmStatsOutput::releaseFlow(uint32_t flow_id) {
+  report_totals.erase(flow_id);
+  writer.remove(flow_id);
+}
+
+void ShmStatsOutput::close() {
+  writer.close();
+}
@@ -0,0 +1,149 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flow_readout.hpp"
+#include "flow_state_store.hpp"
+#include "flow_table.hpp"
+#include "measurement_log.hpp"
+#include "mirror_report.hpp"
+#include "stats_shm.hpp"
+
+// Destination of the measurements. Timestamps are CLOCK_MONOTONIC nanoseconds.
+class MeasurementOutput {
+ public:
+  virtual ~MeasurementOutput() = default;
+
+  virtual bool isOpen() = 0;
+  virtual void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) = 0;
+  virtual void writeReport(int64_t timestamp_ns, const MirrorReport& report) = 0;
+  // End of a readout cycle or report batch
+  virtual void commit() = 0;
+  // The flow was removed and its id may be reused; drops what the output keeps about it
+  virtual void releaseFlow(uint32_t flow_id) {}
+  virtual void close() = 0;
+  // Continues in a new file at `path`, called between two commits
+  virtual bool reopen(const std::string& path) = 0;
+
+  // format is "csv" or "binary"; `reports` selects the report columns instead of the readout columns
+  static MeasurementOutput* create(const std::string& format, const std::string& path, const FlowTable* flows, bool reports);
+};
+
+// Human-readable output, flushed after every cycle
+class CsvOutput : public MeasurementOutput {
+ private:
+  std::ofstream file;
+  const FlowTable* flows;
+  bool reports;
+  int64_t wallclock_offset_ns;
+
+  void writeHeader();
+  void writeTimestamp(int64_t timestamp_ns);
+
+ public:
+  CsvOutput(const std::string& path, const FlowTable* flows, bool reports);
+
+  bool isOpen() override { return file.is_open(); }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override;
+  void close() override;
+  bool reopen(const std::string& path) override;
+};
+
+// Fixed-size records written in large blocks, see measurement_log.hpp
+class BinaryOutput : public MeasurementOutput {
+ private:
+  BinaryLogWriter writer;
+  bool reports;
+
+ public:
+  BinaryOutput(const std::string& path, bool reports);
+
+  bool isOpen() override { return writer.isOpen(); }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override {}
+  void close() override;
+  bool reopen(const std::string& path) override;
+};
+
+/*
+  Keeps the latest state of every flow in a FlowStateStore for queries from
+  other threads, e.g., the control socket. Fed by its own pipeline writer, so
+  queries never touch the readout thread. Per-pipe samples are skipped. In
+  report mode, every report counts as one measurement of its class.
+*/
+class FlowStateView : public MeasurementOutput {
+ public:
+  // Copy of the state of one flow
+  struct FlowState {
+    FlowHotState hot;
+    uint8_t class_current[NUM_RTT_CLASSES];
+    uint64_t class_total[NUM_RTT_CLASSES];
+  };
+
+ private:
+  mutable std::mutex mutex;
+  FlowStateStore store;
+  uint64_t commits;
+
+  void copyState(uint32_t flow_id, FlowState* state) const;
+
+ public:
+  FlowStateView() : commits(0) {}
+
+  bool isOpen() override { return true; }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override;
+  void releaseFlow(uint32_t flow_id) override;
+  void close() override {}
+  bool reopen(const std::string& path) override { return true; }
+
+  bool flowState(uint32_t flow_id, FlowState* state) const;
+  // Ordered by flow id
+  std::vector<std::pair<uint32_t, FlowState>> flowStates() const;
+  uint64_t commitCount() const;
+  const FlowStateStore& flowStore() const { return store; }
+};
+
+/*
+  Publishes the latest state of every flow into a shared-memory segment for
+  local readers, see stats_shm.hpp. Per-pipe samples are skipped. In report
+  mode, every report counts as one measurement of its class.
+*/
+class ShmStatsOutput : public MeasurementOutput {
+ private:
+  struct ReportTotals {
+    uint64_t measurements;
+    uint64_t classes[NUM_RTT_CLASSES];
+  };
+
+  StatsShmWriter writer;
+  std::unordered_map<uint32_t, ReportTotals> report_totals;
+
+ public:
+  ShmStatsOutput(const std::string& name, uint32_t capacity);
+
+  bool isOpen() override { return writer.isOpen(); }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override;
+  void releaseFlow(uint32_t flow_id) override;
+  void close() override;
+  bool reopen(const std::string& path) override { return true; }
+};
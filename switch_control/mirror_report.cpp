@@ -0,0 +1,83 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "mirror_report.hpp"
+
+// The codec is checked against the P4 layout at compile time: a report
+// encoded with encodeMirrorReport has to decode to the same values and bytes,
+// and frames of any other type have to be rejected.
+namespace {
+
+struct RoundTrip {
+  uint8_t data[MIRROR_REPORT_SIZE];
+  MirrorReport report;
+};
+
+constexpr RoundTrip roundTrip(uint32_t flow_id, uint8_t count, uint16_t time, uint16_t rtt, uint16_t accumulator,
+                              uint8_t class_counter, uint8_t class_id) {
+  RoundTrip result = {};
+  encodeMirrorReport(MirrorReport{flow_id, count, time, rtt, accumulator, class_counter, class_id}, result.data);
+  decodeMirrorReport(result.data, &result.report);
+  return result;
+}
+
+constexpr bool roundTrips(uint32_t flow_id, uint8_t count, uint16_t time, uint16_t rtt, uint16_t accumulator,
+                          uint8_t class_counter, uint8_t class_id) {
+  RoundTrip result = roundTrip(flow_id, count, time, rtt, accumulator, class_counter, class_id);
+  return result.report.flow_id == flow_id && result.report.measurement_count == count &&
+         result.report.current_time == time && result.report.current_rtt == rtt &&
+         result.report.rtt_accumulator_value == accumulator && result.report.class_counter == class_counter &&
+         result.report.class_id == class_id && isMirrorReport(result.data, MIRROR_REPORT_SIZE);
+}
+
+// Byte image of a report as built by the P4 deparser
+constexpr bool matchesBytes(const uint8_t (&expected)[MIRROR_REPORT_SIZE], uint32_t flow_id, uint8_t count,
+                            uint16_t time, uint16_t rtt, uint16_t accumulator, uint8_t class_counter, uint8_t class_id) {
+  RoundTrip result = roundTrip(flow_id, count, time, rtt, accumulator, class_counter, class_id);
+  for (size_t i = 0; i < MIRROR_REPORT_SIZE; i++) {
+    if (result.data[i] != expected[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+constexpr uint8_t SAMPLE_REPORT[MIRROR_REPORT_SIZE] = {0xAA, 0x34, 0x56, 0x78, 0x9A, 0xBC,
+                                                       0xDE, 0xF0, 0x12, 0x34, 0x56, 0x07};
+
+// The receivers drop frames of another type or shorter than a report
+constexpr bool acceptsOnlyType(uint8_t type) {
+  uint8_t data[MIRROR_REPORT_SIZE] = {};
+  for (size_t i = 0; i < MIRROR_REPORT_SIZE; i++) {
+    data[i] = SAMPLE_REPORT[i];
+  }
+  mirror_header::type::insert(data, type);
+  return isMirrorReport(data, MIRROR_REPORT_SIZE) == (type == MIRROR_REPORT_TYPE) &&
+         !isMirrorReport(data, MIRROR_REPORT_SIZE - 1);
+}
+
+constexpr bool acceptsOnlyReportType() {
+  for (uint8_t type = 0; type < 1 << mirror_header::type::width; type++) {
+    if (!acceptsOnlyType(type)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+static_assert(roundTrips(0, 0, 0, 0, 0, 0, 0), "Empty report does not round-trip");
+static_assert(roundTrips(MAX_FLOW_IDS - 1, 0xFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFF, NUM_RTT_CLASSES - 1),
+              "Report with all bits set does not round-trip");
+static_assert(roundTrips(0x2AAAA, 0x55, 0xA5A5, 0x5A5A, 0x0F0F, 0xF0, 3), "Alternating bits do not round-trip");
+// type 0x2A | flow_id 0x23456 | 0x78 | 0x9ABC | 0xDEF0 | 0x1234 | 0x56 | 7
+static_assert(matchesBytes(SAMPLE_REPORT, 0x23456, 0x78, 0x9ABC, 0xDEF0, 0x1234, 0x56, 7),
+              "Codec disagrees with the mirror_header_h byte layout");
+static_assert(acceptsOnlyReportType(), "Frames of another type pass as reports");
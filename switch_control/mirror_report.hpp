@@ -0,0 +1,76 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bitfield_codec.hpp"
+#include "spintracker_params.hpp"
+
+// Layout of mirror_header_h (spintracker.p4), 96 bits in network byte order:
+// type (6) | flow_id (18) | measurement_count (8) | current_time (16) |
+// current_rtt (16) | rtt_accumulator_value (16) | class_counter (8) | class_id (8)
+#define MIRROR_REPORT_SIZE 12
+#define MIRROR_REPORT_TYPE 0x2A
+
+namespace mirror_header {
+typedef BitField<0, 6> type;
+typedef BitField<type::end, FLOW_ID_BITS> flow_id;
+typedef BitField<flow_id::end, 8> measurement_count;
+typedef BitField<measurement_count::end, 16> current_time;
+typedef BitField<current_time::end, 16> current_rtt;
+typedef BitField<current_rtt::end, 16> rtt_accumulator_value;
+typedef BitField<rtt_accumulator_value::end, 8> class_counter;
+typedef BitField<class_counter::end, 8> class_id;
+
+typedef BitLayout<type, flow_id, measurement_count, current_time, current_rtt, rtt_accumulator_value, class_counter,
+                  class_id>
+    layout;
+}  // namespace mirror_header
+
+static_assert(mirror_header::layout::size == MIRROR_REPORT_SIZE, "mirror_header_h changed its size");
+
+struct MirrorReport {
+  uint32_t flow_id;
+  uint8_t measurement_count;
+  uint16_t current_time;
+  uint16_t current_rtt;
+  uint16_t rtt_accumulator_value;
+  uint8_t class_counter;
+  uint8_t class_id;
+};
+
+constexpr bool isMirrorReport(const uint8_t* data, size_t len) {
+  return len >= MIRROR_REPORT_SIZE && mirror_header::type::extract(data) == MIRROR_REPORT_TYPE;
+}
+
+// Decodes a report in place, `data` has to hold at least MIRROR_REPORT_SIZE bytes
+constexpr void decodeMirrorReport(const uint8_t* data, MirrorReport* report) {
+  report->flow_id = mirror_header::flow_id::extract(data);
+  report->measurement_count = mirror_header::measurement_count::extract(data);
+  report->current_time = mirror_header::current_time::extract(data);
+  report->current_rtt = mirror_header::current_rtt::extract(data);
+  report->rtt_accumulator_value = mirror_header::rtt_accumulator_value::extract(data);
+  report->class_counter = mirror_header::class_counter::extract(data);
+  report->class_id = mirror_header::class_id::extract(data);
+}
+
+// Encodes a report of MIRROR_REPORT_TYPE into MIRROR_REPORT_SIZE bytes, e.g., for replays and benchmarks
+constexpr void encodeMirrorReport(const MirrorReport& report, uint8_t* data) {
+  mirror_header::type::insert(data, MIRROR_REPORT_TYPE);
+  mirror_header::flow_id::insert(data, report.flow_id);
+  mirror_header::measurement_count::insert(data, report.measurement_count);
+  mirror_header::current_time::insert(data, report.current_time);
+  mirror_header::current_rtt::insert(data, report.current_rtt);
+  mirror_header::rtt_accumulator_value::insert(data, report.rtt_accumulator_value);
+  mirror_header::class_counter::insert(data, report.class_counter);
+  mirror_header::class_id::insert(data, report.class_id);
+}
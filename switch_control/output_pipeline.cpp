@@ -0,0 +1,202 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "output_pipeline.hpp"
+
+#include "instrumentation.hpp"
+
+#include <loguru.hpp>
+
+#include <chrono>
+
+// Records moved from the ring to the output in one go
+#define WRITER_BATCH_SIZE 256
+
+OutputPipeline::OutputPipeline(size_t capacity, OverflowPolicy policy)
+    : capacity(capacity), policy(policy), running(false), releases_pending(false) {}
+
+OutputPipeline::~OutputPipeline() {
+  stop();
+}
+
+void OutputPipeline::addSink(MeasurementOutput* output) {
+  sinks.emplace_back(new Sink(output, capacity));
+}
+
+void OutputPipeline::start() {
+  running = true;
+  for (auto& sink : sinks) {
+    sink->writer_thread = std::thread(&OutputPipeline::writerLoop, this, sink.get());
+  }
+}
+
+void OutputPipeline::stop() {
+  if (!running.exchange(false)) {
+    return;
+  }
+  for (auto& sink : sinks) {
+    sink->writer_thread.join();
+    sink->output->close();
+  }
+}
+
+void OutputPipeline::push(const OutputRecord& record) {
+  for (auto& sink : sinks) {
+    uint64_t occupancy = sink->ring.size();
+    if (occupancy > sink->max_occupancy.load(std::memory_order_relaxed)) {
+      sink->max_occupancy.store(occupancy, std::memory_order_relaxed);
+    }
+
+    if (sink->ring.push(record)) {
+      continue;
+    }
+
+    // An output that misses a release would keep the flow forever
+    if (policy == OverflowPolicy::DROP && record.kind != OUTPUT_FLOW_RELEASE) {
+      sink->dropped.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    while (!sink->ring.push(record)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void OutputPipeline::pushFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  OutputRecord record;
+  record.timestamp_ns = timestamp_ns;
+  record.kind = OUTPUT_FLOW_SAMPLE;
+  record.sample = sample;
+  push(record);
+}
+
+void OutputPipeline::pushReport(int64_t timestamp_ns, const MirrorReport& report) {
+  OutputRecord record;
+  record.timestamp_ns = timestamp_ns;
+  record.kind = OUTPUT_REPORT;
+  record.report = report;
+  push(record);
+}
+
+void OutputPipeline::commit(int64_t timestamp_ns) {
+  OutputRecord record;
+  record.timestamp_ns = timestamp_ns;
+
+  if (releases_pending.load(std::memory_order_acquire)) {
+    std::vector<uint32_t> released;
+    {
+      std::lock_guard<std::mutex> lock(release_mutex);
+      released.swap(pending_releases);
+      releases_pending.store(false, std::memory_order_relaxed);
+    }
+    record.kind = OUTPUT_FLOW_RELEASE;
+    for (uint32_t flow_id : released) {
+      record.flow_id = flow_id;
+      push(record);
+    }
+  }
+
+  record.kind = OUTPUT_COMMIT;
+  push(record);
+}
+
+void OutputPipeline::releaseFlows(const uint32_t* flow_ids, size_t count) {
+  std::lock_guard<std::mutex> lock(release_mutex);
+  pending_releases.insert(pending_releases.end(), flow_ids, flow_ids + count);
+  releases_pending.store(true, std::memory_order_release);
+}
+
+void OutputPipeline::writerLoop(Sink* sink) {
+  std::vector<OutputRecord> batch(WRITER_BATCH_SIZE);
+  PROBE_THREAD_NAME("output writer");
+
+  while (true) {
+    // Checked before the pop: once stop() is seen, the records pushed before it are in the ring,
+    // so an empty pop afterwards means everything has been written
+    bool stopping = !running;
+    size_t count = sink->ring.popBatch(batch.data(), batch.size());
+    if (count == 0) {
+      if (stopping) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+
+    PROBE_SCOPE_ARG(PROBE_OUTPUT_WRITE, count);
+    uint64_t records = 0;
+    for (size_t i = 0; i < count; i++) {
+      const OutputRecord& record = batch[i];
+      switch (record.kind) {
+        case OUTPUT_FLOW_SAMPLE:
+          sink->output->writeFlowSample(record.timestamp_ns, record.sample);
+          records++;
+          break;
+        case OUTPUT_REPORT:
+          sink->output->writeReport(record.timestamp_ns, record.report);
+          records++;
+          break;
+        case OUTPUT_FLOW_RELEASE:
+          sink->output->releaseFlow(record.flow_id);
+          break;
+        case OUTPUT_COMMIT:
+          sink->output->commit();
+          if (sink->reopen_requested.load(std::memory_order_acquire)) {
+            reopenSink(sink);
+          }
+          break;
+      }
+    }
+    sink->written.fetch_add(records, std::memory_order_relaxed);
+  }
+}
+
+void OutputPipeline::reopen(size_t sink, const std::string& path) {
+  CHECK_F(sink < sinks.size(), "There is no output %lu", sink);
+  std::lock_guard<std::mutex> lock(sinks[sink]->reopen_mutex);
+  sinks[sink]->reopen_path = path;
+  sinks[sink]->reopen_requested.store(true, std::memory_order_release);
+}
+
+void OutputPipeline::reopenSink(Sink* sink) {
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(sink->reopen_mutex);
+    path = sink->reopen_path;
+    sink->reopen_requested.store(false, std::memory_order_relaxed);
+  }
+
+  if (sink->output->reopen(path)) {
+    LOG_F(INFO, "Output continues in %s", path.c_str());
+  } else {
+    LOG_F(WARNING, "Failed to open output %s", path.c_str());
+  }
+}
+
+std::vector<OutputPipeline::Stats> OutputPipeline::stats() {
+  std::vector<Stats> result;
+  for (auto& sink : sinks) {
+    Stats stats;
+    stats.occupancy = sink->ring.size();
+    stats.max_occupancy = sink->max_occupancy.load(std::memory_order_relaxed);
+    stats.written = sink->written.load(std::memory_order_relaxed);
+    stats.dropped = sink->dropped.load(std::memory_order_relaxed);
+    result.push_back(stats);
+  }
+  return result;
+}
+
+OverflowPolicy OutputPipeline::parsePolicy(const std::string& policy) {
+  if (policy == "drop") {
+    return OverflowPolicy::DROP;
+  }
+  CHECK_F(policy == "block", "Unknown output policy %s", policy.c_str());
+  return OverflowPolicy::BLOCK;
+}
@@ -0,0 +1,127 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flow_readout.hpp"
+#include "measurement_output.hpp"
+#include "mirror_report.hpp"
+#include "spsc_ring.hpp"
+
+enum OutputRecordKind : uint8_t {
+  OUTPUT_FLOW_SAMPLE,
+  OUTPUT_REPORT,
+  // End of a readout cycle or report batch
+  OUTPUT_COMMIT,
+  // A removed flow, see releaseFlows()
+  OUTPUT_FLOW_RELEASE,
+};
+
+struct OutputRecord {
+  int64_t timestamp_ns;
+  OutputRecordKind kind;
+  union {
+    FlowSample sample;
+    MirrorReport report;
+    uint32_t flow_id;
+  };
+};
+
+enum class OverflowPolicy {
+  // The producer waits for the writer
+  BLOCK,
+  // Records that do not fit are counted and discarded
+  DROP,
+};
+
+/*
+  Decouples the readout from the outputs. The readout thread pushes fixed-size
+  records; every output gets its own SPSC ring and writer thread that drains
+  it in batches, so a slow disk never stretches the sampling interval (with
+  OverflowPolicy::DROP) and outputs do not slow each other down.
+*/
+class OutputPipeline {
+ public:
+  struct Stats {
+    uint64_t occupancy;
+    uint64_t max_occupancy;
+    // Samples and reports, without the commits between cycles
+    uint64_t written;
+    uint64_t dropped;
+  };
+
+ private:
+  struct Sink {
+    std::unique_ptr<MeasurementOutput> output;
+    SpscRing<OutputRecord> ring;
+    std::thread writer_thread;
+
+    std::atomic<uint64_t> max_occupancy;
+    std::atomic<uint64_t> written;
+    std::atomic<uint64_t> dropped;
+
+    // Set by reopen(), handled by the writer after the next commit record
+    std::atomic<bool> reopen_requested;
+    std::mutex reopen_mutex;
+    std::string reopen_path;
+
+    Sink(MeasurementOutput* output, size_t capacity)
+        : output(output), ring(capacity), max_occupancy(0), written(0), dropped(0), reopen_requested(false) {}
+  };
+
+  size_t capacity;
+  OverflowPolicy policy;
+  std::vector<std::unique_ptr<Sink>> sinks;
+  std::atomic<bool> running;
+
+  // Flows released by other threads, pushed by the producer at its next commit
+  std::mutex release_mutex;
+  std::vector<uint32_t> pending_releases;
+  std::atomic<bool> releases_pending;
+
+  void writerLoop(Sink* sink);
+  void reopenSink(Sink* sink);
+
+ public:
+  OutputPipeline(size_t capacity, OverflowPolicy policy);
+  ~OutputPipeline();
+
+  // Takes ownership of the output; all sinks have to be added before start()
+  void addSink(MeasurementOutput* output);
+  void start();
+  // Drains the rings, then closes the outputs
+  void stop();
+
+  // Producer side, to be called from one thread only
+  void push(const OutputRecord& record);
+  void pushFlowSample(int64_t timestamp_ns, const FlowSample& sample);
+  void pushReport(int64_t timestamp_ns, const MirrorReport& report);
+  // Pushes the pending releases and the end of the cycle
+  void commit(int64_t timestamp_ns);
+
+  // The flows were removed and their ids may be reused: every output drops
+  // its state of them after the records pushed before the next commit. The
+  // release records are never dropped. May be called from any thread.
+  void releaseFlows(const uint32_t* flow_ids, size_t count);
+
+  // Switches output `sink` to a new file at the next cycle boundary, so that
+  // no cycle is split across files. May be called from any thread.
+  void reopen(size_t sink, const std::string& path);
+
+  std::vector<Stats> stats();
+
+  static OverflowPolicy parsePolicy(const std::string& policy);
+};
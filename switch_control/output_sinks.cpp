@@ -0,0 +1,82 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "output_sinks.hpp"
+
+#include <loguru.hpp>
+
+// Epochs of the sliding quantile window, it slides in steps of 1/SKETCH_EPOCHS
+#define SKETCH_EPOCHS 6
+
+OutputSinkConfig OutputSinkConfig::withSuffix(const std::string& suffix) const {
+  OutputSinkConfig config = *this;
+  for (std::string* name : {&config.path, &config.sketch_file, &config.rtt_filter_file, &config.stats_shm}) {
+    if (!name->empty()) {
+      *name += suffix;
+    }
+  }
+  return config;
+}
+
+bool createOutputSinks(const OutputSinkConfig& config, OutputPipeline* pipeline, OutputSinks* sinks, std::string* error) {
+  *sinks = OutputSinks();
+
+  // Everything is parsed up front, so an invalid option leaves the pipeline empty
+  EventMode event_mode = EventMode::MEASUREMENT;
+  RttChangeConfig change_config;
+  if (!config.events.empty() && !EventOutput::parseMode(config.events, &event_mode)) {
+    *error = "Invalid output events " + config.events + ", expected measurement or change";
+    return false;
+  }
+  if (!config.change_detector.empty() && !RttChangeDetector::parseConfig(config.change_detector, &change_config)) {
+    *error = "Invalid change detector " + config.change_detector + ", expected tolerance,threshold";
+    return false;
+  }
+  RttFilterConfig filter_config;
+  filter_config.min_window_ns = (int64_t)config.rtt_filters_s * 1000000000;
+  if (!config.rtt_filter_gains.empty() && !RttFilterStore::parseGains(config.rtt_filter_gains, &filter_config)) {
+    *error = "Invalid RTT filter gains " + config.rtt_filter_gains + ", expected alpha,beta in (0, 1]";
+    return false;
+  }
+
+  // The control socket rotates sink 0, so the file output comes first
+  if (!config.path.empty() || config.rotatable) {
+    sinks->output = MeasurementOutput::create(config.format, config.path, config.flows, config.reports);
+    // Event mode filters the file output only, the other sinks keep seeing every sample
+    if (!config.events.empty()) {
+      sinks->events = new EventOutput(sinks->output, event_mode, change_config);
+      sinks->output = sinks->events;
+    }
+    pipeline->addSink(sinks->output);
+  }
+  if (config.flow_state) {
+    sinks->flow_state = new FlowStateView();
+    pipeline->addSink(sinks->flow_state);
+  }
+  if (config.sketch_flows > 0) {
+    sinks->sketches = new RttSketchOutput(config.sketch_flows, SKETCH_EPOCHS,
+                                          (int64_t)config.sketch_window_s * 1000000000 / SKETCH_EPOCHS, config.sketch_file);
+    pipeline->addSink(sinks->sketches);
+  }
+  if (config.rtt_filters_s > 0) {
+    sinks->filters = new RttFilterOutput(filter_config, config.rtt_filter_file);
+    pipeline->addSink(sinks->filters);
+  }
+  if (!config.stats_shm.empty()) {
+    sinks->stats_shm = new ShmStatsOutput(config.stats_shm, MAX_FLOW_IDS);
+    if (sinks->stats_shm->isOpen()) {
+      pipeline->addSink(sinks->stats_shm);
+    } else {
+      LOG_F(WARNING, "Cannot open the shared-memory segment %s", config.stats_shm.c_str());
+      delete sinks->stats_shm;
+      sinks->stats_shm = nullptr;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "flow_table.hpp"
+#include "measurement_output.hpp"
+#include "output_pipeline.hpp"
+#include "rtt_change.hpp"
+#include "rtt_filters.hpp"
+#include "rtt_sketch.hpp"
+
+struct OutputSinkConfig {
+  // File output, "csv" or "binary"; without a path it is only created if `rotatable`
+  std::string format;
+  std::string path;
+  bool rotatable;
+  // Names the flows in the CSV output, may be nullptr
+  const FlowTable* flows;
+  // Report columns instead of readout columns
+  bool reports;
+  // Event filter of the file output, see --output_events and --change_detector
+  std::string events;
+  std::string change_detector;
+  // Latest state per flow for the control socket
+  bool flow_state;
+  // 0 disables the sketches
+  uint32_t sketch_flows;
+  int sketch_window_s;
+  std::string sketch_file;
+  // 0 disables the filters
+  int rtt_filters_s;
+  std::string rtt_filter_gains;
+  std::string rtt_filter_file;
+  // Shared-memory segment, empty disables it
+  std::string stats_shm;
+
+  // Copy for one of several pipelines side by side: the files and the segment get `suffix` appended
+  OutputSinkConfig withSuffix(const std::string& suffix) const;
+};
+
+// Sinks of one pipeline, nullptr if not configured. The pipeline owns them.
+struct OutputSinks {
+  // The file output, behind the event filter if there is one; sink 0 of the pipeline
+  MeasurementOutput* output;
+  EventOutput* events;
+  FlowStateView* flow_state;
+  RttSketchOutput* sketches;
+  RttFilterOutput* filters;
+  ShmStatsOutput* stats_shm;
+};
+
+/*
+  Creates the configured sinks and adds them to `pipeline`. The live modes
+  and every replay worker build their sinks this way, so a replay feeds the
+  same sinks as the capture it comes from. Returns false and sets `error`
+  for an invalid configuration, before any sink is added.
+*/
+bool createOutputSinks(const OutputSinkConfig& config, OutputPipeline* pipeline, OutputSinks* sinks, std::string* error);
@@ -0,0 +1,149 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "readout_scheduler.hpp"
+
+#include <loguru.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "measurement_log.hpp"
+
+ReadoutScheduler::ReadoutScheduler(int64_t period_ns)
+    : period_ns(period_ns),
+      requested_period_ns(period_ns),
+      next_deadline_ns(0),
+      cycle_start_ns(0),
+      cycles(0),
+      missed_deadlines(0),
+      published_ns(0) {
+  CHECK_F(period_ns > 0, "The readout period has to be positive");
+
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  CHECK_F(timer_fd >= 0, "Failed to create readout timer: %s", strerror(errno));
+}
+
+ReadoutScheduler::~ReadoutScheduler() {
+  close(timer_fd);
+}
+
+bool ReadoutScheduler::configureThread(int cpu, int fifo_priority) {
+  bool success = true;
+
+  if (cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    int status = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (status != 0) {
+      LOG_F(WARNING, "Failed to pin the readout thread to CPU %d: %s", cpu, strerror(status));
+      success = false;
+    }
+  }
+
+  if (fifo_priority > 0) {
+    struct sched_param param;
+    param.sched_priority = fifo_priority;
+    int status = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (status != 0) {
+      LOG_F(WARNING, "Failed to switch the readout thread to SCHED_FIFO: %s", strerror(status));
+      success = false;
+    }
+  }
+
+  return success;
+}
+
+void ReadoutScheduler::start() {
+  arm();
+}
+
+void ReadoutScheduler::arm() {
+  int64_t now = monotonicNanoseconds();
+  next_deadline_ns = now + period_ns;
+
+  struct itimerspec spec;
+  spec.it_value.tv_sec = next_deadline_ns / 1000000000;
+  spec.it_value.tv_nsec = next_deadline_ns % 1000000000;
+  spec.it_interval.tv_sec = period_ns / 1000000000;
+  spec.it_interval.tv_nsec = period_ns % 1000000000;
+
+  int status = timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+  CHECK_F(status == 0, "Failed to arm readout timer: %s", strerror(errno));
+}
+
+void ReadoutScheduler::waitForNextCycle() {
+  uint64_t expirations = 0;
+  while (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    // Interrupted by a signal, e.g., the shutdown or stats request
+    if (errno != EINTR) {
+      ABORT_F("Failed to read readout timer: %s", strerror(errno));
+    }
+  }
+
+  cycle_start_ns = monotonicNanoseconds();
+
+  // The timer fired `expirations` times since the last read, the last one is the current deadline
+  int64_t deadline = next_deadline_ns + (int64_t)(expirations - 1) * period_ns;
+  missed_deadlines += expirations - 1;
+  next_deadline_ns = deadline + period_ns;
+
+  lateness.record(cycle_start_ns > deadline ? cycle_start_ns - deadline : 0);
+}
+
+void ReadoutScheduler::cycleDone() {
+  int64_t now = monotonicNanoseconds();
+  duration.record(now - cycle_start_ns);
+  cycles++;
+
+  // Re-arming restarts the deadlines one new period from now
+  int64_t requested = requested_period_ns.load(std::memory_order_relaxed);
+  if (requested != period_ns) {
+    period_ns = requested;
+    arm();
+    LOG_F(INFO, "Readout period changed to %ld us", (long)(period_ns / 1000));
+  }
+
+  if (now - published_ns >= 1000000000) {
+    publishReport();
+    published_ns = now;
+  }
+}
+
+void ReadoutScheduler::requestPeriod(int64_t period_ns) {
+  CHECK_F(period_ns > 0, "The readout period has to be positive");
+  requested_period_ns.store(period_ns, std::memory_order_relaxed);
+}
+
+void ReadoutScheduler::publishReport() {
+  std::string current = report();
+  // A reader holding the lock only delays the refresh to the next cycle
+  std::unique_lock<std::mutex> lock(published_mutex, std::try_to_lock);
+  if (lock.owns_lock()) {
+    published_report.swap(current);
+  }
+}
+
+std::string ReadoutScheduler::publishedReport() {
+  std::lock_guard<std::mutex> lock(published_mutex);
+  return published_report;
+}
+
+std::string ReadoutScheduler::report() const {
+  std::string result = "Readout period " + std::to_string(period_ns / 1000) + " us, " + std::to_string(cycles) +
+                       " cycles, " + std::to_string(missed_deadlines) + " missed deadlines\n";
+  result += "  wakeup lateness: " + lateness.summary() + "\n";
+  result += "  readout duration: " + duration.summary();
+  return result;
+}
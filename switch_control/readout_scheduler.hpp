@@ -0,0 +1,76 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "latency_histogram.hpp"
+
+/*
+  Periodic scheduler for the readout loop. A timerfd armed with an absolute
+  CLOCK_MONOTONIC start time and a fixed interval wakes the thread, so the
+  period does not drift with the amount of work per cycle. Every cycle records
+  the wakeup lateness (wakeup - deadline) and the readout duration.
+
+  Other threads may request a new period and read a copy of the report that
+  the readout thread refreshes about once per second; neither waits for the
+  readout thread nor makes it wait.
+*/
+class ReadoutScheduler {
+ private:
+  int64_t period_ns;
+  std::atomic<int64_t> requested_period_ns;
+  int timer_fd;
+
+  int64_t next_deadline_ns;
+  int64_t cycle_start_ns;
+
+  uint64_t cycles;
+  uint64_t missed_deadlines;
+  LatencyHistogram lateness;
+  LatencyHistogram duration;
+
+  std::mutex published_mutex;
+  std::string published_report;
+  int64_t published_ns;
+
+  void arm();
+  void publishReport();
+
+ public:
+  ReadoutScheduler(int64_t period_ns);
+  ~ReadoutScheduler();
+
+  // Pins the calling thread to `cpu` (if >= 0) and switches it to SCHED_FIFO
+  // with `fifo_priority` (if > 0). Returns false if any of it failed.
+  static bool configureThread(int cpu, int fifo_priority);
+
+  void start();
+  // Blocks until the next deadline. Deadlines that passed while the previous
+  // cycle was still running are counted as missed and skipped.
+  void waitForNextCycle();
+  // Marks the end of the work of the current cycle, applies a requested period
+  void cycleDone();
+
+  // May be called from any thread, takes effect after the current cycle
+  void requestPeriod(int64_t period_ns);
+  int64_t requestedPeriod() const { return requested_period_ns.load(std::memory_order_relaxed); }
+  // report() as of the last refresh, may be called from any thread
+  std::string publishedReport();
+
+  uint64_t cycleCount() const { return cycles; }
+  uint64_t missedDeadlines() const { return missed_deadlines; }
+  const LatencyHistogram& wakeupLateness() const { return lateness; }
+  const LatencyHistogram& readoutDuration() const { return duration; }
+  std::string report() const;
+};
@@ -0,0 +1,159 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "readout_tiers.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <tuple>
+
+#include "spintracker_params.hpp"
+
+// Weight of the newest read in the measurement rate of a flow
+#define RATE_WEIGHT 0.25f
+// Measurements allowed between two reads, half the counter range leaves room for rate jumps
+#define UNREAD_MEASUREMENTS (1u << (MEASUREMENT_COUNTER_BITS - 1))
+
+static const char* TIER_NAMES[NUM_READOUT_TIERS] = {"hot", "warm", "idle"};
+
+ReadoutTiers::ReadoutTiers(uint32_t flow_capacity, const ReadoutTierConfig& config, uint32_t cells_per_flow)
+    : config(config),
+      cells_per_flow(cells_per_flow),
+      cycle(0),
+      tiers(flow_capacity, READOUT_TIER_HOT),
+      last_read(flow_capacity, 0),
+      rates(flow_capacity, 0.0f),
+      tokens(0) {
+  memset(&tier_stats, 0, sizeof(tier_stats));
+  candidates.reserve(flow_capacity);
+  forced.reserve(flow_capacity);
+}
+
+void ReadoutTiers::reset(uint32_t flow_id) {
+  tiers[flow_id] = READOUT_TIER_HOT;
+  last_read[flow_id] = cycle;
+  rates[flow_id] = 0.0f;
+}
+
+uint64_t ReadoutTiers::maxInterval(uint32_t flow_id, int64_t period_ns) const {
+  uint64_t interval = UINT64_MAX;
+  if (period_ns > 0) {
+    interval = (uint64_t)UNREAD_MEASUREMENTS * config.min_rtt_ns / period_ns;
+  }
+  if (rates[flow_id] * interval > UNREAD_MEASUREMENTS) {
+    interval = (uint64_t)(UNREAD_MEASUREMENTS / rates[flow_id]);
+  }
+  return std::max<uint64_t>(interval, 1);
+}
+
+void ReadoutTiers::plan(const std::vector<uint32_t>& active, int64_t period_ns, std::vector<uint32_t>* due) {
+  cycle++;
+  tier_stats.cycles++;
+
+  // The bucket holds at most two cycles of budget, and always room for one flow
+  double budget = config.max_reads_per_s * (double)period_ns / 1e9;
+  if (config.max_reads_per_s > 0) {
+    tokens = std::min(tokens + budget, std::max(2 * budget, (double)cells_per_flow));
+  }
+
+  candidates.clear();
+  forced.clear();
+  for (uint32_t tier = 0; tier < NUM_READOUT_TIERS; tier++) {
+    tier_stats.flows[tier] = 0;
+  }
+  for (uint32_t flow_id : active) {
+    uint8_t tier = tiers[flow_id];
+    tier_stats.flows[tier]++;
+    uint64_t unread = cycle - last_read[flow_id];
+    if (unread >= maxInterval(flow_id, period_ns)) {
+      forced.push_back(flow_id);
+    } else if (unread >= config.intervals[tier]) {
+      candidates.push_back(flow_id);
+    }
+  }
+
+  size_t affordable = candidates.size();
+  if (config.max_reads_per_s > 0) {
+    // Forced reads may take the bucket below zero, the refills of the next cycles pay for them
+    tokens -= (double)forced.size() * cells_per_flow;
+    affordable = std::min(affordable, (size_t)std::max(tokens / cells_per_flow, 0.0));
+    tokens -= (double)affordable * cells_per_flow;
+  }
+  if (affordable < candidates.size()) {
+    // Earliest deadline first, hot flows first among equally overdue ones
+    auto key = [this](uint32_t flow_id) {
+      return std::make_tuple(last_read[flow_id] + config.intervals[tiers[flow_id]], tiers[flow_id], flow_id);
+    };
+    std::nth_element(candidates.begin(), candidates.begin() + affordable, candidates.end(),
+                     [&key](uint32_t a, uint32_t b) { return key(a) < key(b); });
+    tier_stats.deferred += candidates.size() - affordable;
+  }
+
+  due->assign(candidates.begin(), candidates.begin() + affordable);
+  due->insert(due->end(), forced.begin(), forced.end());
+  tier_stats.forced += forced.size();
+  for (uint32_t flow_id : *due) {
+    tier_stats.reads[tiers[flow_id]]++;
+  }
+  std::sort(due->begin(), due->end());
+  if (due->empty()) {
+    tier_stats.idle_cycles++;
+  }
+}
+
+void ReadoutTiers::update(uint32_t flow_id, uint64_t delta) {
+  uint64_t elapsed = std::max<uint64_t>(cycle - last_read[flow_id], 1);
+  last_read[flow_id] = cycle;
+
+  float rate = (float)delta / elapsed;
+  float& average = rates[flow_id];
+  average += RATE_WEIGHT * (rate - average);
+  // More than one measurement between two reads: samples were missed
+  if (delta > 1 && rate > average) {
+    average = rate;
+  }
+
+  if (delta > 1 || average * config.intervals[READOUT_TIER_WARM] > 1.0f) {
+    tiers[flow_id] = READOUT_TIER_HOT;
+  } else if (average * config.intervals[READOUT_TIER_IDLE] > 1.0f) {
+    tiers[flow_id] = READOUT_TIER_WARM;
+  } else {
+    tiers[flow_id] = READOUT_TIER_IDLE;
+  }
+}
+
+std::string ReadoutTiers::report() const {
+  std::string result = "Readout tiers: " + std::to_string(tier_stats.cycles) + " cycles, " +
+                       std::to_string(tier_stats.idle_cycles) + " without reads, " +
+                       std::to_string(tier_stats.deferred) + " deferred reads, " +
+                       std::to_string(tier_stats.forced) + " forced reads";
+  for (uint32_t tier = 0; tier < NUM_READOUT_TIERS; tier++) {
+    result += std::string("\n  ") + TIER_NAMES[tier] + " (every " + std::to_string(config.intervals[tier]) +
+              " cycles): " + std::to_string(tier_stats.flows[tier]) + " flows, " +
+              std::to_string(tier_stats.reads[tier]) + " reads";
+  }
+  return result;
+}
+
+bool ReadoutTiers::parseIntervals(const std::string& text, ReadoutTierConfig* config) {
+  std::istringstream fields(text);
+  std::string field;
+  uint32_t tier = 0;
+  while (std::getline(fields, field, ',')) {
+    char* end = nullptr;
+    unsigned long interval = strtoul(field.c_str(), &end, 10);
+    if (tier >= NUM_READOUT_TIERS || field.empty() || *end != '\0' || interval == 0) {
+      return false;
+    }
+    config->intervals[tier++] = interval;
+  }
+  return tier == NUM_READOUT_TIERS;
+}
@@ -0,0 +1,103 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum ReadoutTier : uint8_t {
+  READOUT_TIER_HOT = 0,
+  READOUT_TIER_WARM = 1,
+  READOUT_TIER_IDLE = 2,
+  NUM_READOUT_TIERS = 3,
+};
+
+struct ReadoutTierConfig {
+  // Readout cycles between two reads of a flow, per tier
+  uint32_t intervals[NUM_READOUT_TIERS] = {1, 8, 64};
+  // Register cells read per second over all flows, 0 for no limit
+  uint64_t max_reads_per_s = 0;
+  // Shortest RTT, i.e., interval between two measurements, expected of any flow
+  int64_t min_rtt_ns = 1000000;
+};
+
+/*
+  Decides which flows the readout reads in a cycle. Every flow is in one of
+  three tiers, read every intervals[tier] cycles. After every read, the
+  measurement counter delta updates a moving average of the measurements
+  per cycle; a flow is hot once it measures more often than every warm
+  interval, warm once more often than every idle interval, idle otherwise.
+  A flow that measured more than once since its last read was read too
+  rarely and is hot right away; new flows start hot.
+
+  With a read budget, reads are taken from a token bucket refilled with
+  max_reads_per_s. When not all due flows fit, the ones most overdue are read
+  first, hot before colder on ties; the others stay due for the next cycle, so
+  a budget below the hot tier's demand stretches all intervals alike instead
+  of starving the colder tiers.
+
+  The 2^MEASUREMENT_COUNTER_BITS counters must not wrap between two reads of
+  a flow, or its widened totals lose wraps. Every flow is therefore read at
+  least once per half counter range of measurements, at min_rtt_ns or at
+  its own rate if that is faster, whatever its tier; flows past that bound
+  are read even beyond the budget, which is paid back in later cycles.
+*/
+class ReadoutTiers {
+ public:
+  struct Stats {
+    uint64_t cycles;
+    // Cycles in which no flow was due, without any register access
+    uint64_t idle_cycles;
+    uint64_t reads[NUM_READOUT_TIERS];
+    // Due flows postponed for lack of read budget
+    uint64_t deferred;
+    // Reads beyond the budget, of flows whose counters could wrap otherwise
+    uint64_t forced;
+    uint32_t flows[NUM_READOUT_TIERS];
+  };
+
+ private:
+  ReadoutTierConfig config;
+  uint32_t cells_per_flow;
+  uint64_t cycle;
+
+  std::vector<uint8_t> tiers;
+  std::vector<uint64_t> last_read;
+  // Measurements per cycle, exponentially weighted
+  std::vector<float> rates;
+
+  double tokens;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> forced;
+
+  // Cycles of `period_ns` after which the counters of the flow could wrap
+  uint64_t maxInterval(uint32_t flow_id, int64_t period_ns) const;
+
+  Stats tier_stats;
+
+ public:
+  // `cells_per_flow` register cells are read per flow and count against the budget
+  ReadoutTiers(uint32_t flow_capacity, const ReadoutTierConfig& config, uint32_t cells_per_flow);
+
+  // Starts a new flow on the id in the hot tier
+  void reset(uint32_t flow_id);
+  // Fills `due` with the sorted ids of the active flows to read in this cycle of `period_ns`
+  void plan(const std::vector<uint32_t>& active, int64_t period_ns, std::vector<uint32_t>* due);
+  // Accounts the read of a due flow, `delta` measurements since its previous read
+  void update(uint32_t flow_id, uint64_t delta);
+
+  ReadoutTier tier(uint32_t flow_id) const { return (ReadoutTier)tiers[flow_id]; }
+  Stats stats() const { return tier_stats; }
+  std::string report() const;
+
+  // "hot,warm,idle" intervals in cycles; false if malformed
+  static bool parseIntervals(const std::string& text, ReadoutTierConfig* config);
+};
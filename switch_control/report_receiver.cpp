@@ -0,0 +1,174 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "report_receiver.hpp"
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/ethernet.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+ReportReceiver::ReportReceiver(std::string interface_name, size_t report_offset, ReportHandler handler,
+                               uint32_t block_size, uint32_t block_count, uint32_t block_timeout_ms)
+    : interface_name(interface_name),
+      report_offset(report_offset),
+      handler(handler),
+      block_size(block_size),
+      block_count(block_count),
+      block_timeout_ms(block_timeout_ms),
+      socket_fd(-1),
+      ring(nullptr),
+      ring_size(0),
+      running(false),
+      blocks(0),
+      packets(0),
+      reports(0),
+      malformed(0),
+      kernel_packets(0),
+      kernel_drops(0) {
+  // A block can never hold more reports than minimal frames
+  batch.resize(block_size / TPACKET_ALIGN(sizeof(struct tpacket3_hdr) + MIRROR_REPORT_SIZE));
+  setupRing();
+}
+
+ReportReceiver::~ReportReceiver() {
+  stop();
+  if (ring != nullptr) {
+    munmap(ring, ring_size);
+  }
+  if (socket_fd >= 0) {
+    close(socket_fd);
+  }
+}
+
+void ReportReceiver::setupRing() {
+  socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  CHECK_F(socket_fd >= 0, "Failed to open packet socket: %s", strerror(errno));
+
+  int version = TPACKET_V3;
+  int status = setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version));
+  CHECK_F(status == 0, "Failed to select TPACKET_V3: %s", strerror(errno));
+
+  struct tpacket_req3 req;
+  memset(&req, 0, sizeof(req));
+  req.tp_block_size = block_size;
+  req.tp_block_nr = block_count;
+  req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+  req.tp_frame_nr = (block_size * block_count) / req.tp_frame_size;
+  req.tp_retire_blk_tov = block_timeout_ms;
+  status = setsockopt(socket_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+  CHECK_F(status == 0, "Failed to set up the RX ring: %s", strerror(errno));
+
+  ring_size = (size_t)block_size * block_count;
+  void* map = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, socket_fd, 0);
+  CHECK_F(map != MAP_FAILED, "Failed to map the RX ring: %s", strerror(errno));
+  ring = (uint8_t*)map;
+
+  struct sockaddr_ll addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_ALL);
+  addr.sll_ifindex = if_nametoindex(interface_name.c_str());
+  CHECK_F(addr.sll_ifindex != 0, "Unknown report interface %s", interface_name.c_str());
+
+  status = bind(socket_fd, (struct sockaddr*)&addr, sizeof(addr));
+  CHECK_F(status == 0, "Failed to bind to %s: %s", interface_name.c_str(), strerror(errno));
+
+  LOG_F(INFO, "Report ring on %s: %u blocks of %u bytes", interface_name.c_str(), block_count, block_size);
+}
+
+void ReportReceiver::start() {
+  running = true;
+  ingest_thread = std::thread(&ReportReceiver::ingestLoop, this);
+}
+
+void ReportReceiver::stop() {
+  running = false;
+  if (ingest_thread.joinable()) {
+    ingest_thread.join();
+  }
+}
+
+void ReportReceiver::ingestLoop() {
+  struct pollfd pfd;
+  pfd.fd = socket_fd;
+  pfd.events = POLLIN | POLLERR;
+  pfd.revents = 0;
+
+  uint32_t current_block = 0;
+  while (running) {
+    auto block = (struct tpacket_block_desc*)(ring + (size_t)current_block * block_size);
+
+    if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+      // Only sleep in the kernel if there is no retired block to process
+      poll(&pfd, 1, 100);
+      continue;
+    }
+
+    processBlock(block);
+
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    current_block = (current_block + 1) % block_count;
+  }
+}
+
+void ReportReceiver::processBlock(struct tpacket_block_desc* block) {
+  uint32_t num_pkts = block->hdr.bh1.num_pkts;
+  auto packet = (struct tpacket3_hdr*)((uint8_t*)block + block->hdr.bh1.offset_to_first_pkt);
+
+  size_t count = 0;
+  for (uint32_t i = 0; i < num_pkts; i++) {
+    auto link = (struct sockaddr_ll*)((uint8_t*)packet + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    const uint8_t* data = (const uint8_t*)packet + packet->tp_mac;
+
+    if (link->sll_pkttype != PACKET_OUTGOING) {
+      if (packet->tp_snaplen > report_offset &&
+          isMirrorReport(data + report_offset, packet->tp_snaplen - report_offset)) {
+        decodeMirrorReport(data + report_offset, &batch[count++]);
+      } else {
+        malformed.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    packet = (struct tpacket3_hdr*)((uint8_t*)packet + packet->tp_next_offset);
+  }
+
+  blocks.fetch_add(1, std::memory_order_relaxed);
+  packets.fetch_add(num_pkts, std::memory_order_relaxed);
+  reports.fetch_add(count, std::memory_order_relaxed);
+
+  if (count > 0) {
+    handler(batch.data(), count);
+  }
+}
+
+ReportReceiver::Stats ReportReceiver::stats() {
+  // The kernel resets its counters on every read
+  struct tpacket_stats_v3 kernel_stats;
+  socklen_t len = sizeof(kernel_stats);
+  if (getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &kernel_stats, &len) == 0) {
+    kernel_packets += kernel_stats.tp_packets;
+    kernel_drops += kernel_stats.tp_drops;
+  }
+
+  Stats result;
+  result.blocks = blocks.load(std::memory_order_relaxed);
+  result.packets = packets.load(std::memory_order_relaxed);
+  result.reports = reports.load(std::memory_order_relaxed);
+  result.malformed = malformed.load(std::memory_order_relaxed);
+  result.kernel_packets = kernel_packets;
+  result.kernel_drops = kernel_drops;
+  return result;
+}
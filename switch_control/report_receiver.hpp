@@ -0,0 +1,80 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+#include <loguru.hpp>
+
+#include <linux/if_packet.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mirror_report.hpp"
+
+/*
+  Receives the mirrored measurement reports on the CPU interface through a
+  memory-mapped TPACKET_V3 ring. The ingest thread only enters the kernel when
+  it runs out of filled blocks; every retired block is decoded straight from
+  the ring and handed to the handler as one batch.
+*/
+class ReportReceiver {
+ public:
+  using ReportHandler = std::function<void(const MirrorReport* reports, size_t count)>;
+
+  struct Stats {
+    uint64_t blocks;
+    uint64_t packets;
+    uint64_t reports;
+    uint64_t malformed;
+    uint64_t kernel_packets;
+    uint64_t kernel_drops;
+  };
+
+ private:
+  std::string interface_name;
+  size_t report_offset;
+  ReportHandler handler;
+
+  uint32_t block_size;
+  uint32_t block_count;
+  uint32_t block_timeout_ms;
+
+  int socket_fd;
+  uint8_t* ring;
+  size_t ring_size;
+
+  std::thread ingest_thread;
+  std::atomic<bool> running;
+
+  std::vector<MirrorReport> batch;
+
+  std::atomic<uint64_t> blocks;
+  std::atomic<uint64_t> packets;
+  std::atomic<uint64_t> reports;
+  std::atomic<uint64_t> malformed;
+  uint64_t kernel_packets;
+  uint64_t kernel_drops;
+
+  void setupRing();
+  void ingestLoop();
+  void processBlock(struct tpacket_block_desc* block);
+
+ public:
+  // `report_offset` is the position of the mirror header inside the received frame
+  ReportReceiver(std::string interface_name, size_t report_offset, ReportHandler handler,
+                 uint32_t block_size = 1 << 22, uint32_t block_count = 64, uint32_t block_timeout_ms = 10);
+  ~ReportReceiver();
+
+  void start();
+  void stop();
+  Stats stats();
+};
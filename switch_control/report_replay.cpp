@@ -0,0 +1,156 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "report_replay.hpp"
+
+#include <time.h>
+
+#include <chrono>
+
+#include "capture_file.hpp"
+#include "measurement_log.hpp"
+
+// Records a worker takes from its queue at once, every batch ends with a commit
+#define REPLAY_BATCH_SIZE 4096
+
+ReportReplay::ReportReplay(const ReplayConfig& config) : config(config), input_done(false) {
+  if (this->config.workers == 0) {
+    this->config.workers = 1;
+  }
+  size_t flows_per_worker = (MAX_FLOW_IDS + this->config.workers - 1) / this->config.workers;
+  for (unsigned i = 0; i < this->config.workers; i++) {
+    workers.emplace_back(new Worker(this->config.queue, flows_per_worker));
+  }
+}
+
+ReportReplay::~ReportReplay() {
+  input_done = true;
+  for (auto& worker : workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+void ReportReplay::push(const ReplayRecord& record) {
+  Worker* worker = workers[record.report.flow_id % workers.size()].get();
+  while (!worker->ring.push(record)) {
+    std::this_thread::yield();
+  }
+}
+
+void ReportReplay::workerLoop(Worker* worker) {
+  std::vector<ReplayRecord> batch(REPLAY_BATCH_SIZE);
+  size_t stride = workers.size();
+
+  while (true) {
+    size_t count = worker->ring.popBatch(batch.data(), batch.size());
+    if (count == 0) {
+      // The reader is done once everything it pushed has been taken
+      if (input_done.load(std::memory_order_acquire) && worker->ring.size() == 0) {
+        break;
+      }
+      std::this_thread::yield();
+      continue;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      const MirrorReport& report = batch[i].report;
+      size_t flow = report.flow_id / stride;
+      uint64_t counter = report.measurement_count;
+      // Captures start in the middle of a flow, its first report accounts one measurement
+      if (worker->reports[flow]++ == 0) {
+        worker->measurements.seed(flow, counter - 1);
+      }
+      worker->measurements.update(flow, &counter, 1);
+      worker->pipeline.pushReport(batch[i].timestamp_ns, report);
+    }
+    worker->pipeline.commit(batch[count - 1].timestamp_ns);
+  }
+  worker->pipeline.stop();
+}
+
+bool ReportReplay::run(const std::vector<std::string>& files, Summary* summary, std::string* error) {
+  // All files are mapped up front, so a bad path fails before anything is written
+  std::vector<std::unique_ptr<CaptureFile>> captures;
+  for (const std::string& path : files) {
+    captures.emplace_back(new CaptureFile());
+    if (!captures.back()->open(path, error)) {
+      *error = path + ": " + *error;
+      return false;
+    }
+  }
+
+  *summary = Summary();
+  summary->files = files.size();
+  summary->worker_reports.resize(workers.size());
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    Worker* worker = workers[i].get();
+    OutputSinkConfig outputs = workers.size() > 1 ? config.outputs.withSuffix("." + std::to_string(i)) : config.outputs;
+    OutputSinks sinks;
+    if (!createOutputSinks(outputs, &worker->pipeline, &sinks, error)) {
+      return false;
+    }
+    worker->pipeline.start();
+  }
+
+  // Outputs expect CLOCK_MONOTONIC timestamps; shifted by the current offset, they show the capture time as wall clock
+  struct timespec realtime;
+  clock_gettime(CLOCK_REALTIME, &realtime);
+  int64_t realtime_offset_ns = (int64_t)realtime.tv_sec * 1000000000 + realtime.tv_nsec - monotonicNanoseconds();
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto& worker : workers) {
+    worker->thread = std::thread(&ReportReplay::workerLoop, this, worker.get());
+  }
+
+  for (auto& capture : captures) {
+    CaptureFile::Packet packet;
+    ReplayRecord record;
+    while (capture->next(&packet)) {
+      summary->packets++;
+      if (packet.length <= config.report_offset ||
+          !isMirrorReport(packet.data + config.report_offset, packet.length - config.report_offset)) {
+        summary->malformed++;
+        continue;
+      }
+      decodeMirrorReport(packet.data + config.report_offset, &record.report);
+      record.timestamp_ns = packet.timestamp_ns - realtime_offset_ns;
+      push(record);
+      summary->worker_reports[record.report.flow_id % workers.size()]++;
+      summary->reports++;
+    }
+    summary->bytes += capture->size();
+    summary->truncated_files += capture->isTruncated();
+    capture->close();
+  }
+
+  input_done.store(true, std::memory_order_release);
+  for (auto& worker : workers) {
+    worker->thread.join();
+  }
+  summary->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (auto& worker : workers) {
+    for (size_t flow = 0; flow < worker->reports.size(); flow++) {
+      if (worker->reports[flow] == 0) {
+        continue;
+      }
+      uint64_t measurements = worker->measurements.total(flow);
+      summary->flows++;
+      summary->measurements += measurements;
+      summary->missing += measurements > worker->reports[flow] ? measurements - worker->reports[flow] : 0;
+    }
+    for (auto& stats : worker->pipeline.stats()) {
+      summary->outputs.push_back(stats);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,98 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "counter_widener.hpp"
+#include "mirror_report.hpp"
+#include "output_pipeline.hpp"
+#include "output_sinks.hpp"
+#include "spsc_ring.hpp"
+
+struct ReplayConfig {
+  // Position of the mirror header inside the captured frames, as --report_offset
+  size_t report_offset;
+  unsigned workers;
+  // Sinks of every worker; with more than one worker, each worker writes its
+  // files and shared-memory segment under the configured names plus .<worker>
+  OutputSinkConfig outputs;
+  // Capacity of the queue to every worker and of its output queue
+  size_t queue;
+};
+
+/*
+  Offline replay of captured measurement reports (pcap/pcapng of the CPU
+  port). The reading thread decodes the frames straight from the mapped
+  files and shards the reports by flow id over the workers, so every flow is
+  handled by one worker in capture order. Every worker feeds its own output
+  pipeline with the sinks of the live report mode (createOutputSinks()).
+  The per-flow measurement counters are widened for the summary only, which
+  compares them to the reports seen; the sinks get the reports as captured.
+  Nothing is dropped or paced: the run takes as long as the slowest of
+  reading, processing and writing, which makes it a repeatable benchmark of
+  the report path.
+*/
+class ReportReplay {
+ public:
+  struct Summary {
+    uint64_t files;
+    uint64_t truncated_files;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t reports;
+    uint64_t malformed;
+    uint64_t flows;
+    // Widened measurement counters of all flows since their first report
+    uint64_t measurements;
+    // Measurements without a report in the capture
+    uint64_t missing;
+    double seconds;
+    std::vector<uint64_t> worker_reports;
+    std::vector<OutputPipeline::Stats> outputs;
+  };
+
+ private:
+  struct ReplayRecord {
+    int64_t timestamp_ns;
+    MirrorReport report;
+  };
+
+  struct Worker {
+    SpscRing<ReplayRecord> ring;
+    std::thread thread;
+    OutputPipeline pipeline;
+
+    // Indexed by flow_id / number of workers
+    CounterWidener measurements;
+    std::vector<uint64_t> reports;
+
+    Worker(size_t queue, size_t flows)
+        : ring(queue), pipeline(queue, OverflowPolicy::BLOCK), measurements(flows, MEASUREMENT_COUNTER_BITS), reports(flows, 0) {}
+  };
+
+  ReplayConfig config;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<bool> input_done;
+
+  void workerLoop(Worker* worker);
+  void push(const ReplayRecord& record);
+
+ public:
+  explicit ReportReplay(const ReplayConfig& config);
+  ~ReportReplay();
+
+  // Replays the files in the given order; returns false and sets `error` if a file cannot be opened
+  bool run(const std::vector<std::string>& files, Summary* summary, std::string* error);
+};
@@ -0,0 +1,141 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "rtt_change.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+RttChangeDetector::RttChangeDetector(uint32_t capacity, const RttChangeConfig& config)
+    : config(config), flows(capacity, FlowState{0, 0, 0, 0}) {}
+
+RttChange RttChangeDetector::add(uint32_t flow_id, uint16_t rtt) {
+  FlowState& state = flows[flow_id];
+  float value = rtt;
+  if (state.samples == 0) {
+    state = FlowState{value, 0, 0, 1};
+    return RTT_CHANGE_NONE;
+  }
+
+  state.samples++;
+  state.mean += (value - state.mean) / state.samples;
+  float tolerance = config.tolerance * state.mean;
+  state.increase = std::max(0.0f, state.increase + value - state.mean - tolerance);
+  state.decrease = std::max(0.0f, state.decrease + state.mean - value - tolerance);
+
+  float threshold = config.threshold * state.mean;
+  RttChange change = RTT_CHANGE_NONE;
+  if (state.increase > threshold) {
+    change = RTT_CHANGE_INCREASE;
+  } else if (state.decrease > threshold) {
+    change = RTT_CHANGE_DECREASE;
+  }
+  if (change != RTT_CHANGE_NONE) {
+    state = FlowState{value, 0, 0, 1};
+  }
+  return change;
+}
+
+bool RttChangeDetector::parseConfig(const std::string& text, RttChangeConfig* config) {
+  char* end = nullptr;
+  float tolerance = strtof(text.c_str(), &end);
+  if (end == text.c_str() || *end != ',') {
+    return false;
+  }
+  const char* threshold_text = end + 1;
+  float threshold = strtof(threshold_text, &end);
+  if (end == threshold_text || *end != '\0' || tolerance < 0 || threshold <= 0) {
+    return false;
+  }
+  config->tolerance = tolerance;
+  config->threshold = threshold;
+  return true;
+}
+
+EventOutput::EventOutput(MeasurementOutput* output, EventMode mode, const RttChangeConfig& config)
+    : output(output),
+      mode(mode),
+      detector(MAX_FLOW_IDS, config),
+      last_totals(MAX_FLOW_IDS, 0),
+      forward_pipes(false),
+      seen(0),
+      written(0),
+      changes(0) {}
+
+bool EventOutput::measure(uint32_t flow_id, uint16_t rtt) {
+  bool first = detector.samples(flow_id) == 0;
+  RttChange change = detector.add(flow_id, rtt);
+  if (change != RTT_CHANGE_NONE) {
+    changes.fetch_add(1, std::memory_order_relaxed);
+  }
+  return mode == EventMode::MEASUREMENT || first || change != RTT_CHANGE_NONE;
+}
+
+void EventOutput::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  if (sample.per_pipe) {
+    if (forward_pipes) {
+      output->writeFlowSample(timestamp_ns, sample);
+    }
+    return;
+  }
+  seen.fetch_add(1, std::memory_order_relaxed);
+  forward_pipes = false;
+  if (sample.flow_id >= last_totals.size()) {
+    return;
+  }
+
+  uint64_t& last_total = last_totals[sample.flow_id];
+  if (sample.measurement_total == last_total) {
+    return;
+  }
+  if (sample.measurement_total < last_total) {
+    detector.reset(sample.flow_id);
+  }
+  last_total = sample.measurement_total;
+
+  forward_pipes = measure(sample.flow_id, sample.rtt);
+  if (forward_pipes) {
+    output->writeFlowSample(timestamp_ns, sample);
+    written.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void EventOutput::releaseFlow(uint32_t flow_id) {
+  if (flow_id < last_totals.size()) {
+    last_totals[flow_id] = 0;
+    detector.reset(flow_id);
+  }
+  output->releaseFlow(flow_id);
+}
+
+void EventOutput::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  // Every report is a measurement
+  seen.fetch_add(1, std::memory_order_relaxed);
+  if (report.flow_id >= last_totals.size() || !measure(report.flow_id, report.current_rtt)) {
+    return;
+  }
+  output->writeReport(timestamp_ns, report);
+  written.fetch_add(1, std::memory_order_relaxed);
+}
+
+EventOutput::Stats EventOutput::stats() const {
+  return Stats{seen.load(std::memory_order_relaxed), written.load(std::memory_order_relaxed),
+               changes.load(std::memory_order_relaxed)};
+}
+
+bool EventOutput::parseMode(const std::string& text, EventMode* mode) {
+  if (text == "measurement") {
+    *mode = EventMode::MEASUREMENT;
+  } else if (text == "change") {
+    *mode = EventMode::CHANGE;
+  } else {
+    return false;
+  }
+  return true;
+}
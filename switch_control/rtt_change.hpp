@@ -0,0 +1,122 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "measurement_output.hpp"
+
+enum RttChange : int8_t {
+  RTT_CHANGE_NONE = 0,
+  RTT_CHANGE_INCREASE = 1,
+  RTT_CHANGE_DECREASE = -1,
+};
+
+struct RttChangeConfig {
+  // Deviation from the mean ignored per sample, relative to the mean RTT
+  float tolerance = 0.1f;
+  // Accumulated deviation that flags a change, relative to the mean RTT
+  float threshold = 1.0f;
+};
+
+/*
+  Two-sided Page-Hinkley test on the RTT sequence of every flow. The mean is
+  taken over the samples since the last change; deviations above and below
+  it by more than the tolerance are accumulated separately, clamped at zero,
+  and a sum beyond the threshold flags a change and restarts the test at the
+  level of the flagging sample. State is 16 bytes per flow id, allocated up
+  front; every sample is O(1).
+*/
+class RttChangeDetector {
+ private:
+  struct FlowState {
+    float mean;
+    float increase;
+    float decrease;
+    uint32_t samples;
+  };
+
+  RttChangeConfig config;
+  std::vector<FlowState> flows;
+
+ public:
+  RttChangeDetector(uint32_t capacity, const RttChangeConfig& config);
+
+  // Forgets the samples of the flow, e.g., when its id is reused
+  void reset(uint32_t flow_id) { flows[flow_id] = FlowState{0, 0, 0, 0}; }
+  RttChange add(uint32_t flow_id, uint16_t rtt);
+  uint32_t samples(uint32_t flow_id) const { return flows[flow_id].samples; }
+  uint32_t capacity() const { return flows.size(); }
+  size_t memoryBytes() const { return flows.size() * sizeof(FlowState); }
+
+  // "tolerance,threshold"; false if malformed
+  static bool parseConfig(const std::string& text, RttChangeConfig* config);
+};
+
+enum class EventMode {
+  // Samples of flows whose measurement total advanced, and every report
+  MEASUREMENT,
+  // Only samples and reports at which the detector flags an RTT change, and the first of every flow
+  CHANGE,
+};
+
+/*
+  Forwards only events to the wrapped output, so the output volume follows
+  the measurements rather than flows x readout cycles. A sample is new when
+  the measurement total of its flow differs from the last one seen; a lower
+  total means the id was reused and restarts the detector of the flow.
+  Per-pipe samples follow their merged sample. Runs on the writer thread of
+  its sink, the counters may be read from any thread.
+*/
+class EventOutput : public MeasurementOutput {
+ public:
+  // Per-pipe samples are not counted
+  struct Stats {
+    uint64_t seen;
+    uint64_t written;
+    uint64_t changes;
+  };
+
+ private:
+  std::unique_ptr<MeasurementOutput> output;
+  EventMode mode;
+  RttChangeDetector detector;
+  std::vector<uint64_t> last_totals;
+  // Whether the merged sample before the following per-pipe samples was forwarded
+  bool forward_pipes;
+
+  std::atomic<uint64_t> seen;
+  std::atomic<uint64_t> written;
+  std::atomic<uint64_t> changes;
+
+  bool measure(uint32_t flow_id, uint16_t rtt);
+
+ public:
+  // Takes ownership of `output`
+  EventOutput(MeasurementOutput* output, EventMode mode, const RttChangeConfig& config);
+
+  bool isOpen() override { return output->isOpen(); }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override { output->commit(); }
+  void releaseFlow(uint32_t flow_id) override;
+  void close() override { output->close(); }
+  bool reopen(const std::string& path) override { return output->reopen(path); }
+
+  Stats stats() const;
+  size_t memoryBytes() const { return detector.memoryBytes() + last_totals.size() * sizeof(uint64_t); }
+
+  // "measurement" or "change"; false otherwise
+  static bool parseMode(const std::string& text, EventMode* mode);
+};
@@ -0,0 +1,96 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "rtt_class_plan.hpp"
+
+#include <loguru.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+bool loadRttClassPlan(const std::string& path, std::vector<rtt_class_range>* plan) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    LOG_F(WARNING, "Cannot open class plan %s", path.c_str());
+    return false;
+  }
+
+  std::vector<rtt_class_range> ranges;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    uint32_t accumulator_min, accumulator_max, rtt_min, rtt_max, rtt_class;
+    // Every field is range-checked before it is narrowed, so 70000 is not loaded as 4464
+    if (!(fields >> accumulator_min >> accumulator_max >> rtt_min >> rtt_max >> rtt_class) ||
+        accumulator_min > 0xFFFF || accumulator_max > 0xFFFF || rtt_min > 0xFFFF || rtt_max > 0xFFFF ||
+        rtt_class > 0xFF) {
+      LOG_F(WARNING, "Malformed class range in %s:%d", path.c_str(), line_number);
+      return false;
+    }
+
+    ranges.push_back(rtt_class_range{(uint16_t)accumulator_min, (uint16_t)accumulator_max, (uint16_t)rtt_min,
+                                     (uint16_t)rtt_max, (uint8_t)rtt_class});
+  }
+
+  std::string error;
+  if (!validateRttClassPlan(ranges, &error)) {
+    LOG_F(WARNING, "Invalid class plan %s: %s", path.c_str(), error.c_str());
+    return false;
+  }
+
+  *plan = std::move(ranges);
+  LOG_F(INFO, "Loaded %zu class ranges from %s", plan->size(), path.c_str());
+  return true;
+}
+
+bool validateRttClassPlan(const std::vector<rtt_class_range>& plan, std::string* error) {
+  if (plan.size() > RTT_CLASS_TABLE_SIZE) {
+    *error = "more than " + std::to_string(RTT_CLASS_TABLE_SIZE) + " ranges";
+    return false;
+  }
+
+  std::unordered_set<uint64_t> keys;
+  for (size_t i = 0; i < plan.size(); i++) {
+    const rtt_class_range& range = plan[i];
+    if (range.rtt_class >= NUM_RTT_CLASSES) {
+      *error = "range " + std::to_string(i) + " has class " + std::to_string(range.rtt_class);
+      return false;
+    }
+    if (range.accumulator_min > range.accumulator_max || range.rtt_min > range.rtt_max) {
+      *error = "range " + std::to_string(i) + " is empty";
+      return false;
+    }
+    if (!keys.insert(range.key()).second) {
+      *error = "range " + std::to_string(i) + " is a duplicate";
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<rtt_class_range> defaultRttClassPlan(int configured_rtt, int min_latency, int max_latency) {
+  std::vector<rtt_class_range> plan;
+  plan.push_back(rtt_class_range{(uint16_t)0, (uint16_t)0xFFFF, (uint16_t)0, (uint16_t)5, 0});
+
+  if (min_latency != 0 && max_latency != 0) {
+    plan.push_back(rtt_class_range{(uint16_t)(4 * min_latency), (uint16_t)(4 * max_latency), (uint16_t)(min_latency),
+                                   (uint16_t)(max_latency), 1});
+  } else {
+    plan.push_back(rtt_class_range{(uint16_t)(0.9 * 4 * configured_rtt), (uint16_t)(1.1 * 4 * configured_rtt),
+                                   (uint16_t)(0.9 * configured_rtt), (uint16_t)(1.1 * configured_rtt), 1});
+  }
+  return plan;
+}
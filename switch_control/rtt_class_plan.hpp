@@ -0,0 +1,54 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "spintracker_params.hpp"
+
+// One entry of rtt_class_table: samples within both ranges are counted in rtt_class
+struct rtt_class_range {
+  uint16_t accumulator_min;
+  uint16_t accumulator_max;
+  uint16_t rtt_min;
+  uint16_t rtt_max;
+  uint8_t rtt_class;
+
+  // Match key of the entry, entries with the same key replace each other
+  uint64_t key() const {
+    return ((uint64_t)accumulator_min << 48) | ((uint64_t)accumulator_max << 32) | ((uint64_t)rtt_min << 16) | rtt_max;
+  }
+};
+
+// Changes applied to rtt_class_table when switching to a new plan
+struct rtt_class_plan_diff {
+  size_t added;
+  size_t modified;
+  size_t deleted;
+  size_t unchanged;
+};
+
+/*
+  Reads a complete class plan, one range per line:
+    accumulator_min accumulator_max rtt_min rtt_max class
+  Empty lines and lines starting with '#' are ignored. Returns false and
+  leaves `plan` untouched if any line is invalid, so that a broken file never
+  replaces a working plan.
+*/
+bool loadRttClassPlan(const std::string& path, std::vector<rtt_class_range>* plan);
+
+// Checks the class ids, range bounds, table capacity and duplicate keys
+bool validateRttClassPlan(const std::vector<rtt_class_range>& plan, std::string* error);
+
+// Grease detection below 5ms (class 0) and one expected range (class 1), given
+// by min/max_latency if both are set and by configured_rtt +-10% otherwise
+std::vector<rtt_class_range> defaultRttClassPlan(int configured_rtt, int min_latency, int max_latency);
@@ -0,0 +1,208 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "rtt_filters.hpp"
+
+#include <loguru.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+RttFilterStore::RttFilterStore(uint32_t flow_ids, const RttFilterConfig& config)
+    : config(config),
+      slot_ns(config.min_window_ns / RTT_MIN_WINDOW_SLOTS),
+      start_ns(monotonicNanoseconds()),
+      filters(flow_ids),
+      listed(flow_ids, false) {
+  CHECK_F(slot_ns > 0, "The minimum RTT window needs at least %d ns", RTT_MIN_WINDOW_SLOTS);
+  this->flow_ids.reserve(flow_ids);
+}
+
+void RttFilterStore::record(uint32_t flow_id, uint16_t rtt, int64_t timestamp_ns) {
+  if (flow_id >= filters.size()) {
+    return;
+  }
+  FlowFilters& flow = filters[flow_id];
+
+  if (!listed[flow_id]) {
+    listed[flow_id] = true;
+    flow_ids.push_back(flow_id);
+  }
+  if (flow.samples == 0) {
+    flow.srtt = rtt;
+    flow.rttvar = rtt / 2.0f;
+  } else {
+    flow.rttvar += config.beta * (std::fabs(flow.srtt - rtt) - flow.rttvar);
+    flow.srtt += config.alpha * (rtt - flow.srtt);
+  }
+  if (flow.samples != UINT32_MAX) {
+    flow.samples++;
+  }
+  flow.latest_rtt = rtt;
+
+  // Slots that left the window drop off the front, larger RTTs off the back
+  uint32_t current = (uint32_t)slot(timestamp_ns);
+  while (flow.min_count > 0 && current - flow.min_slots[flow.min_head] >= RTT_MIN_WINDOW_SLOTS) {
+    flow.min_head = (flow.min_head + 1) % RTT_MIN_WINDOW_SLOTS;
+    flow.min_count--;
+  }
+  uint32_t back = (flow.min_head + flow.min_count - 1) % RTT_MIN_WINDOW_SLOTS;
+  while (flow.min_count > 0 && flow.min_rtts[back] >= rtt) {
+    flow.min_count--;
+    back = (back + RTT_MIN_WINDOW_SLOTS - 1) % RTT_MIN_WINDOW_SLOTS;
+  }
+  // A smaller RTT of the same slot stays in the window as long
+  if (flow.min_count > 0 && flow.min_slots[back] == current) {
+    return;
+  }
+  back = (flow.min_head + flow.min_count) % RTT_MIN_WINDOW_SLOTS;
+  flow.min_slots[back] = current;
+  flow.min_rtts[back] = rtt;
+  flow.min_count++;
+}
+
+void RttFilterStore::recordSample(uint32_t flow_id, uint16_t rtt, uint64_t measurement_total, int64_t timestamp_ns) {
+  if (flow_id >= filters.size() || measurement_total == filters[flow_id].last_total) {
+    return;
+  }
+  FlowFilters& flow = filters[flow_id];
+  if (measurement_total < flow.last_total) {
+    flow.samples = 0;
+    flow.min_count = 0;
+  }
+  record(flow_id, rtt, timestamp_ns);
+  flow.last_total = measurement_total;
+}
+
+void RttFilterStore::release(uint32_t flow_id) {
+  if (flow_id >= filters.size() || !listed[flow_id]) {
+    return;
+  }
+  filters[flow_id] = FlowFilters();
+  listed[flow_id] = false;
+  flow_ids.erase(std::find(flow_ids.begin(), flow_ids.end(), flow_id));
+}
+
+bool RttFilterStore::values(uint32_t flow_id, int64_t now_ns, RttFilterValues* values) const {
+  if (flow_id >= filters.size() || filters[flow_id].samples == 0) {
+    return false;
+  }
+  const FlowFilters& flow = filters[flow_id];
+  values->samples = flow.samples;
+  values->latest_rtt = flow.latest_rtt;
+  values->srtt = flow.srtt;
+  values->rttvar = flow.rttvar;
+
+  // The front is the minimum once the slots that left the window are skipped
+  values->min_rtt = 0;
+  uint32_t current = (uint32_t)slot(now_ns);
+  for (uint32_t i = 0; i < flow.min_count; i++) {
+    uint32_t entry = (flow.min_head + i) % RTT_MIN_WINDOW_SLOTS;
+    if (current - flow.min_slots[entry] < RTT_MIN_WINDOW_SLOTS) {
+      values->min_rtt = flow.min_rtts[entry];
+      break;
+    }
+  }
+  return true;
+}
+
+bool RttFilterStore::parseGains(const std::string& text, RttFilterConfig* config) {
+  char* end = nullptr;
+  float alpha = strtof(text.c_str(), &end);
+  if (end == text.c_str() || *end != ',') {
+    return false;
+  }
+  const char* beta_text = end + 1;
+  float beta = strtof(beta_text, &end);
+  if (end == beta_text || *end != '\0' || alpha <= 0 || alpha > 1 || beta <= 0 || beta > 1) {
+    return false;
+  }
+  config->alpha = alpha;
+  config->beta = beta;
+  return true;
+}
+
+RttFilterOutput::RttFilterOutput(const RttFilterConfig& config, const std::string& path)
+    : store(MAX_FLOW_IDS, config), current_slot(0), last_timestamp_ns(0) {
+  if (path.empty()) {
+    return;
+  }
+
+  file.open(path);
+  if (!file.is_open()) {
+    LOG_F(WARNING, "Cannot open RTT filter output %s", path.c_str());
+    return;
+  }
+  file << "timestamp_ns, flow_id, samples, latest_rtt, min_rtt, srtt, rttvar\n";
+}
+
+void RttFilterOutput::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  if (sample.per_pipe) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  store.recordSample(sample.flow_id, sample.rtt, sample.measurement_total, timestamp_ns);
+  last_timestamp_ns = timestamp_ns;
+}
+
+void RttFilterOutput::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  std::lock_guard<std::mutex> lock(mutex);
+  store.record(report.flow_id, report.current_rtt, timestamp_ns);
+  last_timestamp_ns = timestamp_ns;
+}
+
+void RttFilterOutput::commit() {
+  if (!file.is_open() || last_timestamp_ns == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  uint64_t slot = store.slot(last_timestamp_ns);
+  if (slot != current_slot) {
+    current_slot = slot;
+    writeValues(last_timestamp_ns);
+  }
+}
+
+void RttFilterOutput::writeValues(int64_t timestamp_ns) {
+  for (uint32_t flow_id : store.flows()) {
+    RttFilterValues values;
+    if (!store.values(flow_id, timestamp_ns, &values)) {
+      continue;
+    }
+    file << timestamp_ns << ", " << flow_id << ", " << values.samples << ", " << values.latest_rtt << ", "
+         << values.min_rtt << ", " << values.srtt << ", " << values.rttvar << "\n";
+  }
+  file.flush();
+}
+
+void RttFilterOutput::releaseFlow(uint32_t flow_id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  store.release(flow_id);
+}
+
+void RttFilterOutput::close() {
+  file.close();
+}
+
+bool RttFilterOutput::values(uint32_t flow_id, RttFilterValues* values) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.values(flow_id, monotonicNanoseconds(), values);
+}
+
+std::vector<uint32_t> RttFilterOutput::flows() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.flows();
+}
+
+size_t RttFilterOutput::memoryBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.memoryBytes();
+}
@@ -0,0 +1,131 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "measurement_output.hpp"
+
+// Slots the window of the minimum RTT is split into, the window slides by one slot
+#define RTT_MIN_WINDOW_SLOTS 8
+
+struct RttFilterConfig {
+  int64_t min_window_ns = 10000000000;
+  // Gains of the smoothed RTT and the RTT variation, as in RFC 6298
+  float alpha = 0.125f;
+  float beta = 0.25f;
+};
+
+// Filter values of one flow, RTTs in the units of the RTT registers
+struct RttFilterValues {
+  uint64_t samples;
+  uint16_t latest_rtt;
+  // Minimum over the window, 0 without samples in the window
+  uint16_t min_rtt;
+  float srtt;
+  float rttvar;
+};
+
+/*
+  Software filters over the individual RTT samples of every flow: the
+  minimum over a sliding window and the exponentially weighted smoothed RTT
+  and RTT variation. The window minimum is a monotonic deque of slot minima:
+  samples evict all larger ones from its back, slots that left the window
+  drop off its front, so an update is O(1) amortized. With one entry per
+  slot at most, the deque has a fixed size, and the minimum covers the
+  current slot and the RTT_MIN_WINDOW_SLOTS - 1 before it.
+
+  Filters are indexed directly by flow id, all memory is allocated up front
+  (memoryBytes()). Not synchronized.
+*/
+class RttFilterStore {
+ private:
+  struct FlowFilters {
+    uint64_t last_total;
+    uint32_t samples;
+    float srtt;
+    float rttvar;
+    uint32_t min_slots[RTT_MIN_WINDOW_SLOTS];
+    uint16_t min_rtts[RTT_MIN_WINDOW_SLOTS];
+    uint16_t latest_rtt;
+    // Ring of the deque entries
+    uint8_t min_head;
+    uint8_t min_count;
+  };
+
+  RttFilterConfig config;
+  int64_t slot_ns;
+  int64_t start_ns;
+  std::vector<FlowFilters> filters;
+  // Flows with samples, in the order of their first sample
+  std::vector<bool> listed;
+  std::vector<uint32_t> flow_ids;
+
+ public:
+  RttFilterStore(uint32_t flow_ids, const RttFilterConfig& config);
+
+  void record(uint32_t flow_id, uint16_t rtt, int64_t timestamp_ns);
+  // Records `rtt` if `measurement_total` changed since the last call for the flow.
+  // A smaller total means the id was reused, its filters start over.
+  void recordSample(uint32_t flow_id, uint16_t rtt, uint64_t measurement_total, int64_t timestamp_ns);
+  // Drops the filters of the flow
+  void release(uint32_t flow_id);
+
+  uint64_t slot(int64_t timestamp_ns) const {
+    return timestamp_ns > start_ns ? (uint64_t)((timestamp_ns - start_ns) / slot_ns) : 0;
+  }
+  // False for flows without samples
+  bool values(uint32_t flow_id, int64_t now_ns, RttFilterValues* values) const;
+  const std::vector<uint32_t>& flows() const { return flow_ids; }
+  size_t memoryBytes() const {
+    return filters.size() * sizeof(FlowFilters) + listed.size() / 8 + flow_ids.capacity() * sizeof(uint32_t);
+  }
+
+  // "alpha,beta"; false if malformed
+  static bool parseGains(const std::string& text, RttFilterConfig* config);
+};
+
+/*
+  Pipeline sink feeding the filters from the readout samples (new
+  spin_measurement_storage values) or from the reports (current_rtt). With a
+  file, the filter values of all flows are written as CSV whenever the
+  window slides.
+*/
+class RttFilterOutput : public MeasurementOutput {
+ private:
+  mutable std::mutex mutex;
+  RttFilterStore store;
+  std::ofstream file;
+  uint64_t current_slot;
+  int64_t last_timestamp_ns;
+
+  void writeValues(int64_t timestamp_ns);
+
+ public:
+  // `path` may be empty
+  RttFilterOutput(const RttFilterConfig& config, const std::string& path);
+
+  bool isOpen() override { return true; }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override;
+  void releaseFlow(uint32_t flow_id) override;
+  void close() override;
+  bool reopen(const std::string& path) override { return true; }
+
+  // May be called from any thread
+  bool values(uint32_t flow_id, RttFilterValues* values) const;
+  std::vector<uint32_t> flows() const;
+  size_t memoryBytes() const;
+};
@@ -0,0 +1,316 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "rtt_sketch.hpp"
+
+#include <loguru.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static_assert(RttHistogram::bucket(0xFFFF) == RTT_SKETCH_BUCKETS - 1, "The last bucket has to hold the largest value");
+
+void RttHistogram::clear() {
+  memset(counts, 0, sizeof(counts));
+  total = 0;
+}
+
+void RttHistogram::add(uint16_t value, uint64_t count) {
+  counts[bucket(value)] += count;
+  total += count;
+}
+
+void RttHistogram::merge(const RttHistogram& other) {
+  for (int i = 0; i < RTT_SKETCH_BUCKETS; i++) {
+    counts[i] += other.counts[i];
+  }
+  total += other.total;
+}
+
+uint16_t RttHistogram::quantile(double q) const {
+  if (total == 0) {
+    return 0;
+  }
+
+  uint64_t rank = (uint64_t)std::ceil(q * total);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (int i = 0; i < RTT_SKETCH_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return (uint16_t)(((uint32_t)bucketLow(i) + bucketHigh(i)) / 2);
+    }
+  }
+  return bucketHigh(RTT_SKETCH_BUCKETS - 1);
+}
+
+uint16_t RttHistogram::bucketLow(int bucket) {
+  if (bucket < RTT_SKETCH_SUB_BUCKETS) {
+    return bucket;
+  }
+  int linear = bucket - RTT_SKETCH_SUB_BUCKETS;
+  int shift = linear / (RTT_SKETCH_SUB_BUCKETS / 2) + 1;
+  return (uint16_t)((linear % (RTT_SKETCH_SUB_BUCKETS / 2) + RTT_SKETCH_SUB_BUCKETS / 2) << shift);
+}
+
+uint16_t RttHistogram::bucketHigh(int bucket) {
+  if (bucket < RTT_SKETCH_SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = (bucket - RTT_SKETCH_SUB_BUCKETS) / (RTT_SKETCH_SUB_BUCKETS / 2) + 1;
+  return (uint16_t)(bucketLow(bucket) + (1 << shift) - 1);
+}
+
+RttSketchStore::RttSketchStore(uint32_t max_flows, uint32_t flow_ids, uint32_t epochs, int64_t epoch_ns)
+    : max_flows(max_flows),
+      epochs(epochs),
+      epoch_ns(epoch_ns),
+      start_ns(monotonicNanoseconds()),
+      slot_of_flow(flow_ids, -1),
+      flow_of_slot(max_flows, NO_FLOW),
+      used_slots(0),
+      rejected(0),
+      lifetime_counts((size_t)max_flows * RTT_SKETCH_BUCKETS),
+      epoch_counts((size_t)max_flows * epochs * RTT_SKETCH_BUCKETS),
+      // No epoch histogram belongs to an epoch yet
+      epoch_numbers((size_t)max_flows * epochs, UINT64_MAX),
+      last_totals(max_flows) {
+  CHECK_F(epochs > 0 && epoch_ns > 0, "The sketch window needs at least one epoch");
+  free_slots.reserve(max_flows);
+}
+
+int32_t RttSketchStore::slot(uint32_t flow_id) {
+  if (flow_id >= slot_of_flow.size()) {
+    return -1;
+  }
+  int32_t slot = slot_of_flow[flow_id];
+  if (slot >= 0) {
+    return slot;
+  }
+  if (!free_slots.empty()) {
+    slot = free_slots.back();
+    free_slots.pop_back();
+  } else if (used_slots < max_flows) {
+    slot = used_slots++;
+  } else {
+    rejected++;
+    return -1;
+  }
+
+  slot_of_flow[flow_id] = slot;
+  flow_of_slot[slot] = flow_id;
+  return slot;
+}
+
+void RttSketchStore::clearSlot(int32_t slot) {
+  memset(&lifetime_counts[(size_t)slot * RTT_SKETCH_BUCKETS], 0, RTT_SKETCH_BUCKETS * sizeof(uint32_t));
+  // The epoch histograms are cleared lazily once they belong to no epoch
+  std::fill_n(epoch_numbers.begin() + (size_t)slot * epochs, epochs, UINT64_MAX);
+  last_totals[slot] = 0;
+}
+
+void RttSketchStore::release(uint32_t flow_id) {
+  if (flow_id >= slot_of_flow.size() || slot_of_flow[flow_id] < 0) {
+    return;
+  }
+
+  int32_t flow_slot = slot_of_flow[flow_id];
+  clearSlot(flow_slot);
+  slot_of_flow[flow_id] = -1;
+  flow_of_slot[flow_slot] = NO_FLOW;
+  free_slots.push_back(flow_slot);
+}
+
+void RttSketchStore::record(uint32_t flow_id, uint16_t rtt, int64_t timestamp_ns) {
+  int32_t flow_slot = slot(flow_id);
+  if (flow_slot < 0) {
+    return;
+  }
+
+  int bucket = RttHistogram::bucket(rtt);
+  uint32_t& lifetime_count = lifetime_counts[(size_t)flow_slot * RTT_SKETCH_BUCKETS + bucket];
+  if (lifetime_count != UINT32_MAX) {
+    lifetime_count++;
+  }
+
+  // The epoch histogram still holds an epoch that left the window
+  uint64_t current = epoch(timestamp_ns);
+  size_t epoch_index = (size_t)flow_slot * epochs + current % epochs;
+  uint16_t* counts = &epoch_counts[epoch_index * RTT_SKETCH_BUCKETS];
+  if (epoch_numbers[epoch_index] != current) {
+    memset(counts, 0, RTT_SKETCH_BUCKETS * sizeof(uint16_t));
+    epoch_numbers[epoch_index] = current;
+  }
+  if (counts[bucket] != UINT16_MAX) {
+    counts[bucket]++;
+  }
+}
+
+void RttSketchStore::recordSample(uint32_t flow_id, uint16_t rtt, uint64_t measurement_total, int64_t timestamp_ns) {
+  int32_t flow_slot = slot(flow_id);
+  if (flow_slot < 0 || measurement_total == last_totals[flow_slot]) {
+    return;
+  }
+  // The counters restarted, the samples so far belong to the previous flow of the id
+  if (measurement_total < last_totals[flow_slot]) {
+    clearSlot(flow_slot);
+  }
+  last_totals[flow_slot] = measurement_total;
+  record(flow_id, rtt, timestamp_ns);
+}
+
+bool RttSketchStore::lifetime(uint32_t flow_id, RttHistogram* histogram) const {
+  if (flow_id >= slot_of_flow.size() || slot_of_flow[flow_id] < 0) {
+    return false;
+  }
+
+  const uint32_t* counts = &lifetime_counts[(size_t)slot_of_flow[flow_id] * RTT_SKETCH_BUCKETS];
+  for (int i = 0; i < RTT_SKETCH_BUCKETS; i++) {
+    histogram->counts[i] += counts[i];
+    histogram->total += counts[i];
+  }
+  return true;
+}
+
+bool RttSketchStore::window(uint32_t flow_id, int64_t now_ns, RttHistogram* histogram) const {
+  if (flow_id >= slot_of_flow.size() || slot_of_flow[flow_id] < 0) {
+    return false;
+  }
+
+  uint64_t current = epoch(now_ns);
+  for (uint32_t i = 0; i < epochs; i++) {
+    size_t epoch_index = (size_t)slot_of_flow[flow_id] * epochs + i;
+    uint64_t number = epoch_numbers[epoch_index];
+    if (number == UINT64_MAX || number > current || current - number >= epochs) {
+      continue;
+    }
+
+    const uint16_t* counts = &epoch_counts[epoch_index * RTT_SKETCH_BUCKETS];
+    for (int j = 0; j < RTT_SKETCH_BUCKETS; j++) {
+      histogram->counts[j] += counts[j];
+      histogram->total += counts[j];
+    }
+  }
+  return true;
+}
+
+std::vector<uint32_t> RttSketchStore::flows() const {
+  std::vector<uint32_t> result;
+  result.reserve(used_slots - free_slots.size());
+  for (uint32_t slot = 0; slot < used_slots; slot++) {
+    if (flow_of_slot[slot] != NO_FLOW) {
+      result.push_back(flow_of_slot[slot]);
+    }
+  }
+  return result;
+}
+
+size_t RttSketchStore::memoryBytes() const {
+  return slot_of_flow.size() * sizeof(int32_t) + flow_of_slot.size() * sizeof(uint32_t) +
+         free_slots.capacity() * sizeof(int32_t) +
+         lifetime_counts.size() * sizeof(uint32_t) + epoch_counts.size() * sizeof(uint16_t) +
+         epoch_numbers.size() * sizeof(uint64_t) + last_totals.size() * sizeof(uint64_t);
+}
+
+RttSketchOutput::RttSketchOutput(uint32_t max_flows, uint32_t epochs, int64_t epoch_ns, const std::string& path)
+    : store(max_flows, MAX_FLOW_IDS, epochs, epoch_ns), current_epoch(0), last_timestamp_ns(0) {
+  if (path.empty()) {
+    return;
+  }
+
+  file.open(path);
+  if (!file.is_open()) {
+    LOG_F(WARNING, "Cannot open quantile output %s", path.c_str());
+    return;
+  }
+  file << "timestamp_ns, flow_id, window_count, window_p50, window_p90, window_p99, window_p999, lifetime_count, "
+          "lifetime_p50, lifetime_p90, lifetime_p99, lifetime_p999\n";
+}
+
+void RttSketchOutput::writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) {
+  if (sample.per_pipe) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  store.recordSample(sample.flow_id, sample.rtt, sample.measurement_total, timestamp_ns);
+  last_timestamp_ns = timestamp_ns;
+}
+
+void RttSketchOutput::writeReport(int64_t timestamp_ns, const MirrorReport& report) {
+  std::lock_guard<std::mutex> lock(mutex);
+  store.record(report.flow_id, report.current_rtt, timestamp_ns);
+  last_timestamp_ns = timestamp_ns;
+}
+
+void RttSketchOutput::commit() {
+  if (!file.is_open() || last_timestamp_ns == 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  uint64_t epoch = store.epoch(last_timestamp_ns);
+  if (epoch != current_epoch) {
+    current_epoch = epoch;
+    writeQuantiles(last_timestamp_ns);
+  }
+}
+
+void RttSketchOutput::writeQuantiles(int64_t timestamp_ns) {
+  static const double levels[] = {0.5, 0.9, 0.99, 0.999};
+
+  for (uint32_t flow_id : store.flows()) {
+    RttHistogram window, lifetime;
+    store.window(flow_id, timestamp_ns, &window);
+    store.lifetime(flow_id, &lifetime);
+
+    file << timestamp_ns << ", " << flow_id << ", " << window.total;
+    for (double level : levels) {
+      file << ", " << window.quantile(level);
+    }
+    file << ", " << lifetime.total;
+    for (double level : levels) {
+      file << ", " << lifetime.quantile(level);
+    }
+    file << "\n";
+  }
+  file.flush();
+}
+
+void RttSketchOutput::close() {
+  file.close();
+}
+
+void RttSketchOutput::releaseFlow(uint32_t flow_id) {
+  std::lock_guard<std::mutex> lock(mutex);
+  store.release(flow_id);
+}
+
+bool RttSketchOutput::quantiles(uint32_t flow_id, RttHistogram* window, RttHistogram* lifetime) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.window(flow_id, monotonicNanoseconds(), window) && store.lifetime(flow_id, lifetime);
+}
+
+std::vector<uint32_t> RttSketchOutput::flows() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.flows();
+}
+
+uint64_t RttSketchOutput::rejectedFlows() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.rejectedFlows();
+}
+
+size_t RttSketchOutput::memoryBytes() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return store.memoryBytes();
+}
@@ -0,0 +1,150 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "measurement_output.hpp"
+
+// Values below 2^RTT_SKETCH_SUB_BUCKET_BITS are counted exactly, every power of
+// two above is split into 2^(RTT_SKETCH_SUB_BUCKET_BITS - 1) linear buckets
+#define RTT_SKETCH_SUB_BUCKET_BITS 5
+#define RTT_SKETCH_SUB_BUCKETS (1 << RTT_SKETCH_SUB_BUCKET_BITS)
+#define RTT_SKETCH_BUCKETS (RTT_SKETCH_SUB_BUCKETS + (16 - RTT_SKETCH_SUB_BUCKET_BITS) * (RTT_SKETCH_SUB_BUCKETS / 2))
+
+/*
+  Log-linear histogram of 16-bit RTT values (HDR histogram layout). Quantiles
+  are within 1/32 of the true value, histograms of different flows, pipes or
+  time windows merge by adding the counts.
+*/
+struct RttHistogram {
+  uint64_t counts[RTT_SKETCH_BUCKETS];
+  uint64_t total;
+
+  RttHistogram() { clear(); }
+
+  void clear();
+  void add(uint16_t value, uint64_t count = 1);
+  void merge(const RttHistogram& other);
+  // Midpoint of the bucket holding the q-quantile, 0 for an empty histogram
+  uint16_t quantile(double q) const;
+
+  static constexpr int bucket(uint16_t value) {
+    if (value < RTT_SKETCH_SUB_BUCKETS) {
+      return value;
+    }
+    // Position of the highest bit, the next bits select the linear bucket
+    int exponent = 31 - __builtin_clz(value);
+    int shift = exponent - (RTT_SKETCH_SUB_BUCKET_BITS - 1);
+    return RTT_SKETCH_SUB_BUCKETS + (shift - 1) * (RTT_SKETCH_SUB_BUCKETS / 2) + ((value >> shift) - RTT_SKETCH_SUB_BUCKETS / 2);
+  }
+  static uint16_t bucketLow(int bucket);
+  static uint16_t bucketHigh(int bucket);
+};
+
+/*
+  Bounded per-flow sketches: a lifetime histogram and a ring of `epochs`
+  epoch histograms forming the sliding window. All memory is allocated up
+  front for `max_flows` flows; a flow takes a slot on its first sample and
+  flows beyond the limit are counted as rejected. Released flows return
+  their slot, and a measurement total that went backwards (the id was
+  recycled for a new flow) clears the histograms of the slot. Recording is
+  O(1): the epoch slot of a flow is cleared lazily when it is reused.
+*/
+class RttSketchStore {
+ private:
+  uint32_t max_flows;
+  uint32_t epochs;
+  int64_t epoch_ns;
+  int64_t start_ns;
+
+  // Slot of every flow id, -1 if none; free slots hold NO_FLOW
+  std::vector<int32_t> slot_of_flow;
+  std::vector<uint32_t> flow_of_slot;
+  std::vector<int32_t> free_slots;
+  uint32_t used_slots;
+  uint64_t rejected;
+
+  // Per slot: RTT_SKETCH_BUCKETS lifetime counts, epochs * RTT_SKETCH_BUCKETS
+  // epoch counts and the epoch number each epoch histogram belongs to
+  std::vector<uint32_t> lifetime_counts;
+  std::vector<uint16_t> epoch_counts;
+  std::vector<uint64_t> epoch_numbers;
+  std::vector<uint64_t> last_totals;
+
+  static constexpr uint32_t NO_FLOW = UINT32_MAX;
+
+  int32_t slot(uint32_t flow_id);
+  void clearSlot(int32_t slot);
+
+ public:
+  RttSketchStore(uint32_t max_flows, uint32_t flow_ids, uint32_t epochs, int64_t epoch_ns);
+
+  void record(uint32_t flow_id, uint16_t rtt, int64_t timestamp_ns);
+  // Records `rtt` if `measurement_total` grew since the last call for the flow.
+  // The readout only sees the latest of several measurements per cycle.
+  // A smaller total than the last one starts a new flow on the same slot.
+  void recordSample(uint32_t flow_id, uint16_t rtt, uint64_t measurement_total, int64_t timestamp_ns);
+  // Drops the sketches of the flow and frees its slot
+  void release(uint32_t flow_id);
+
+  uint64_t epoch(int64_t timestamp_ns) const {
+    return timestamp_ns > start_ns ? (uint64_t)((timestamp_ns - start_ns) / epoch_ns) : 0;
+  }
+  int64_t windowLength() const { return epoch_ns * epochs; }
+
+  // Adds the counts of the flow to `histogram`, returns false for unknown flows
+  bool lifetime(uint32_t flow_id, RttHistogram* histogram) const;
+  // The current epoch and the epochs - 1 before it
+  bool window(uint32_t flow_id, int64_t now_ns, RttHistogram* histogram) const;
+
+  std::vector<uint32_t> flows() const;
+  uint64_t rejectedFlows() const { return rejected; }
+  size_t memoryBytes() const;
+};
+
+/*
+  Pipeline sink feeding the sketches from the readout samples (new
+  spin_measurement_storage values) or from the reports (current_rtt). With a
+  file, the window and lifetime quantiles of all flows are written as CSV at
+  every epoch boundary.
+*/
+class RttSketchOutput : public MeasurementOutput {
+ private:
+  mutable std::mutex mutex;
+  RttSketchStore store;
+  std::ofstream file;
+  uint64_t current_epoch;
+  int64_t last_timestamp_ns;
+
+  void writeQuantiles(int64_t timestamp_ns);
+
+ public:
+  // `path` may be empty; the window of `epochs` * `epoch_ns` slides by one epoch
+  RttSketchOutput(uint32_t max_flows, uint32_t epochs, int64_t epoch_ns, const std::string& path);
+
+  bool isOpen() override { return true; }
+  void writeFlowSample(int64_t timestamp_ns, const FlowSample& sample) override;
+  void writeReport(int64_t timestamp_ns, const MirrorReport& report) override;
+  void commit() override;
+  void releaseFlow(uint32_t flow_id) override;
+  void close() override;
+  bool reopen(const std::string& path) override { return true; }
+
+  // May be called from any thread
+  bool quantiles(uint32_t flow_id, RttHistogram* window, RttHistogram* lifetime) const;
+  std::vector<uint32_t> flows() const;
+  uint64_t rejectedFlows() const;
+  size_t memoryBytes() const;
+};
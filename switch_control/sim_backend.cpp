@@ -0,0 +1,642 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "sim_backend.hpp"
+
+#include <algorithm>
+
+SimConfig SimConfig::tofino() {
+  SimConfig config;
+  config.register_read_ns = 15000;
+  config.register_write_ns = 15000;
+  config.batched_register_write_ns = 1000;
+  config.register_sync_ns = 100000;
+  config.register_sync_cell_ns = 10;
+  config.batch_read_cell_ns = 100;
+  config.table_op_ns = 20000;
+  config.batched_table_op_ns = 3000;
+  config.batch_commit_ns = 50000;
+  return config;
+}
+
+void SimBackend::emulateLatency(uint64_t ns) {
+  if (ns == 0) {
+    return;
+  }
+
+  // Sleep for the bulk of long delays, spin for the rest to stay accurate
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+  if (ns > 100000) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(ns - 50000));
+  }
+  while (std::chrono::steady_clock::now() < deadline) {
+  }
+}
+
+SimSession::SimSession(SimBackend* backend)
+    : backend(backend), in_batch(false), in_transaction(false), batched_ops(0) {}
+
+void SimSession::beginBatch() {
+  operations.lock();
+  CHECK_F(!in_batch, "Batch already open");
+  in_batch = true;
+  batched_ops = 0;
+}
+
+void SimSession::endBatch() {
+  CHECK_F(in_batch, "No open batch");
+  in_batch = false;
+  if (batched_ops > 0) {
+    SimBackend::emulateLatency(backend->config.batch_commit_ns);
+  }
+  operations.unlock();
+}
+
+void SimSession::beginTransaction() {
+  operations.lock();
+  CHECK_F(!in_transaction, "Transaction already open");
+  in_transaction = true;
+  pending.clear();
+}
+
+void SimSession::commitTransaction() {
+  CHECK_F(in_transaction, "No open transaction");
+  in_transaction = false;
+
+  {
+    // All operations become visible at once to the data plane and to readers
+    std::lock_guard<std::mutex> lock(backend->state_mutex);
+    for (auto& op : pending) {
+      if (op.type == PendingOp::REGISTER_WRITE) {
+        for (uint64_t index = op.index; index < op.index + op.count; index++) {
+          backend->update(op.target, index, op.value);
+        }
+      } else {
+        backend->applyTableOp(op.type, op.target, op.key, op.data);
+      }
+    }
+  }
+  pending.clear();
+  SimBackend::emulateLatency(backend->config.batch_commit_ns);
+  operations.unlock();
+}
+
+void SimSession::abortTransaction() {
+  CHECK_F(in_transaction, "No open transaction");
+  in_transaction = false;
+  pending.clear();
+  operations.unlock();
+}
+
+void SimSession::completeOperations() {}
+
+SimBackend::SimBackend(SimConfig config) : config(config), traffic_running(false), packets(0), reports(0) {
+  CHECK_F(config.pipes > 0 && config.num_flows > 0, "Invalid simulator configuration");
+
+  // Registers and tables as declared by bf-rt.json, per-flow ones scaled from flow_id_v4 to num_flows
+  uint32_t flows = config.num_flows;
+  spin_delay_tracker = addRegister<p4::spin_delay_tracker_binding>(flows);
+  spin_delay_tracker_dup = addRegister<p4::spin_delay_tracker_dup_binding>(flows);
+  spin_measurement_counter = addRegister<p4::spin_measurement_counter_binding>(flows);
+  first_rtt_protection_reg = addRegister<p4::first_rtt_protection_reg_binding>(flows);
+  spin_phase_tracker = addRegister<p4::spin_phase_tracker_binding>(flows);
+  // Pair registers, phase in the upper and threshold_counter in the lower byte. Not in the
+  // bindings (struct values), declared with NUM_FLOWS cells like the other per-flow registers.
+  spinbit_threshold_phase_reg = addRegister("Ingress.spinbit.spinbit_threshold_phase_reg", 16, flows);
+  spinbit_threshold_phase_reg_variant2 = addRegister("Ingress.spinbit.spinbit_threshold_phase_reg_variant2", 16, flows);
+  spin_measurement_storage = addRegister<p4::spin_measurement_storage_binding>(flows);
+  // Indexed by flow_id << AVERAGE_BUFFER_BITS | position, but AVERAGE_BUFFER_SIZE cells per flow
+  rtt_ring_buffer = addRegister<p4::rtt_ring_buffer_binding>(flows);
+  rtt_ring_buffer_dup = addRegister<p4::rtt_ring_buffer_dup_binding>(flows);
+  rtt_accumulator = addRegister<p4::rtt_accumulator_binding>(flows);
+  buffer_index = addRegister<p4::buffer_index_binding>(flows);
+  rtt_class_counter = addRegister<p4::rtt_class_counter_binding>(flows);
+
+  rtt_class_table = addTable(p4::rtt_class_table_binding::NAME, {"meta.rtt_accumulator_value", "meta.current_rtt"},
+                             {{"Ingress.spinbit.set_rtt_class", {"class"}}, {"NoAction", {}}},
+                             p4::rtt_class_table_binding::SIZE);
+  // Action order matches meta.reorder_selector
+  reorder_protection_selector = addTable(p4::reorder_protection_selector_binding::NAME, {"hdr.quic_short.quic_bit"},
+                                         {{"Ingress.spinbit.select_spinbit", {}},
+                                          {"Ingress.spinbit.select_qbit_reorder", {}},
+                                          {"Ingress.spinbit.select_consec_reorder", {}}},
+                                         p4::reorder_protection_selector_binding::SIZE);
+  flow_id_v4 = addTable(p4::flow_id_v4_binding::NAME,
+                        {"hdr.ipv4.src_addr", "hdr.ipv4.dst_addr", "hdr.udp.src_port", "hdr.udp.dst_port"},
+                        {{"Ingress.flow_identification.track_flow", {"flow_id"}}, {"NoAction", {}}}, flows);
+
+  LOG_F(INFO, "Simulated data plane with %u pipes and %u flows", config.pipes, config.num_flows);
+}
+
+SimBackend::~SimBackend() {
+  stopTraffic();
+}
+
+dp_handle_t SimBackend::addRegister(const std::string& name, uint32_t width, size_t size) {
+  SimRegister reg;
+  reg.name = name;
+  reg.width = width;
+  reg.size = size;
+  reg.live.assign(size * config.pipes, 0);
+  reg.shadow.assign(size * config.pipes, 0);
+  registers.push_back(std::move(reg));
+  return registers.size() - 1;
+}
+
+dp_handle_t SimBackend::addTable(const std::string& name, std::vector<std::string> keys,
+                                 std::vector<std::pair<std::string, std::vector<std::string>>> actions, size_t size) {
+  SimTable table;
+  table.name = name;
+  table.keys = keys;
+  table.size = size;
+
+  // Action ids are unique across tables, like BfRt ids
+  dp_id_t next_action_id = 1;
+  for (auto& other : tables) {
+    next_action_id += other.actions.size();
+  }
+  for (auto& action : actions) {
+    table.actions.push_back(SimAction{action.first, next_action_id++, action.second});
+  }
+
+  tables.push_back(std::move(table));
+  return tables.size() - 1;
+}
+
+std::shared_ptr<DataplaneSession> SimBackend::createSession() {
+  return std::make_shared<SimSession>(this);
+}
+
+uint32_t SimBackend::pipeCount() {
+  return config.pipes;
+}
+
+dp_handle_t SimBackend::registerOpen(const std::string& name) {
+  for (size_t i = 0; i < registers.size(); i++) {
+    if (registers[i].name == name) {
+      return i;
+    }
+  }
+  ABORT_F("Unknown register %s", name.c_str());
+}
+
+size_t SimBackend::registerSize(dp_handle_t reg) {
+  return registers.at(reg).size;
+}
+
+uint64_t& SimBackend::cell(dp_handle_t reg, uint32_t pipe, uint64_t index) {
+  SimRegister& state = registers[reg];
+  return state.live[(size_t)pipe * state.size + index];
+}
+
+uint64_t SimBackend::update(dp_handle_t reg, uint64_t index, uint64_t value) {
+  SimRegister& state = registers[reg];
+  CHECK_F(index < state.size, "Index %lu exceeds register %s", index, state.name.c_str());
+
+  // Control plane writes go to all pipes
+  uint64_t mask = state.width >= 64 ? ~0ULL : (1ULL << state.width) - 1;
+  for (uint32_t p = 0; p < config.pipes; p++) {
+    cell(reg, p, index) = value & mask;
+  }
+  return value & mask;
+}
+
+uint64_t SimBackend::registerRead(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint32_t pipe) {
+  std::lock_guard<std::recursive_mutex> hold(static_cast<SimSession&>(session).operations);
+  emulateLatency(config.register_read_ns);
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  CHECK_F(index < registers.at(reg).size && pipe < config.pipes, "Index %lu on pipe %u exceeds register %s", index, pipe,
+          registers.at(reg).name.c_str());
+  return cell(reg, pipe, index);
+}
+
+void SimBackend::registerWrite(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint64_t value) {
+  SimSession& sim_session = static_cast<SimSession&>(session);
+  std::lock_guard<std::recursive_mutex> hold(sim_session.operations);
+  // Checked at the call, as BfRt rejects the entry right away, not at the commit
+  CHECK_F(index < registers.at(reg).size, "Index %lu exceeds register %s", index, registers[reg].name.c_str());
+
+  if (sim_session.in_transaction) {
+    SimSession::PendingOp op;
+    op.type = SimSession::PendingOp::REGISTER_WRITE;
+    op.target = reg;
+    op.index = index;
+    op.count = 1;
+    op.value = value;
+    sim_session.pending.push_back(op);
+    return;
+  }
+
+  emulateLatency(config.register_write_ns);
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  update(reg, index, value);
+}
+
+void SimBackend::registerWriteRange(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                    uint64_t value) {
+  SimSession& sim_session = static_cast<SimSession&>(session);
+  std::lock_guard<std::recursive_mutex> hold(sim_session.operations);
+  CHECK_F(first + count <= registers.at(reg).size, "Cells %lu+%u exceed register %s", first, count,
+          registers[reg].name.c_str());
+
+  // Every cell is a write of its own, only the pending operation covers the range
+  bool batched = sim_session.in_transaction || sim_session.in_batch;
+  emulateLatency((uint64_t)count * (batched ? config.batched_register_write_ns : config.register_write_ns));
+
+  if (sim_session.in_transaction) {
+    SimSession::PendingOp op;
+    op.type = SimSession::PendingOp::REGISTER_WRITE;
+    op.target = reg;
+    op.index = first;
+    op.count = count;
+    op.value = value;
+    sim_session.pending.push_back(op);
+    return;
+  }
+  if (sim_session.in_batch) {
+    sim_session.batched_ops += count;
+  }
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  for (uint64_t index = first; index < first + count; index++) {
+    update(reg, index, value);
+  }
+}
+
+void SimBackend::registerSyncStart(DataplaneSession& session, dp_handle_t reg) {
+  std::lock_guard<std::recursive_mutex> hold(static_cast<SimSession&>(session).operations);
+  SimRegister& state = registers.at(reg);
+
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    state.shadow = state.live;
+  }
+
+  // Syncs run in the background on the device, overlapping ones overlap here too
+  uint64_t latency = config.register_sync_ns + (uint64_t)config.register_sync_cell_ns * state.live.size();
+  state.sync_deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(latency);
+}
+
+void SimBackend::registerSyncWait(dp_handle_t reg) {
+  auto remaining = registers.at(reg).sync_deadline - std::chrono::steady_clock::now();
+  if (remaining.count() > 0) {
+    emulateLatency(std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count());
+  }
+}
+
+void SimBackend::registerReserve(dp_handle_t reg, uint32_t count) {}
+
+void SimBackend::registerReadBatch(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                   uint32_t pipe, uint64_t* values) {
+  std::lock_guard<std::recursive_mutex> hold(static_cast<SimSession&>(session).operations);
+  SimRegister& state = registers.at(reg);
+  CHECK_F(first + count <= state.size && pipe < config.pipes, "Invalid batch read");
+
+  emulateLatency((uint64_t)config.batch_read_cell_ns * count);
+
+  // Only the sync writes the shadow, which does not run concurrently with reads
+  std::copy_n(state.shadow.begin() + (size_t)pipe * state.size + first, count, values);
+}
+
+void SimBackend::registerReadBatchPipes(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                                        uint32_t pipes, uint64_t* values) {
+  std::lock_guard<std::recursive_mutex> hold(static_cast<SimSession&>(session).operations);
+  SimRegister& state = registers.at(reg);
+  CHECK_F(first + count <= state.size && pipes <= config.pipes, "Invalid batch read");
+
+  // One get returns the values of all pipes
+  emulateLatency((uint64_t)config.batch_read_cell_ns * count);
+
+  for (uint32_t pipe = 0; pipe < pipes; pipe++) {
+    std::copy_n(state.shadow.begin() + (size_t)pipe * state.size + first, count, values + (size_t)pipe * count);
+  }
+}
+
+dp_handle_t SimBackend::tableOpen(const std::string& name) {
+  for (size_t i = 0; i < tables.size(); i++) {
+    if (tables[i].name == name) {
+      return i;
+    }
+  }
+  ABORT_F("Unknown table %s", name.c_str());
+}
+
+dp_id_t SimBackend::keyFieldId(dp_handle_t table, const std::string& name) {
+  auto& keys = tables.at(table).keys;
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i] == name) {
+      return i + 1;
+    }
+  }
+  ABORT_F("Unknown key field %s", name.c_str());
+}
+
+dp_id_t SimBackend::actionId(dp_handle_t table, const std::string& name) {
+  for (auto& action : tables.at(table).actions) {
+    if (action.name == name) {
+      return action.id;
+    }
+  }
+  ABORT_F("Unknown action %s", name.c_str());
+}
+
+dp_id_t SimBackend::dataFieldId(dp_handle_t table, dp_id_t action, const std::string& name) {
+  for (auto& candidate : tables.at(table).actions) {
+    if (candidate.id != action) {
+      continue;
+    }
+    for (size_t i = 0; i < candidate.data_fields.size(); i++) {
+      if (candidate.data_fields[i] == name) {
+        return i + 1;
+      }
+    }
+  }
+  ABORT_F("Unknown data field %s", name.c_str());
+}
+
+size_t SimBackend::tableSize(dp_handle_t table) {
+  return tables.at(table).size;
+}
+
+std::vector<uint64_t> SimBackend::entryKey(const SimTable& table, const TableKey& key) {
+  std::vector<uint64_t> result(2 * table.keys.size(), 0);
+  for (uint32_t i = 0; i < key.count; i++) {
+    const TableKey::Field& field = key.fields[i];
+    CHECK_F(field.id >= 1 && field.id <= table.keys.size(), "Invalid key field %u of %s", field.id, table.name.c_str());
+    result[2 * (field.id - 1)] = field.value;
+    result[2 * (field.id - 1) + 1] = field.range_end;
+  }
+  return result;
+}
+
+void SimBackend::applyTableOp(int type, dp_handle_t table, const TableKey& key, const TableData& data) {
+  SimTable& state = tables.at(table);
+  auto entry_key = entryKey(state, key);
+  auto it = state.entries.find(entry_key);
+
+  if (type == SimSession::PendingOp::ADD) {
+    CHECK_F(it == state.entries.end(), "Entry already exists in %s", state.name.c_str());
+    CHECK_F(state.entries.size() < state.size, "Table %s is full", state.name.c_str());
+    state.entries.emplace(std::move(entry_key), data);
+  } else if (type == SimSession::PendingOp::MODIFY) {
+    CHECK_F(it != state.entries.end(), "Entry does not exist in %s", state.name.c_str());
+    it->second = data;
+  } else {
+    CHECK_F(it != state.entries.end(), "Entry does not exist in %s", state.name.c_str());
+    state.entries.erase(it);
+  }
+}
+
+void SimBackend::tableOperation(DataplaneSession& session, int type, dp_handle_t table, const TableKey& key,
+                                const TableData& data) {
+  SimSession& sim_session = static_cast<SimSession&>(session);
+  std::lock_guard<std::recursive_mutex> hold(sim_session.operations);
+
+  if (sim_session.in_transaction) {
+    SimSession::PendingOp op;
+    op.type = (decltype(op.type))type;
+    op.target = table;
+    op.key = key;
+    op.data = data;
+    sim_session.pending.push_back(op);
+    emulateLatency(config.batched_table_op_ns);
+    return;
+  }
+
+  if (sim_session.in_batch) {
+    emulateLatency(config.batched_table_op_ns);
+    sim_session.batched_ops++;
+  } else {
+    emulateLatency(config.table_op_ns);
+  }
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  applyTableOp(type, table, key, data);
+}
+
+void SimBackend::tableEntryAdd(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) {
+  tableOperation(session, SimSession::PendingOp::ADD, table, key, data);
+}
+
+void SimBackend::tableEntryModify(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) {
+  tableOperation(session, SimSession::PendingOp::MODIFY, table, key, data);
+}
+
+void SimBackend::tableEntryDelete(DataplaneSession& session, dp_handle_t table, const TableKey& key) {
+  tableOperation(session, SimSession::PendingOp::DELETE, table, key, TableData());
+}
+
+bool SimBackend::lookupRttClass(uint16_t accumulator, uint16_t rtt, uint8_t* rtt_class) {
+  const SimTable& table = tables[rtt_class_table];
+  dp_id_t set_rtt_class = table.actions[0].id;
+
+  for (auto& entry : table.entries) {
+    const std::vector<uint64_t>& key = entry.first;
+    if (accumulator < key[0] || accumulator > key[1] || rtt < key[2] || rtt > key[3]) {
+      continue;
+    }
+    // NoAction leaves meta.rtt_class_temp at 0
+    *rtt_class = entry.second.action_id == set_rtt_class ? (uint8_t)entry.second.fields[0].value : 0;
+    return true;
+  }
+  return false;
+}
+
+uint8_t SimBackend::reorderSelector() {
+  // QUIC short headers always carry quic_bit 1
+  const SimTable& table = tables[reorder_protection_selector];
+  auto it = table.entries.find(std::vector<uint64_t>{1, 1});
+  if (it == table.entries.end()) {
+    return 0;
+  }
+  for (size_t i = 0; i < table.actions.size(); i++) {
+    if (table.actions[i].id == it->second.action_id) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+bool SimBackend::process(uint32_t pipe, uint32_t flow_id, uint8_t spin_bit, uint16_t current_time, MirrorReport* report) {
+  CHECK_F(flow_id < config.num_flows && pipe < config.pipes, "Invalid packet for flow %u on pipe %u", flow_id, pipe);
+
+  // Spin bit phase change detection, see Spin_bit.p4
+  bool new_phase = false;
+  uint8_t selector = reorderSelector();
+  if (selector == 1 || selector == 2) {
+    uint64_t& state = cell(selector == 1 ? spinbit_threshold_phase_reg : spinbit_threshold_phase_reg_variant2, pipe, flow_id);
+    uint8_t phase = (state >> 8) & 1;
+    uint8_t threshold_counter = state & 0xFF;
+    if (phase != spin_bit) {
+      if (threshold_counter == SPIN_REORDERING_THRESHOLD - 1) {
+        state = (uint64_t)spin_bit << 8;
+        new_phase = true;
+      } else {
+        state = (state & 0xFF00) | (uint8_t)(threshold_counter + 1);
+      }
+    } else if (selector == 2) {
+      state &= 0xFF00;
+    }
+  } else {
+    uint64_t& phase = cell(spin_phase_tracker, pipe, flow_id);
+    if (spin_bit != phase) {
+      phase = spin_bit;
+      new_phase = true;
+    }
+  }
+
+  if (!new_phase) {
+    return false;
+  }
+
+  // RTT with timer wraparound protection
+  uint64_t& timestamp = cell(spin_delay_tracker, pipe, flow_id);
+  uint16_t rtt = current_time < timestamp ? timestamp - current_time : current_time - timestamp;
+  timestamp = current_time;
+
+  uint64_t& timestamp_dup = cell(spin_delay_tracker_dup, pipe, flow_id);
+  if (current_time < timestamp_dup) {
+    rtt = 0xFFFF - rtt;
+  }
+  timestamp_dup = current_time;
+
+  // No measurement in the first RTT
+  uint64_t& measurement_state = cell(first_rtt_protection_reg, pipe, flow_id);
+  bool measure = measurement_state == 1;
+  measurement_state = 1;
+  if (!measure) {
+    return false;
+  }
+
+  uint64_t& counter = cell(spin_measurement_counter, pipe, flow_id);
+  counter = (counter + 1) & 0xFF;
+  cell(spin_measurement_storage, pipe, flow_id) = rtt;
+
+  // Ring buffer and accumulator
+  uint64_t& position = cell(buffer_index, pipe, flow_id);
+  uint64_t swap_index = ((uint64_t)(flow_id & ((1 << (FLOW_ID_BITS - 1)) - 1)) << AVERAGE_BUFFER_BITS) | position;
+  // The upper ids index beyond the declared cells, which the program leaves undefined;
+  // the simulator wraps them around
+  swap_index %= registers[rtt_ring_buffer].size;
+  position = position == AVERAGE_BUFFER_SIZE - 1 ? 0 : position + 1;
+
+  uint64_t& ring_entry = cell(rtt_ring_buffer, pipe, swap_index);
+  uint16_t removed_rtt = ring_entry;
+  ring_entry = rtt;
+
+  uint64_t& ring_entry_dup = cell(rtt_ring_buffer_dup, pipe, swap_index);
+  bool change_negative = ring_entry_dup > rtt;
+  ring_entry_dup = rtt;
+
+  // Saturating add/subtract
+  uint64_t& accumulator = cell(rtt_accumulator, pipe, flow_id);
+  if (change_negative) {
+    uint16_t change = removed_rtt - rtt;
+    accumulator = accumulator > change ? accumulator - change : 0;
+  } else {
+    uint16_t change = rtt - removed_rtt;
+    accumulator = std::min<uint64_t>(accumulator + change, 0xFFFF);
+  }
+
+  // RTT classification, default action set_rtt_class(2)
+  uint8_t rtt_class = 2;
+  lookupRttClass(accumulator, rtt, &rtt_class);
+  uint64_t& class_counter = cell(rtt_class_counter, pipe, RTT_CLASS_INDEX(flow_id, rtt_class));
+  class_counter = (class_counter + 1) & ((1 << RTT_CLASS_COUNTER_BITS) - 1);
+
+  if (report != nullptr) {
+    report->flow_id = flow_id;
+    report->measurement_count = counter;
+    report->current_time = current_time;
+    report->current_rtt = rtt;
+    report->rtt_accumulator_value = accumulator;
+    report->class_counter = class_counter;
+    report->class_id = rtt_class;
+  }
+  return true;
+}
+
+bool SimBackend::processPacket(uint32_t pipe, uint32_t flow_id, uint8_t spin_bit, uint16_t current_time, MirrorReport* report) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  return process(pipe, flow_id, spin_bit, current_time, report);
+}
+
+void SimBackend::setReportHandler(ReportHandler handler) {
+  report_handler = handler;
+}
+
+void SimBackend::startTraffic(uint32_t rtt_ms, int pipe, uint32_t rtt_spread_ms, uint32_t packet_interval_us) {
+  CHECK_F(rtt_ms > 0, "The simulated RTT must be positive");
+  CHECK_F(pipe < (int)config.pipes, "Pipe %d is not simulated", pipe);
+  if (traffic_running.exchange(true)) {
+    return;
+  }
+  traffic_thread = std::thread(&SimBackend::trafficLoop, this, rtt_ms, pipe, rtt_spread_ms, packet_interval_us);
+}
+
+void SimBackend::stopTraffic() {
+  traffic_running = false;
+  if (traffic_thread.joinable()) {
+    traffic_thread.join();
+  }
+}
+
+void SimBackend::trafficLoop(uint32_t rtt_ms, int pipe, uint32_t rtt_spread_ms, uint32_t packet_interval_us) {
+  std::vector<uint32_t> flow_ids;
+  std::vector<MirrorReport> generated;
+  MirrorReport report;
+
+  auto next = std::chrono::steady_clock::now();
+  while (traffic_running) {
+    int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t now_ms = now_ns / 1000000;
+    // meta.current_time holds bits [35:20] of the ingress timestamp
+    uint16_t current_time = (now_ns >> 20) & 0xFFFF;
+
+    generated.clear();
+    {
+      std::lock_guard<std::mutex> lock(state_mutex);
+
+      const SimTable& table = tables[flow_id_v4];
+      dp_id_t track_flow = table.actions[0].id;
+      flow_ids.clear();
+      for (auto& entry : table.entries) {
+        if (entry.second.action_id == track_flow) {
+          flow_ids.push_back(entry.second.fields[0].value);
+        }
+      }
+      if (flow_ids.empty()) {
+        flow_ids.push_back(0);
+      }
+
+      for (uint32_t flow_id : flow_ids) {
+        // Offset the flows so that they do not all spin in lockstep
+        uint32_t rtt = rtt_ms + flow_id % (rtt_spread_ms + 1);
+        uint8_t spin_bit = ((now_ms + flow_id * 7) / rtt) & 1;
+        if (process(pipe < 0 ? flow_id % config.pipes : pipe, flow_id, spin_bit, current_time, &report)) {
+          generated.push_back(report);
+        }
+      }
+    }
+
+    packets += flow_ids.size();
+    reports += generated.size();
+    if (report_handler) {
+      for (auto& generated_report : generated) {
+        report_handler(generated_report);
+      }
+    }
+
+    next += std::chrono::microseconds(packet_interval_us);
+    std::this_thread::sleep_until(next);
+  }
+}
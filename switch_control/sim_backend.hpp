@@ -0,0 +1,212 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+#include <loguru.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "dataplane_backend.hpp"
+#include "mirror_report.hpp"
+#include "p4_bindings.hpp"
+#include "spintracker_params.hpp"
+
+struct SimConfig {
+  uint32_t pipes = 4;
+  // Cells of the per-flow registers and entries of flow_id_v4
+  uint32_t num_flows = 4096;
+
+  // Emulated access latencies in ns, 0 disables them
+  uint32_t register_read_ns = 0;
+  uint32_t register_write_ns = 0;
+  uint32_t batched_register_write_ns = 0;
+  uint32_t register_sync_ns = 0;
+  uint32_t register_sync_cell_ns = 0;
+  uint32_t batch_read_cell_ns = 0;
+  uint32_t table_op_ns = 0;
+  uint32_t batched_table_op_ns = 0;
+  uint32_t batch_commit_ns = 0;
+
+  // Rough latencies of BfRt on a Tofino, to keep relative costs realistic
+  static SimConfig tofino();
+};
+
+class SimBackend;
+
+class SimSession : public DataplaneSession {
+ private:
+  friend class SimBackend;
+
+  struct PendingOp {
+    enum { ADD, MODIFY, DELETE, REGISTER_WRITE } type;
+    dp_handle_t target;
+    TableKey key;
+    TableData data;
+    uint64_t index;
+    // Register writes cover the cells index .. index + count - 1
+    uint32_t count;
+    uint64_t value;
+  };
+
+  SimBackend* backend;
+  // Held for every operation and from begin to end of a batch or transaction:
+  // like a BfRt session, the session serves one operation at a time
+  std::recursive_mutex operations;
+  bool in_batch;
+  bool in_transaction;
+  uint32_t batched_ops;
+  // Operations of the open transaction, applied together on commit
+  std::vector<PendingOp> pending;
+
+ public:
+  SimSession(SimBackend* backend);
+
+  void beginBatch() override;
+  void endBatch() override;
+  void beginTransaction() override;
+  void commitTransaction() override;
+  void abortTransaction() override;
+  void completeOperations() override;
+};
+
+/*
+  In-memory model of the spintracker program: the Ingress.spinbit registers,
+  rtt_class_table, reorder_protection_selector and flow_id_v4. Packets can be
+  fed through the SpinBit control with processPacket() or generated for all
+  installed flows by the traffic thread. Allows running and benchmarking the
+  control plane without a Tofino or the SDE.
+*/
+class SimBackend : public DataplaneBackend {
+ public:
+  typedef std::function<void(const MirrorReport&)> ReportHandler;
+
+ private:
+  friend class SimSession;
+
+  struct SimRegister {
+    std::string name;
+    uint32_t width;
+    size_t size;
+    // Live and synced state of all pipes, index pipe * size + cell
+    std::vector<uint64_t> live;
+    std::vector<uint64_t> shadow;
+    std::chrono::steady_clock::time_point sync_deadline;
+  };
+
+  struct SimAction {
+    std::string name;
+    dp_id_t id;
+    std::vector<std::string> data_fields;
+  };
+
+  struct SimTable {
+    std::string name;
+    std::vector<std::string> keys;
+    std::vector<SimAction> actions;
+    size_t size;
+    // Key fields in id order, value and range end per field
+    std::map<std::vector<uint64_t>, TableData> entries;
+  };
+
+  SimConfig config;
+  std::mutex state_mutex;
+  std::vector<SimRegister> registers;
+  std::vector<SimTable> tables;
+
+  ReportHandler report_handler;
+  std::thread traffic_thread;
+  std::atomic<bool> traffic_running;
+  std::atomic<uint64_t> packets;
+  std::atomic<uint64_t> reports;
+
+  // Handles of the registers and tables used by processPacket()
+  dp_handle_t spin_delay_tracker, spin_delay_tracker_dup, spin_measurement_counter, first_rtt_protection_reg,
+      spin_phase_tracker, spinbit_threshold_phase_reg, spinbit_threshold_phase_reg_variant2,
+      spin_measurement_storage, rtt_ring_buffer, rtt_ring_buffer_dup, rtt_accumulator, buffer_index,
+      rtt_class_counter;
+  dp_handle_t rtt_class_table, reorder_protection_selector, flow_id_v4;
+
+  dp_handle_t addRegister(const std::string& name, uint32_t width, size_t size);
+  // Declared as in bf-rt.json, with the cells per flow_id_v4 entry of the program for `flows` flows
+  template <typename Binding>
+  dp_handle_t addRegister(uint32_t flows) {
+    static_assert(Binding::SIZE % p4::flow_id_v4_binding::SIZE == 0, "Not a per-flow register");
+    return addRegister(Binding::NAME, Binding::WIDTH, (size_t)flows * (Binding::SIZE / p4::flow_id_v4_binding::SIZE));
+  }
+  dp_handle_t addTable(const std::string& name, std::vector<std::string> keys,
+                       std::vector<std::pair<std::string, std::vector<std::string>>> actions, size_t size);
+  static std::vector<uint64_t> entryKey(const SimTable& table, const TableKey& key);
+  uint64_t& cell(dp_handle_t reg, uint32_t pipe, uint64_t index);
+  uint64_t update(dp_handle_t reg, uint64_t index, uint64_t value);
+
+  void tableOperation(DataplaneSession& session, int type, dp_handle_t table, const TableKey& key, const TableData& data);
+
+  // Require state_mutex
+  void applyTableOp(int type, dp_handle_t table, const TableKey& key, const TableData& data);
+  bool lookupRttClass(uint16_t accumulator, uint16_t rtt, uint8_t* rtt_class);
+  uint8_t reorderSelector();
+  bool process(uint32_t pipe, uint32_t flow_id, uint8_t spin_bit, uint16_t current_time, MirrorReport* report);
+
+  void trafficLoop(uint32_t rtt_ms, int pipe, uint32_t rtt_spread_ms, uint32_t packet_interval_us);
+
+ public:
+  SimBackend(SimConfig config = SimConfig());
+  ~SimBackend();
+
+  static void emulateLatency(uint64_t ns);
+
+  std::shared_ptr<DataplaneSession> createSession() override;
+  uint32_t pipeCount() override;
+
+  dp_handle_t registerOpen(const std::string& name) override;
+  size_t registerSize(dp_handle_t reg) override;
+  uint64_t registerRead(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint32_t pipe) override;
+  void registerWrite(DataplaneSession& session, dp_handle_t reg, uint64_t index, uint64_t value) override;
+  void registerWriteRange(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                          uint64_t value) override;
+  void registerSyncStart(DataplaneSession& session, dp_handle_t reg) override;
+  void registerSyncWait(dp_handle_t reg) override;
+  void registerReserve(dp_handle_t reg, uint32_t count) override;
+  void registerReadBatch(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                         uint32_t pipe, uint64_t* values) override;
+  void registerReadBatchPipes(DataplaneSession& session, dp_handle_t reg, uint64_t first, uint32_t count,
+                              uint32_t pipes, uint64_t* values) override;
+
+  dp_handle_t tableOpen(const std::string& name) override;
+  dp_id_t keyFieldId(dp_handle_t table, const std::string& name) override;
+  dp_id_t actionId(dp_handle_t table, const std::string& name) override;
+  dp_id_t dataFieldId(dp_handle_t table, dp_id_t action, const std::string& name) override;
+  size_t tableSize(dp_handle_t table) override;
+  void tableEntryAdd(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) override;
+  void tableEntryModify(DataplaneSession& session, dp_handle_t table, const TableKey& key, const TableData& data) override;
+  void tableEntryDelete(DataplaneSession& session, dp_handle_t table, const TableKey& key) override;
+
+  void setCpuPort(uint32_t port) override {}
+  void addPort(uint64_t dev_port, uint32_t speed) override {}
+
+  // Runs one packet of `flow_id` through the SpinBit control. Returns true and
+  // fills `report` if the packet produced a measurement (and a mirrored report).
+  bool processPacket(uint32_t pipe, uint32_t flow_id, uint8_t spin_bit, uint16_t current_time, MirrorReport* report = nullptr);
+
+  // Generates spinning traffic for all flows installed in flow_id_v4 (flow 0
+  // if there are none). Flow i spins with an RTT of rtt_ms + i % (rtt_spread_ms + 1)
+  // and enters on `pipe`, or on pipe i % pipes if `pipe` is negative.
+  void setReportHandler(ReportHandler handler);
+  void startTraffic(uint32_t rtt_ms, int pipe = -1, uint32_t rtt_spread_ms = 0, uint32_t packet_interval_us = 100);
+  void stopTraffic();
+  uint64_t packetCount() const { return packets.load(); }
+  uint64_t reportCount() const { return reports.load(); }
+};
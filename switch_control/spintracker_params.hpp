@@ -0,0 +1,30 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+// Program parameters of spintracker.p4 that define the register layouts.
+// Keep in sync with the data plane.
+#define FLOW_ID_BITS 18
+#define MAX_FLOW_IDS (1 << FLOW_ID_BITS)
+
+#define MEASUREMENT_COUNTER_BITS 8
+
+#define AVERAGE_BUFFER_BITS 3
+#define AVERAGE_BUFFER_SIZE 4
+
+#define NUM_RTT_CLASSES 8
+#define RTT_CLASS_BITS 3
+#define RTT_CLASS_COUNTER_BITS 8
+#define RTT_CLASS_TABLE_SIZE 1000
+
+#define SPIN_REORDERING_THRESHOLD 3
+
+// rtt_class_counter is indexed by flow_id << RTT_CLASS_BITS | class
+#define RTT_CLASS_INDEX(flow_id, rtt_class) (((uint64_t)(flow_id) << RTT_CLASS_BITS) | (rtt_class))
@@ -0,0 +1,86 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define CACHE_LINE_SIZE 64
+
+/*
+  Bounded lock-free single-producer/single-consumer ring. The capacity is
+  rounded up to a power of two. Each side caches the other side's index and
+  only reloads it when the ring looks full (producer) or empty (consumer).
+*/
+template <typename T>
+class SpscRing {
+ private:
+  std::vector<T> slots;
+  size_t mask;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;  // next slot to write, owned by the producer
+  size_t cached_tail;
+
+  alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;  // next slot to read, owned by the consumer
+  size_t cached_head;
+
+  static size_t roundUp(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+ public:
+  SpscRing(size_t capacity)
+      : slots(roundUp(capacity)), mask(slots.size() - 1), head(0), cached_tail(0), tail(0), cached_head(0) {}
+
+  // Producer side
+  bool push(const T& item) {
+    size_t current_head = head.load(std::memory_order_relaxed);
+    if (current_head - cached_tail == slots.size()) {
+      cached_tail = tail.load(std::memory_order_acquire);
+      if (current_head - cached_tail == slots.size()) {
+        return false;
+      }
+    }
+    slots[current_head & mask] = item;
+    head.store(current_head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, returns the number of items copied to `items`
+  size_t popBatch(T* items, size_t max_items) {
+    size_t current_tail = tail.load(std::memory_order_relaxed);
+    if (cached_head == current_tail) {
+      cached_head = head.load(std::memory_order_acquire);
+      if (cached_head == current_tail) {
+        return 0;
+      }
+    }
+
+    size_t count = cached_head - current_tail;
+    if (count > max_items) {
+      count = max_items;
+    }
+    for (size_t i = 0; i < count; i++) {
+      items[i] = slots[(current_tail + i) & mask];
+    }
+    tail.store(current_tail + count, std::memory_order_release);
+    return count;
+  }
+
+  // Approximate when called concurrently
+  size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+  size_t capacity() const { return slots.size(); }
+};
@@ -0,0 +1,268 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#include "stats_shm.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "measurement_log.hpp"
+
+static uint64_t alignUp(uint64_t offset) {
+  return (offset + STATS_SHM_ALIGNMENT - 1) & ~(uint64_t)(STATS_SHM_ALIGNMENT - 1);
+}
+
+StatsShmSegment::StatsShmSegment()
+    : fd(-1),
+      map(nullptr),
+      map_size(0),
+      header(nullptr),
+      sequence(nullptr),
+      rtt(nullptr),
+      rtt_accumulator(nullptr),
+      class_id(nullptr),
+      measurement_total(nullptr),
+      class_total(nullptr),
+      updated(nullptr) {}
+
+StatsShmSegment::~StatsShmSegment() {
+  close();
+}
+
+void StatsShmSegment::close() {
+  if (map != nullptr) {
+    munmap(map, map_size);
+    map = nullptr;
+    header = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+void StatsShmSegment::layout(uint32_t capacity, StatsShmHeader* header) {
+  header->header_size = sizeof(StatsShmHeader);
+  header->capacity = capacity;
+  header->num_rtt_classes = NUM_RTT_CLASSES;
+
+  uint64_t offset = alignUp(sizeof(StatsShmHeader));
+  header->sequence_offset = offset;
+  offset = alignUp(offset + (uint64_t)capacity * sizeof(uint32_t));
+  header->rtt_offset = offset;
+  offset = alignUp(offset + (uint64_t)capacity * sizeof(uint16_t));
+  header->rtt_accumulator_offset = offset;
+  offset = alignUp(offset + (uint64_t)capacity * sizeof(uint16_t));
+  header->class_id_offset = offset;
+  offset = alignUp(offset + (uint64_t)capacity * sizeof(uint8_t));
+  header->measurement_total_offset = offset;
+  offset = alignUp(offset + (uint64_t)capacity * sizeof(uint64_t));
+  header->class_total_offset = offset;
+  offset = alignUp(offset + (uint64_t)capacity * NUM_RTT_CLASSES * sizeof(uint64_t));
+  header->updated_offset = offset;
+  header->segment_size = alignUp(offset + (uint64_t)capacity * sizeof(int64_t));
+}
+
+void StatsShmSegment::attachArrays() {
+  header = (StatsShmHeader*)map;
+  sequence = (std::atomic<uint32_t>*)(map + header->sequence_offset);
+  rtt = (std::atomic<uint16_t>*)(map + header->rtt_offset);
+  rtt_accumulator = (std::atomic<uint16_t>*)(map + header->rtt_accumulator_offset);
+  class_id = (std::atomic<uint8_t>*)(map + header->class_id_offset);
+  measurement_total = (std::atomic<uint64_t>*)(map + header->measurement_total_offset);
+  class_total = (std::atomic<uint64_t>*)(map + header->class_total_offset);
+  updated = (std::atomic<int64_t>*)(map + header->updated_offset);
+}
+
+bool StatsShmWriter::create(const std::string& name, uint32_t capacity, std::string* error) {
+  StatsShmHeader layout_header = {};
+  layout(capacity, &layout_header);
+
+  // A fresh segment, readers of a previous instance keep their old mapping
+  shm_unlink(name.c_str());
+  fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return false;
+  }
+  // Pages of flows that are never updated are never allocated
+  if (ftruncate(fd, layout_header.segment_size) != 0) {
+    *error = strerror(errno);
+    close();
+    return false;
+  }
+  map = (uint8_t*)mmap(nullptr, layout_header.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    map = nullptr;
+    *error = strerror(errno);
+    close();
+    return false;
+  }
+  map_size = layout_header.segment_size;
+  this->name = name;
+
+  struct timespec realtime;
+  clock_gettime(CLOCK_REALTIME, &realtime);
+  layout_header.realtime_ns = (int64_t)realtime.tv_sec * 1000000000 + realtime.tv_nsec;
+  layout_header.monotonic_ns = monotonicNanoseconds();
+  layout_header.writer_pid = getpid();
+  layout_header.version = STATS_SHM_VERSION;
+  memcpy(map, &layout_header, offsetof(StatsShmHeader, flow_limit));
+  attachArrays();
+
+  // Readers check the magic first, it marks the header as complete
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = STATS_SHM_MAGIC;
+  return true;
+}
+
+void StatsShmWriter::close() {
+  if (!name.empty()) {
+    shm_unlink(name.c_str());
+    name.clear();
+  }
+  StatsShmSegment::close();
+}
+
+void StatsShmWriter::update(uint32_t flow_id, int64_t timestamp_ns, uint16_t rtt_value, uint16_t rtt_accumulator_value,
+                            uint8_t class_id_value, uint64_t measurement_total_value, const uint64_t* class_totals) {
+  if (flow_id >= header->capacity) {
+    return;
+  }
+
+  uint32_t current = sequence[flow_id].load(std::memory_order_relaxed);
+  sequence[flow_id].store(current + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  rtt[flow_id].store(rtt_value, std::memory_order_relaxed);
+  rtt_accumulator[flow_id].store(rtt_accumulator_value, std::memory_order_relaxed);
+  class_id[flow_id].store(class_id_value, std::memory_order_relaxed);
+  measurement_total[flow_id].store(measurement_total_value, std::memory_order_relaxed);
+  for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    class_total[(size_t)flow_id * NUM_RTT_CLASSES + rtt_class].store(class_totals[rtt_class], std::memory_order_relaxed);
+  }
+  updated[flow_id].store(timestamp_ns, std::memory_order_relaxed);
+
+  sequence[flow_id].store(current + 2, std::memory_order_release);
+
+  if (flow_id >= header->flow_limit.load(std::memory_order_relaxed)) {
+    header->flow_limit.store(flow_id + 1, std::memory_order_release);
+  }
+  header->updates.store(header->updates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void StatsShmWriter::remove(uint32_t flow_id) {
+  if (flow_id >= header->capacity) {
+    return;
+  }
+
+  uint32_t current = sequence[flow_id].load(std::memory_order_relaxed);
+  sequence[flow_id].store(current + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  rtt[flow_id].store(0, std::memory_order_relaxed);
+  rtt_accumulator[flow_id].store(0, std::memory_order_relaxed);
+  class_id[flow_id].store(0, std::memory_order_relaxed);
+  measurement_total[flow_id].store(0, std::memory_order_relaxed);
+  for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    class_total[(size_t)flow_id * NUM_RTT_CLASSES + rtt_class].store(0, std::memory_order_relaxed);
+  }
+  updated[flow_id].store(0, std::memory_order_relaxed);
+
+  sequence[flow_id].store(current + 2, std::memory_order_release);
+  header->updates.store(header->updates.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void StatsShmWriter::commit(int64_t timestamp_ns) {
+  header->commit_ns.store(timestamp_ns, std::memory_order_release);
+}
+
+bool StatsShmReader::open(const std::string& name, std::string* error) {
+  fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    *error = strerror(errno);
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(StatsShmHeader)) {
+    *error = "segment too small";
+    close();
+    return false;
+  }
+  map_size = info.st_size;
+  map = (uint8_t*)mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    map = nullptr;
+    *error = strerror(errno);
+    close();
+    return false;
+  }
+
+  const StatsShmHeader* mapped = (const StatsShmHeader*)map;
+  if (mapped->magic != STATS_SHM_MAGIC) {
+    *error = "not a stats segment";
+    close();
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (mapped->version != STATS_SHM_VERSION) {
+    *error = "unsupported version " + std::to_string(mapped->version);
+    close();
+    return false;
+  }
+
+  // The layout is recomputed, a writer with different parameters is rejected
+  StatsShmHeader expected = {};
+  layout(mapped->capacity, &expected);
+  if (mapped->num_rtt_classes != NUM_RTT_CLASSES || mapped->header_size != expected.header_size ||
+      mapped->segment_size != expected.segment_size || mapped->segment_size > map_size ||
+      mapped->updated_offset != expected.updated_offset) {
+    *error = "incompatible layout";
+    close();
+    return false;
+  }
+  attachArrays();
+  return true;
+}
+
+bool StatsShmReader::read(uint32_t flow_id, StatsShmFlow* flow, int retries) const {
+  if (flow_id >= header->capacity) {
+    return false;
+  }
+
+  for (int attempt = 0; attempt < retries; attempt++) {
+    uint32_t before = sequence[flow_id].load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+
+    flow->flow_id = flow_id;
+    flow->rtt = rtt[flow_id].load(std::memory_order_relaxed);
+    flow->rtt_accumulator = rtt_accumulator[flow_id].load(std::memory_order_relaxed);
+    flow->class_id = class_id[flow_id].load(std::memory_order_relaxed);
+    flow->measurement_total = measurement_total[flow_id].load(std::memory_order_relaxed);
+    for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+      flow->class_total[rtt_class] = class_total[(size_t)flow_id * NUM_RTT_CLASSES + rtt_class].load(std::memory_order_relaxed);
+    }
+    flow->updated_ns = updated[flow_id].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence[flow_id].load(std::memory_order_relaxed) == before) {
+      return flow->updated_ns != 0;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,141 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "spintracker_params.hpp"
+
+/*
+  Latest state of every flow in a POSIX shared-memory segment. The control
+  process is the only writer; any number of local readers map the segment
+  read-only and take consistent per-flow snapshots without syscalls.
+
+  Layout: a header followed by one array per field (struct of arrays), each
+  starting on its own cache line and indexed by flow id. Every flow has a
+  sequence counter that is odd while the writer updates the flow; a reader
+  retries when the counter is odd or changed during its copy.
+*/
+#define STATS_SHM_MAGIC 0x5350494e53544154ULL  // "SPINSTAT"
+#define STATS_SHM_VERSION 1
+#define STATS_SHM_ALIGNMENT 64
+
+struct StatsShmHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t segment_size;
+  // Flow ids 0 .. capacity - 1
+  uint32_t capacity;
+  uint32_t num_rtt_classes;
+  // Byte offsets of the arrays from the start of the segment
+  uint64_t sequence_offset;
+  uint64_t rtt_offset;
+  uint64_t rtt_accumulator_offset;
+  uint64_t class_id_offset;
+  uint64_t measurement_total_offset;
+  uint64_t class_total_offset;
+  uint64_t updated_offset;
+  // Wall clock (CLOCK_REALTIME) at `monotonic_ns`, for converting the update times
+  int64_t realtime_ns;
+  int64_t monotonic_ns;
+  int32_t writer_pid;
+  uint32_t padding;
+
+  alignas(STATS_SHM_ALIGNMENT) std::atomic<uint32_t> flow_limit;  // highest updated flow id + 1
+  std::atomic<uint64_t> updates;
+  std::atomic<int64_t> commit_ns;  // end of the last readout cycle or report batch
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint16_t>::is_always_lock_free &&
+                  std::atomic<uint8_t>::is_always_lock_free,
+              "Atomics in shared memory have to be lock-free");
+
+// One consistent copy of a flow
+struct StatsShmFlow {
+  uint32_t flow_id;
+  uint16_t rtt;
+  uint16_t rtt_accumulator;
+  // Class of the latest report, 0 when polling the registers
+  uint8_t class_id;
+  uint64_t measurement_total;
+  uint64_t class_total[NUM_RTT_CLASSES];
+  // CLOCK_MONOTONIC nanoseconds, 0 if the flow was never updated
+  int64_t updated_ns;
+};
+
+// Mapped segment and the typed array pointers, shared by writer and reader
+class StatsShmSegment {
+ protected:
+  int fd;
+  uint8_t* map;
+  size_t map_size;
+
+  StatsShmHeader* header;
+  std::atomic<uint32_t>* sequence;
+  std::atomic<uint16_t>* rtt;
+  std::atomic<uint16_t>* rtt_accumulator;
+  std::atomic<uint8_t>* class_id;
+  std::atomic<uint64_t>* measurement_total;
+  std::atomic<uint64_t>* class_total;  // capacity x NUM_RTT_CLASSES
+  std::atomic<int64_t>* updated;
+
+  void attachArrays();
+
+ public:
+  StatsShmSegment();
+  virtual ~StatsShmSegment();
+  StatsShmSegment(const StatsShmSegment&) = delete;
+  StatsShmSegment& operator=(const StatsShmSegment&) = delete;
+
+  bool isOpen() const { return map != nullptr; }
+  virtual void close();
+
+  uint32_t capacity() const { return header->capacity; }
+  // Fills the layout of a segment for `capacity` flows into `header`
+  static void layout(uint32_t capacity, StatsShmHeader* header);
+};
+
+class StatsShmWriter : public StatsShmSegment {
+ private:
+  std::string name;
+
+ public:
+  // Creates (or replaces) the segment `name`, e.g., "/spintracker"
+  bool create(const std::string& name, uint32_t capacity, std::string* error);
+  // Unlinks the segment, mapped readers keep their view
+  void close() override;
+
+  // Single writer only. Flow ids beyond the capacity are ignored.
+  void update(uint32_t flow_id, int64_t timestamp_ns, uint16_t rtt, uint16_t rtt_accumulator, uint8_t class_id,
+              uint64_t measurement_total, const uint64_t* class_totals);
+  // Clears the flow, readers see it as never updated
+  void remove(uint32_t flow_id);
+  void commit(int64_t timestamp_ns);
+};
+
+class StatsShmReader : public StatsShmSegment {
+ public:
+  // Maps the segment read-only, returns false and sets `error` for missing or incompatible segments
+  bool open(const std::string& name, std::string* error);
+
+  // Copies the flow, returns false for flows that were never updated or removed, or when
+  // the writer kept the flow busy for all retries
+  bool read(uint32_t flow_id, StatsShmFlow* flow, int retries = 1000) const;
+
+  uint32_t flowLimit() const { return header->flow_limit.load(std::memory_order_acquire); }
+  uint64_t updates() const { return header->updates.load(std::memory_order_relaxed); }
+  int64_t commitTime() const { return header->commit_ns.load(std::memory_order_acquire); }
+  int32_t writerPid() const { return header->writer_pid; }
+  int64_t toRealtime(int64_t monotonic_ns) const { return monotonic_ns - header->monotonic_ns + header->realtime_ns; }
+};
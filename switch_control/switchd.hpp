@@ -31,6 +31,7 @@ class Switchd {
 
   bf_rt_target_t device_target;
   const bfrt::BfRtInfo* bfrtInfo;
+  // Only for setup queries; readout and programming have their own, see DataplaneSessions
   std::shared_ptr<bfrt::BfRtSession> session;
 
   const char* p4_name;
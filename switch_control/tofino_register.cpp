@@ -9,74 +9,85 @@
 
 #include "tofino_register.hpp"
 
-#include <vector>
+#include "instrumentation.hpp"
 
-TofinoRegister::TofinoRegister(std::string register_name, Switchd* switchd) {
-  this->switchd = switchd;
+TofinoRegister::TofinoRegister(std::string register_name, DataplaneBackend* backend, DataplaneSession* session) {
+  this->backend = backend;
+  this->session = session;
 
-  char data_field[128];
-  snprintf(data_field, 128, "%s.f1", register_name.c_str());
-
-  bf_status_t bf_status;
-
-  bf_status =
-      switchd->bfrtInfo->bfrtTableFromNameGet(register_name.c_str(), &table);
-  assert(bf_status == BF_SUCCESS);
+  handle = backend->registerOpen(register_name);
+  register_size = backend->registerSize(handle);
+  pipes = backend->pipeCount();
+}
 
-  bf_status = table->keyFieldIdGet("$REGISTER_INDEX", &reg_index_key_id);
-  assert(bf_status == BF_SUCCESS);
+TofinoRegister::TofinoRegister(dp_handle_t handle, DataplaneBackend* backend, DataplaneSession* session) {
+  this->backend = backend;
+  this->session = session;
+  this->handle = handle;
 
-  bf_status = table->dataFieldIdGet(data_field, &data_id);
-  assert(bf_status == BF_SUCCESS);
+  register_size = backend->registerSize(handle);
+  pipes = backend->pipeCount();
 }
 
 uint64_t TofinoRegister::read(uint64_t key, uint64_t pipe_id) {
-  bf_status_t bf_status;
-
-  auto flag = bfrt::BfRtTable::BfRtTableGetFlag::GET_FROM_HW;
-
-  std::unique_ptr<BfRtTableKey> table_key;
-  std::unique_ptr<BfRtTableData> table_data;
-
-  bf_status = table->keyAllocate(&table_key);
-  assert(bf_status == BF_SUCCESS);
+  PROBE_SCOPE_ARG(PROBE_REGISTER_READ, handle);
+  return backend->registerRead(*session, handle, key, pipe_id);
+}
 
-  bf_status = table->dataAllocate(&table_data);
-  assert(bf_status == BF_SUCCESS);
+void TofinoRegister::write(uint64_t key, uint64_t value) {
+  PROBE_SCOPE_ARG(PROBE_REGISTER_WRITE, handle);
+  backend->registerWrite(*session, handle, key, value);
+}
 
-  bf_status = table_key->setValue(reg_index_key_id, key);
-  assert(bf_status == BF_SUCCESS);
+void TofinoRegister::reserveSnapshot(uint32_t count) {
+  backend->registerReserve(handle, count);
+}
 
-  bf_status = table->tableEntryGet(*switchd->session, switchd->device_target,
-                                   *table_key.get(), flag, table_data.get());
-  assert(bf_status == BF_SUCCESS);
+void TofinoRegister::startSync() {
+  PROBE_SCOPE_ARG(PROBE_REGISTER_SYNC_START, handle);
+  backend->registerSyncStart(*session, handle);
+}
 
-  std::vector<uint64_t> values;
-  bf_status = table_data.get()->getValue(data_id, &values);
-  assert(bf_status == BF_SUCCESS);
+void TofinoRegister::waitSync() {
+  PROBE_SCOPE_ARG(PROBE_REGISTER_SYNC_WAIT, handle);
+  backend->registerSyncWait(handle);
+}
 
-  return values.at(pipe_id);
+void TofinoRegister::syncFromHardware() {
+  startSync();
+  waitSync();
 }
 
-void TofinoRegister::write(uint64_t key, uint64_t value) {
-  bf_status_t bf_status;
+void TofinoRegister::snapshot(uint64_t first, uint32_t count, uint64_t pipe_id, uint64_t* values, bool sync) {
+  if (count == 0) {
+    return;
+  }
+  CHECK_F(first + count <= register_size, "Snapshot [%lu, %lu) exceeds register size %zu",
+          first, first + count, register_size);
 
-  std::unique_ptr<BfRtTableKey> table_key;
-  std::unique_ptr<BfRtTableData> table_data;
+  if (sync) {
+    syncFromHardware();
+  }
 
-  bf_status = table->keyAllocate(&table_key);
-  assert(bf_status == BF_SUCCESS);
+  PROBE_SCOPE_ARG(PROBE_REGISTER_GET, handle);
+  backend->registerReadBatch(*session, handle, first, count, pipe_id, values);
+}
 
-  bf_status = table->dataAllocate(&table_data);
-  assert(bf_status == BF_SUCCESS);
+void TofinoRegister::snapshot(uint64_t pipe_id, uint64_t* values, bool sync) {
+  snapshot(0, register_size, pipe_id, values, sync);
+}
 
-  bf_status = table_key->setValue(reg_index_key_id, key);
-  assert(bf_status == BF_SUCCESS);
+void TofinoRegister::snapshotPipes(uint64_t first, uint32_t count, uint64_t* values, bool sync) {
+  if (count == 0) {
+    return;
+  }
+  CHECK_F(first + count <= register_size, "Snapshot [%lu, %lu) exceeds register size %zu",
+          first, first + count, register_size);
 
-  bf_status = table_data->setValue(data_id, value);
-  assert(bf_status == BF_SUCCESS);
+  if (sync) {
+    syncFromHardware();
+  }
 
-  bf_status = table->tableEntryAdd(*switchd->session, switchd->device_target,
-                                   *table_key.get(), *table_data.get());
-  assert(bf_status == BF_SUCCESS);
-}
\ No newline at end of file
+  PROBE_SCOPE_ARG(PROBE_REGISTER_GET, handle);
+  backend->registerReadBatchPipes(*session, handle, first, count, pipes, values);
+}
@@ -10,18 +10,48 @@
 #pragma once
 #include <loguru.hpp>
 
-#include "switchd.hpp"
+#include <string>
 
+#include "dataplane_backend.hpp"
+
+/*
+  Readout access to one register on the readout session. Not synchronized:
+  a register and its session belong to the readout thread, other threads
+  write the cells through TofinoTables.
+*/
 class TofinoRegister {
  private:
-  Switchd* switchd;
-  const BfRtTable* table;
-
-  bf_rt_id_t reg_index_key_id;
-  bf_rt_id_t data_id;
+  DataplaneBackend* backend;
+  DataplaneSession* session;
+  dp_handle_t handle;
+  size_t register_size;
+  uint32_t pipes;
 
  public:
-  TofinoRegister(std::string register_name, Switchd* switchd);
+  TofinoRegister(std::string register_name, DataplaneBackend* backend, DataplaneSession* session);
+  // For a register already resolved through the generated bindings
+  TofinoRegister(dp_handle_t handle, DataplaneBackend* backend, DataplaneSession* session);
   uint64_t read(uint64_t index, uint64_t pipe_id);
   void write(uint64_t index, uint64_t value);
-};
\ No newline at end of file
+
+  // Number of register cells (per pipe)
+  size_t size() const { return register_size; }
+  uint32_t pipeCount() const { return pipes; }
+
+  // Preallocate the key/data objects for snapshots of up to `count` cells.
+  void reserveSnapshot(uint32_t count);
+
+  // Copy the register contents of all pipes from hardware to the software shadow.
+  // startSync/waitSync allow overlapping the syncs of several registers.
+  void startSync();
+  void waitSync();
+  void syncFromHardware();
+
+  // Read `count` cells starting at `first` into `values` with one hardware sync
+  // and one multi-entry get. Does not allocate once enough capacity is reserved.
+  void snapshot(uint64_t first, uint32_t count, uint64_t pipe_id, uint64_t* values, bool sync = true);
+  void snapshot(uint64_t pipe_id, uint64_t* values, bool sync = true);
+  // The same get for all pipes, the cells of a pipe follow each other:
+  // values[pipe * count + i], pipeCount() * count values
+  void snapshotPipes(uint64_t first, uint32_t count, uint64_t* values, bool sync = true);
+};
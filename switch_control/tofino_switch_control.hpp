@@ -8,27 +8,25 @@
 */
 
 #pragma once
-#include <bf_switchd/bf_switchd.h>
 #include <loguru.hpp>
 
-#include <pipe_mgr/pipe_mgr_mirror_intf.h>
-
-
-extern "C" {
-#include <traffic_mgr/traffic_mgr.h>
-#include <bf_pm/bf_pm_intf.h>
-}
-
-#include "switchd.hpp"
+#include "dataplane_backend.hpp"
+#include "dataplane_sessions.hpp"
+#include "p4_bindings.hpp"
 #include "tofino_register.hpp"
 #include "tofino_tables.hpp"
 #include <pthread.h>
 
 class TofinoSwitchControl {
  public:
-  Switchd* switchd;
+  DataplaneBackend* backend;
+  // The registers use the readout session, the tables the programming session
+  DataplaneSessions sessions;
   pthread_t readDataplane_thread;
 
+  // Tables and registers of the compiled program, see tools/gen_p4_bindings.py
+  p4::Program p4;
+
   // Dataplane Constructs
   TofinoRegister* spin_measurement_register;
   TofinoRegister* spin_measurement_counter_register;
@@ -42,15 +40,19 @@ class TofinoSwitchControl {
 	bool spinbit_enabled;
   int spinbit_reorderingprotection;
 
-  TofinoSwitchControl(std::string file_path, bool spinbit_enabled, int spinbit_reorderingprotection);
+  // `shared_session` puts readout and programming on one session, see DataplaneSessions
+  TofinoSwitchControl(DataplaneBackend* backend, std::string file_path, bool spinbit_enabled, int spinbit_reorderingprotection, bool shared_session = false);
 
   void initializeTables();
   void initializeDataplaneInterfaces();
   void setupDataplane();
-  void setupPort(uint64_t num, bf_port_speed_t speed);
+  void setupPort(uint64_t num, uint32_t speed);
   void sessionCompleteOperations();
 
   void setSpinReorderProtection();
+  // Switches the variant of a running tracker, see setSpinReorderProtection()
+  void setSpinReorderProtection(int spinbit_reorderingprotection);
   void RTTClassTableSetEntry(uint16_t accumulator_min, uint16_t accumulator_max, uint16_t rtt_min, uint16_t rtt_max, uint8_t rtt_class);
+  rtt_class_plan_diff applyRTTClassPlan(const std::vector<rtt_class_range>& plan);
 
 };
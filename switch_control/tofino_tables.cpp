@@ -8,128 +8,322 @@
 */
 
 #include "tofino_tables.hpp"
+#include "instrumentation.hpp"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 
-TofinoTables::TofinoTables(Switchd* switchd) {
-  this->switchd = switchd;
+// The control plane parameters have to match the compiled program
+static_assert(p4::rtt_class_table_binding::SIZE == RTT_CLASS_TABLE_SIZE, "RTT_CLASS_TABLE_SIZE differs from bf-rt.json");
+static_assert(p4::rtt_class_table_binding::SET_RTT_CLASS_CLASS_WIDTH == RTT_CLASS_BITS, "RTT_CLASS_BITS differs from bf-rt.json");
+static_assert(p4::flow_id_v4_binding::TRACK_FLOW_FLOW_ID_WIDTH == FLOW_ID_BITS, "FLOW_ID_BITS differs from bf-rt.json");
+
+TofinoTables::TofinoTables(DataplaneBackend* backend, DataplaneSession* session, p4::Program* p4) {
+  this->backend = backend;
+  this->session = session;
+  this->p4 = p4;
+  this->installed_reorder_protection = 0;
   initializeTables();
 }
 
 void TofinoTables::initializeTables() {
+  p4->rtt_class_table.resolve(backend);
+  p4->flow_id_v4.resolve(backend);
+  p4->reorder_protection_selector.resolve(backend);
+
+  // Per-flow registers, read by the readout and cleared by recycleFlows()
+  p4->spin_delay_tracker.resolve(backend);
+  p4->spin_delay_tracker_dup.resolve(backend);
+  p4->spin_measurement_counter.resolve(backend);
+  p4->first_rtt_protection_reg.resolve(backend);
+  p4->spin_phase_tracker.resolve(backend);
+  p4->spin_measurement_storage.resolve(backend);
+  p4->rtt_ring_buffer.resolve(backend);
+  p4->rtt_ring_buffer_dup.resolve(backend);
+  p4->rtt_accumulator.resolve(backend);
+  p4->buffer_index.resolve(backend);
+  p4->rtt_class_counter.resolve(backend);
+
+  // The program indexes the ring buffers by id << AVERAGE_BUFFER_BITS but declares
+  // only AVERAGE_BUFFER_SIZE cells per flow, so the slots of the upper ids do not exist
+  ring_buffer_size = backend->registerSize(p4->rtt_ring_buffer.handle);
+  uint64_t flow_ids = std::min<uint64_t>(flowTableSize(), 1 << (FLOW_ID_BITS - 1));
+  uint64_t ring_flows =
+      ring_buffer_size < AVERAGE_BUFFER_SIZE ? 0 : ((ring_buffer_size - AVERAGE_BUFFER_SIZE) >> AVERAGE_BUFFER_BITS) + 1;
+  static std::atomic<bool> layout_logged(false);
+  if (ring_flows < flow_ids && !layout_logged.exchange(true)) {
+    LOG_F(WARNING, "rtt_ring_buffer holds %lu cells, but flow ids from %lu on index beyond it (id << %d); "
+          "their ring buffer slots are not cleared on recycling", ring_buffer_size, ring_flows, AVERAGE_BUFFER_BITS);
+  }
+}
 
-  tables["Ingress.spinbit.rtt_class_table"] = table_def{};
-  tables["Ingress.spinbit.rtt_class_table"].keys["meta.rtt_accumulator_value"] = 0;
-  tables["Ingress.spinbit.rtt_class_table"].keys["meta.current_rtt"] = 0;
-  tables["Ingress.spinbit.rtt_class_table"].actions["Ingress.spinbit.set_rtt_class"] = action_def({{"class", 0},});
-  tables["Ingress.spinbit.rtt_class_table"].actions["NoAction"] = action_def();
 
+void TofinoTables::enableQBitReorderProtection(){
+  setReorderProtection(1);
+}
 
-  tables["Ingress.spinbit.reorder_protection_selector"] = table_def{};
-  tables["Ingress.spinbit.reorder_protection_selector"].keys["hdr.quic_short.quic_bit"] = 0;
-  tables["Ingress.spinbit.reorder_protection_selector"].actions["Ingress.spinbit.select_spinbit"] = action_def();
-  tables["Ingress.spinbit.reorder_protection_selector"].actions["Ingress.spinbit.select_qbit_reorder"] = action_def();
-  tables["Ingress.spinbit.reorder_protection_selector"].actions["Ingress.spinbit.select_consec_reorder"] = action_def();
+void TofinoTables::enableConsecReorderProtection(){
+  setReorderProtection(2);
+}
 
+void TofinoTables::setReorderProtection(int variant){
+  PROBE_SCOPE_ARG(PROBE_TABLE_REORDER_PROTECTION, variant);
+  if (variant != 1 && variant != 2){
+    variant = 0;
+  }
 
-  for (auto& table : tables) {
-    auto bf_status = switchd->bfrtInfo->bfrtTableFromNameGet(table.first, &table.second.table);
-    assert(bf_status == BF_SUCCESS);
+  std::lock_guard<std::mutex> lock(programming_mutex);
+  if (variant == installed_reorder_protection){
+    return;
+  }
 
-    bf_status = table.second.table->keyAllocate(&table.second.key_ref);
-    assert(bf_status == BF_SUCCESS);
+  auto& table = p4->reorder_protection_selector;
 
-    for (auto& key : table.second.keys) {
-      bf_status = table.second.table->keyFieldIdGet(key.first, &key.second);
-      assert(bf_status == BF_SUCCESS);
-    }
+  TableKey key;
+  key.setExact(table.keys.quic_bit, 1);
 
-    for (auto& action : table.second.actions) {
-      bf_status = table.second.table->actionIdGet(action.first, &action.second.id);
-      assert(bf_status == BF_SUCCESS);
+  // Without an entry, the default action select_spinbit applies
+  if (variant == 0){
+    backend->tableEntryDelete(*session, table.handle, key);
+    installed_reorder_protection = 0;
+    return;
+  }
 
-      bf_status = table.second.table->dataAllocate(action.second.id, &action.second.data_ref);
-      assert(bf_status == BF_SUCCESS);
+  TableData data;
+  data.setAction(variant == 1 ? table.actions.select_qbit_reorder.id : table.actions.select_consec_reorder.id);
 
-      for (auto& field : action.second.data_fields) {
-        bf_status = table.second.table->dataFieldIdGet(field.first, action.second.id, &field.second);
-        assert(bf_status == BF_SUCCESS);
-      }
-    }
+  if (installed_reorder_protection == 0){
+    backend->tableEntryAdd(*session, table.handle, key, data);
+  } else{
+    backend->tableEntryModify(*session, table.handle, key, data);
   }
+  installed_reorder_protection = variant;
 }
 
+int TofinoTables::reorderProtection(){
+  std::lock_guard<std::mutex> lock(programming_mutex);
+  return installed_reorder_protection;
+}
 
-void TofinoTables::enableQBitReorderProtection(){
-  auto& table_ref = tables["Ingress.spinbit.reorder_protection_selector"];
 
-  key_list_entry result;
+void TofinoTables::RTTClassTableKey(const rtt_class_range& range, TableKey* key){
+  auto& table = p4->rtt_class_table;
 
-  auto bf_status = table_ref.table->keyReset(table_ref.key_ref.get());
-  table_ref.table->keyAllocate(&result.key);
-  auto& action_ref = table_ref.actions["Ingress.spinbit.select_qbit_reorder"];
+  key->clear();
+  key->setRange(table.keys.rtt_accumulator_value, range.accumulator_min, range.accumulator_max);
+  key->setRange(table.keys.current_rtt, range.rtt_min, range.rtt_max);
+}
 
-  bf_status = table_ref.table->keyReset(table_ref.key_ref.get());
-  assert(bf_status == BF_SUCCESS);
+void TofinoTables::RTTClassTableData(const rtt_class_range& range, TableData* data){
+  auto& action = p4->rtt_class_table.actions.set_rtt_class;
 
-  table_ref.table->keyAllocate(&result.key);
+  data->setAction(action.id);
+  data->set(action.class_, (uint64_t) range.rtt_class);
+}
 
-  bf_status = result.key->setValue(table_ref.keys["hdr.quic_short.quic_bit"], 1);
-  assert(bf_status == BF_SUCCESS);
+void TofinoTables::RTTClassTableSetEntry(uint16_t accumulator_min, uint16_t accumulator_max, uint16_t rtt_min, uint16_t rtt_max, uint8_t rtt_class){
+  PROBE_SCOPE(PROBE_TABLE_RTT_CLASS_ENTRY);
+  rtt_class_range range{accumulator_min, accumulator_max, rtt_min, rtt_max, rtt_class};
+  std::lock_guard<std::mutex> lock(programming_mutex);
 
-  bf_status = table_ref.table->dataReset(action_ref.id, action_ref.data_ref.get());
-  assert(bf_status == BF_SUCCESS);
+  TableKey key;
+  TableData data;
+  RTTClassTableKey(range, &key);
+  RTTClassTableData(range, &data);
 
-  bf_status = table_ref.table->tableEntryAdd(*switchd->session, switchd->device_target, *result.key, *action_ref.data_ref);
-  assert(bf_status == BF_SUCCESS);
+  backend->tableEntryAdd(*session, p4->rtt_class_table.handle, key, data);
+  installed_rtt_classes[range.key()] = range;
 }
 
-void TofinoTables::enableConsecReorderProtection(){
-  auto& table_ref = tables["Ingress.spinbit.reorder_protection_selector"];
+rtt_class_plan_diff TofinoTables::applyRTTClassPlan(const std::vector<rtt_class_range>& plan){
+  PROBE_SCOPE_ARG(PROBE_TABLE_RTT_CLASS_PLAN, plan.size());
+  dp_handle_t handle = p4->rtt_class_table.handle;
+  rtt_class_plan_diff diff = {0, 0, 0, 0};
+  std::lock_guard<std::mutex> lock(programming_mutex);
 
-  key_list_entry result;
+  std::map<uint64_t, rtt_class_range> target;
+  for (auto& range : plan){
+    target[range.key()] = range;
+  }
 
-  auto bf_status = table_ref.table->keyReset(table_ref.key_ref.get());
-  table_ref.table->keyAllocate(&result.key);
-  auto& action_ref = table_ref.actions["Ingress.spinbit.select_consec_reorder"];
+  TableKey key;
+  TableData data;
 
-  bf_status = table_ref.table->keyReset(table_ref.key_ref.get());
-  assert(bf_status == BF_SUCCESS);
+  // Within the transaction, the data plane sees either the old or the new plan.
+  // Deletes go first so that the table never has to hold both plans at once.
+  session->beginTransaction();
 
-  table_ref.table->keyAllocate(&result.key);
+  for (auto& installed : installed_rtt_classes){
+    if (target.find(installed.first) == target.end()){
+      RTTClassTableKey(installed.second, &key);
+      backend->tableEntryDelete(*session, handle, key);
+      diff.deleted++;
+    }
+  }
 
-  bf_status = result.key->setValue(table_ref.keys["hdr.quic_short.quic_bit"], 1);
-  assert(bf_status == BF_SUCCESS);
+  for (auto& range : target){
+    auto installed = installed_rtt_classes.find(range.first);
+    if (installed == installed_rtt_classes.end()){
+      RTTClassTableKey(range.second, &key);
+      RTTClassTableData(range.second, &data);
+      backend->tableEntryAdd(*session, handle, key, data);
+      diff.added++;
+    } else if (installed->second.rtt_class != range.second.rtt_class){
+      RTTClassTableKey(range.second, &key);
+      RTTClassTableData(range.second, &data);
+      backend->tableEntryModify(*session, handle, key, data);
+      diff.modified++;
+    } else{
+      diff.unchanged++;
+    }
+  }
 
-  bf_status = table_ref.table->dataReset(action_ref.id, action_ref.data_ref.get());
-  assert(bf_status == BF_SUCCESS);
+  session->commitTransaction();
+  installed_rtt_classes = std::move(target);
+  return diff;
+}
 
-  bf_status = table_ref.table->tableEntryAdd(*switchd->session, switchd->device_target, *result.key, *action_ref.data_ref);
-  assert(bf_status == BF_SUCCESS);
+std::vector<rtt_class_range> TofinoTables::installedRTTClassPlan(){
+  std::lock_guard<std::mutex> lock(programming_mutex);
+  std::vector<rtt_class_range> plan;
+  for (auto& installed : installed_rtt_classes){
+    plan.push_back(installed.second);
+  }
+  return plan;
 }
 
+void TofinoTables::flowTableAddEntries(const flow_entry* entries, size_t count){
+  PROBE_SCOPE_ARG(PROBE_TABLE_FLOW_ADD, count);
+  auto& table = p4->flow_id_v4;
 
-void TofinoTables::RTTClassTableSetEntry(uint16_t accumulator_min, uint16_t accumulator_max, uint16_t rtt_min, uint16_t rtt_max, uint8_t rtt_class){
+  // Key and data live on the stack, building entries does not allocate
+  TableKey key;
+  TableData data;
+
+  std::lock_guard<std::mutex> lock(programming_mutex);
+  session->beginBatch();
+
+  for (size_t i = 0; i < count; i++){
+    const FlowTuple& tuple = entries[i].tuple;
 
-  auto& table_ref = tables["Ingress.spinbit.rtt_class_table"];
-  key_list_entry result;
+    key.clear();
+    key.setExact(table.keys.src_addr, (uint64_t) tuple.src_addr);
+    key.setExact(table.keys.dst_addr, (uint64_t) tuple.dst_addr);
+    key.setExact(table.keys.src_port, (uint64_t) tuple.src_port);
+    key.setExact(table.keys.dst_port, (uint64_t) tuple.dst_port);
 
-  auto bf_status = table_ref.table->keyReset(table_ref.key_ref.get());
-  assert(bf_status == BF_SUCCESS);
+    data.setAction(table.actions.track_flow.id);
+    data.set(table.actions.track_flow.flow_id, (uint64_t) entries[i].flow_id);
 
-  table_ref.table->keyAllocate(&result.key);
-  bf_status = result.key->setValueRange(table_ref.keys["meta.rtt_accumulator_value"], accumulator_min, accumulator_max);
-  assert(bf_status == BF_SUCCESS);
+    backend->tableEntryAdd(*session, table.handle, key, data);
+  }
+
+  session->endBatch();
+}
+
+void TofinoTables::flowTableDeleteEntries(const FlowTuple* tuples, size_t count){
+  PROBE_SCOPE_ARG(PROBE_TABLE_FLOW_DELETE, count);
+  auto& table = p4->flow_id_v4;
 
-  bf_status = result.key->setValueRange(table_ref.keys["meta.current_rtt"], rtt_min, rtt_max);
-  assert(bf_status == BF_SUCCESS);
+  TableKey key;
 
-  auto& action_ref = table_ref.actions["Ingress.spinbit.set_rtt_class"];
-  bf_status = table_ref.table->dataReset(action_ref.id, action_ref.data_ref.get());
-  assert(bf_status == BF_SUCCESS);
+  std::lock_guard<std::mutex> lock(programming_mutex);
+  session->beginBatch();
 
-  bf_status = action_ref.data_ref->setValue(action_ref.data_fields["class"], (uint64_t) rtt_class);
-  assert(bf_status == BF_SUCCESS);
+  for (size_t i = 0; i < count; i++){
+    key.clear();
+    key.setExact(table.keys.src_addr, (uint64_t) tuples[i].src_addr);
+    key.setExact(table.keys.dst_addr, (uint64_t) tuples[i].dst_addr);
+    key.setExact(table.keys.src_port, (uint64_t) tuples[i].src_port);
+    key.setExact(table.keys.dst_port, (uint64_t) tuples[i].dst_port);
+
+    backend->tableEntryDelete(*session, table.handle, key);
+  }
+
+  session->endBatch();
+}
 
-  bf_status = table_ref.table->tableEntryAdd(*switchd->session, switchd->device_target, *result.key, *action_ref.data_ref);
-  assert(bf_status == BF_SUCCESS);
-}
\ No newline at end of file
+size_t TofinoTables::flowTableSize(){
+  return backend->tableSize(p4->flow_id_v4.handle);
+}
+
+void TofinoTables::recycleFlows(const uint32_t* flow_ids, size_t count){
+  PROBE_SCOPE_ARG(PROBE_TABLE_RECYCLE_FLOWS, count);
+  if (count == 0){
+    return;
+  }
+  std::vector<uint32_t> ids(flow_ids, flow_ids + count);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  const dp_handle_t flow_registers[] = {
+      p4->spin_delay_tracker.handle, p4->spin_delay_tracker_dup.handle, p4->spin_measurement_counter.handle,
+      p4->first_rtt_protection_reg.handle, p4->spin_phase_tracker.handle, p4->spin_measurement_storage.handle,
+      p4->rtt_accumulator.handle, p4->buffer_index.handle};
+
+  std::lock_guard<std::mutex> lock(programming_mutex);
+  session->beginTransaction();
+
+  size_t run_start = 0;
+  while (run_start < ids.size()){
+    // Runs of consecutive ids cover consecutive cells
+    size_t run_end = run_start + 1;
+    while (run_end < ids.size() && ids[run_end] == ids[run_end - 1] + 1){
+      run_end++;
+    }
+    uint32_t first = ids[run_start];
+    uint32_t run_length = run_end - run_start;
+
+    for (dp_handle_t reg : flow_registers){
+      backend->registerWriteRange(*session, reg, first, run_length, 0);
+    }
+    backend->registerWriteRange(*session, p4->rtt_class_counter.handle, RTT_CLASS_INDEX(first, 0),
+                                run_length * NUM_RTT_CLASSES, 0);
+
+    // Only the first AVERAGE_BUFFER_SIZE slots of a flow are used, indexed by
+    // the lower FLOW_ID_BITS - 1 bits of the id as in the P4 program. Slots
+    // beyond the register do not exist on the device, writing them fails.
+    for (size_t i = run_start; i < run_end; i++){
+      uint64_t slot = (uint64_t)(ids[i] & ((1 << (FLOW_ID_BITS - 1)) - 1)) << AVERAGE_BUFFER_BITS;
+      if (slot + AVERAGE_BUFFER_SIZE > ring_buffer_size){
+        continue;
+      }
+      backend->registerWriteRange(*session, p4->rtt_ring_buffer.handle, slot, AVERAGE_BUFFER_SIZE, 0);
+      backend->registerWriteRange(*session, p4->rtt_ring_buffer_dup.handle, slot, AVERAGE_BUFFER_SIZE, 0);
+    }
+    run_start = run_end;
+  }
+
+  session->commitTransaction();
+}
+
+bool TofinoTables::resetCounters(const uint32_t* flow_ids, size_t count){
+  PROBE_SCOPE_ARG(PROBE_TABLE_RESET_COUNTERS, count);
+  if (count == 0){
+    return true;
+  }
+
+  std::unique_lock<std::mutex> lock(programming_mutex, std::try_to_lock);
+  if (!lock.owns_lock()){
+    return false;
+  }
+  session->beginTransaction();
+
+  size_t run_start = 0;
+  while (run_start < count){
+    size_t run_end = run_start + 1;
+    while (run_end < count && flow_ids[run_end] == flow_ids[run_end - 1] + 1){
+      run_end++;
+    }
+    uint32_t first = flow_ids[run_start];
+    uint32_t run_length = run_end - run_start;
+
+    backend->registerWriteRange(*session, p4->spin_measurement_counter.handle, first, run_length, 0);
+    backend->registerWriteRange(*session, p4->rtt_class_counter.handle, RTT_CLASS_INDEX(first, 0),
+                                run_length * NUM_RTT_CLASSES, 0);
+    run_start = run_end;
+  }
+
+  session->commitTransaction();
+  return true;
+}
@@ -10,42 +10,76 @@
 #pragma once
 #include <loguru.hpp>
 
-#include "switchd.hpp"
+#include <map>
+#include <mutex>
+#include <string>
 
-struct key_list_entry {
-  std::unique_ptr<bfrt::BfRtTableKey> key;
-};
-
-struct action_def {
-  bf_rt_id_t id;
-  std::unique_ptr<bfrt::BfRtTableData> data_ref;
-  std::map<std::string, bf_rt_id_t> data_fields;
+#include "dataplane_backend.hpp"
+#include "flow_table.hpp"
+#include "p4_bindings.hpp"
+#include "rtt_class_plan.hpp"
 
-  action_def(std::map<std::string, bf_rt_id_t> fields)
-          : data_fields(fields)
-  {}
-
-  action_def() {};
+struct flow_entry {
+  FlowTuple tuple;
+  uint32_t flow_id;
 };
 
-struct table_def {
-  const bfrt::BfRtTable* table;
+/*
+  Table programming and the per-flow register writes, on the programming
+  session. May be called from any thread; the readout does not share the
+  session, so it keeps its cadence while batches and transactions run.
+*/
+class TofinoTables {
+ private:
+  DataplaneBackend* backend;
+  DataplaneSession* session;
+  // Generated from bf-rt.json, ids are resolved once by initializeTables()
+  p4::Program* p4;
 
-  std::unique_ptr<bfrt::BfRtTableKey> key_ref;
+  // Batches and transactions on the programming session must not interleave,
+  // the flow manager, the control socket and the main loop all program tables
+  std::mutex programming_mutex;
 
-  std::map<std::string, bf_rt_id_t> keys;
-  std::map<std::string, action_def> actions;
-};
+  // Entries installed in rtt_class_table, by match key
+  std::map<uint64_t, rtt_class_range> installed_rtt_classes;
+  // Variant installed in reorder_protection_selector, 0 for none
+  int installed_reorder_protection;
+  // Cells of rtt_ring_buffer(_dup) as allocated by the device
+  size_t ring_buffer_size;
 
-class TofinoTables {
- private:
-  Switchd* switchd;
-  std::map<std::string, table_def> tables;
+  void RTTClassTableKey(const rtt_class_range& range, TableKey* key);
+  void RTTClassTableData(const rtt_class_range& range, TableData* data);
 
  public:
-  TofinoTables(Switchd* switchd);
+  TofinoTables(DataplaneBackend* backend, DataplaneSession* session, p4::Program* p4);
   void initializeTables();
   void enableQBitReorderProtection();
   void enableConsecReorderProtection();
+  // 0: none, 1: QBit variant, 2: Consec variant; adds, modifies or removes the quic_bit entry
+  void setReorderProtection(int variant);
+  int reorderProtection();
   void RTTClassTableSetEntry(uint16_t accumulator_min, uint16_t accumulator_max, uint16_t rtt_min, uint16_t rtt_max, uint8_t rtt_class);
-};
\ No newline at end of file
+
+  // Replaces the installed class ranges by `plan` with the minimal set of
+  // deletes/modifies/adds, committed as one atomic transaction
+  rtt_class_plan_diff applyRTTClassPlan(const std::vector<rtt_class_range>& plan);
+  std::vector<rtt_class_range> installedRTTClassPlan();
+
+  // Install/remove track_flow entries of flow_id_v4, all entries within one batch
+  void flowTableAddEntries(const flow_entry* entries, size_t count);
+  void flowTableDeleteEntries(const FlowTuple* tuples, size_t count);
+  size_t flowTableSize();
+
+  // Zeroes all per-flow register cells of the flows (delay trackers, first RTT
+  // protection, phase tracker, measurement counter and storage, ring buffers,
+  // accumulator, buffer index and class counters) in one transaction, so a
+  // reused flow id starts without the state of its previous flow. Consecutive
+  // ids are cleared as ranges. The struct-valued threshold phase registers are
+  // not in the bindings and keep their cells, as do the ring buffer slots of
+  // ids whose slot lies beyond the ring buffer registers.
+  void recycleFlows(const uint32_t* flow_ids, size_t count);
+  // Zeroes the measurement and class counters of the sorted flow ids in one transaction, runs of
+  // consecutive ids as ranges. Returns false without writing while another thread programs, so
+  // the readout never waits for it.
+  bool resetCounters(const uint32_t* flow_ids, size_t count);
+};
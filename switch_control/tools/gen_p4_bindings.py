@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Generates typed bindings for the tables and registers of a compiled P4
+program from its bf-rt.json:
+
+  ./gen_p4_bindings.py bf-rt.json p4_bindings.hpp
+
+Every table and register becomes a struct with its name and size as
+constants and flat members for the handles and ids, filled by resolve()
+once at startup. Members are named by the shortest unique suffix of the P4
+name (rtt_class_table, keys.current_rtt, actions.set_rtt_class), so code
+using a table, key, action or data field that no longer exists in the
+program fails to compile.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+CPP_KEYWORDS = {
+    "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class", "const",
+    "constexpr", "continue", "decltype", "default", "delete", "do", "double", "else", "enum", "explicit",
+    "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+    "namespace", "new", "noexcept", "not", "nullptr", "operator", "or", "private", "protected", "public",
+    "register", "return", "short", "signed", "sizeof", "static", "struct", "switch", "template", "this",
+    "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
+    "volatile", "while", "xor",
+}
+
+
+def identifier(name):
+    result = re.sub(r"[^A-Za-z0-9_]", "_", name)
+    if result[0].isdigit():
+        result = "_" + result
+    if result in CPP_KEYWORDS:
+        result += "_"
+    return result
+
+
+def short_names(names):
+    """Maps every dotted name to its shortest suffix that no other name ends with."""
+    result = {}
+    for name in names:
+        parts = name.split(".")
+        for length in range(1, len(parts) + 1):
+            suffix = ".".join(parts[-length:])
+            if not any(other != name and (other == suffix or other.endswith("." + suffix)) for other in names):
+                break
+        result[name] = identifier(suffix)
+    return result
+
+
+def program_name(table):
+    # bf-rt.json qualifies P4 objects with the pipeline name, BfRtInfo accepts the name without it
+    name = table["name"]
+    return name[len("pipe."):] if name.startswith("pipe.") else name
+
+
+def field_width(field):
+    return field.get("type", {}).get("width", 0)
+
+
+def generate_table(table, member, out):
+    key_names = short_names([key["name"] for key in table["key"]])
+    action_names = short_names([action["name"] for action in table["action_specs"]])
+
+    out.append("// %s" % program_name(table))
+    out.append("struct %s_binding {" % member)
+    out.append('  static constexpr const char* NAME = "%s";' % program_name(table))
+    out.append("  static constexpr uint32_t BFRT_ID = 0x%08x;" % table["id"])
+    out.append("  static constexpr size_t SIZE = %d;" % table["size"])
+    for action in table["action_specs"]:
+        for data in action["data"]:
+            out.append("  static constexpr unsigned %s_%s_WIDTH = %d;" % (
+                action_names[action["name"]].upper(), re.sub(r"[^A-Za-z0-9_]", "_", data["name"]).upper(),
+                field_width(data)))
+    out.append("")
+    out.append("  dp_handle_t handle;")
+    out.append("  struct {")
+    for key in table["key"]:
+        out.append("    dp_id_t %s;" % key_names[key["name"]])
+    out.append("  } keys;")
+    out.append("  struct {")
+    for action in table["action_specs"]:
+        out.append("    struct {")
+        out.append("      dp_id_t id;")
+        for data in action["data"]:
+            out.append("      dp_id_t %s;" % identifier(data["name"]))
+        out.append("    } %s;" % action_names[action["name"]])
+    out.append("  } actions;")
+    out.append("")
+    out.append("  void resolve(DataplaneBackend* backend) {")
+    out.append("    handle = backend->tableOpen(NAME);")
+    for key in table["key"]:
+        out.append('    keys.%s = backend->keyFieldId(handle, "%s");' % (key_names[key["name"]], key["name"]))
+    for action in table["action_specs"]:
+        action_member = "actions." + action_names[action["name"]]
+        out.append('    %s.id = backend->actionId(handle, "%s");' % (action_member, action["name"]))
+        for data in action["data"]:
+            out.append('    %s.%s = backend->dataFieldId(handle, %s.id, "%s");' % (
+                action_member, identifier(data["name"]), action_member, data["name"]))
+    out.append("  }")
+    out.append("};")
+    out.append("")
+
+
+def generate_register(table, member, out):
+    fields = [data["singleton"] for data in table["data"] if "singleton" in data]
+
+    out.append("// %s" % program_name(table))
+    out.append("struct %s_binding {" % member)
+    out.append('  static constexpr const char* NAME = "%s";' % program_name(table))
+    out.append("  static constexpr uint32_t BFRT_ID = 0x%08x;" % table["id"])
+    out.append("  static constexpr size_t SIZE = %d;" % table["size"])
+    out.append("  static constexpr unsigned WIDTH = %d;" % field_width(fields[0]))
+    out.append("")
+    out.append("  dp_handle_t handle;")
+    out.append("")
+    out.append("  void resolve(DataplaneBackend* backend) { handle = backend->registerOpen(NAME); }")
+    out.append("};")
+    out.append("")
+
+
+def generate(bfrt, source):
+    tables = [table for table in bfrt["tables"] if table["table_type"] in ("MatchAction_Direct", "Register")]
+    members = short_names([program_name(table) for table in tables])
+
+    out = [
+        "// Generated by tools/gen_p4_bindings.py from %s, do not edit." % source,
+        "",
+        "#pragma once",
+        "",
+        "#include <cstddef>",
+        "#include <cstdint>",
+        "",
+        '#include "dataplane_backend.hpp"',
+        "",
+        "namespace p4 {",
+        "",
+    ]
+
+    skipped = []
+    for table in tables:
+        member = members[program_name(table)]
+        if table["table_type"] == "MatchAction_Direct":
+            generate_table(table, member, out)
+        elif len(table["data"]) == 1 and "singleton" in table["data"][0]:
+            generate_register(table, member, out)
+        else:
+            # DataplaneBackend only reads and writes single-field registers
+            out.append("// %s: skipped, registers with struct values are not supported" % program_name(table))
+            out.append("")
+            skipped.append(table)
+
+    out.append("// All tables and registers of the program, resolve() the ones in use")
+    out.append("struct Program {")
+    for table in tables:
+        if table not in skipped:
+            member = members[program_name(table)]
+            out.append("  %s_binding %s;" % (member, member))
+    out.append("};")
+    out.append("")
+    out.append("}  // namespace p4")
+    return "\n".join(out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("bfrt_json")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    with open(args.bfrt_json) as file:
+        bfrt = json.load(file)
+    content = generate(bfrt, os.path.basename(args.bfrt_json))
+
+    os.makedirs(os.path.dirname(os.path.abspath(args.output)), exist_ok=True)
+    with open(args.output, "w") as file:
+        file.write(content)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""
+Sends synthetic measurement reports (mirror_header_h) on an interface, e.g.
+one end of a veth pair whose peer is passed to --report_interface:
+
+  ip link add veth0 type veth peer name veth1 && ip link set veth0 up && ip link set veth1 up
+  ./inject_reports.py --interface veth0 --flows 4 --count 10000
+
+With --pcap, the frames are written to a capture file instead, e.g., as input
+for --replay:
+
+  ./inject_reports.py --pcap reports.pcap --flows 1000 --count 1000
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+MIRROR_REPORT_TYPE = 0x2A
+MIN_FRAME_SIZE = 60
+
+
+def encode_report(flow_id, measurement_count, current_time, current_rtt, accumulator, class_counter, class_id):
+    first_word = (MIRROR_REPORT_TYPE << 26) | ((flow_id & 0x3FFFF) << 8) | (measurement_count & 0xFF)
+    return struct.pack("!IHHHBB", first_word, current_time & 0xFFFF, current_rtt & 0xFFFF,
+                       accumulator & 0xFFFF, class_counter & 0xFF, class_id & 0xFF)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--interface")
+    target.add_argument("--pcap", help="write a pcap file instead of sending")
+    parser.add_argument("--flows", type=int, default=1)
+    parser.add_argument("--count", type=int, default=1000, help="reports per flow")
+    parser.add_argument("--rtt", type=int, default=20)
+    parser.add_argument("--offset", type=int, default=0, help="padding in front of the report")
+    parser.add_argument("--interval_us", type=int, default=0)
+    args = parser.parse_args()
+
+    if args.pcap:
+        capture = open(args.pcap, "wb")
+        # Microsecond timestamps, Ethernet link type
+        capture.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, 65535, 1))
+        timestamp_us = int(time.time() * 1e6)
+
+        def send(frame):
+            capture.write(struct.pack("<IIII", timestamp_us // 1000000, timestamp_us % 1000000, len(frame), len(frame)))
+            capture.write(frame)
+    else:
+        sock = socket.socket(socket.AF_PACKET, socket.SOCK_RAW)
+        sock.bind((args.interface, 0))
+        send = sock.send
+
+    current_time = 0
+    for i in range(args.count):
+        for flow_id in range(args.flows):
+            rtt = args.rtt + flow_id
+            current_time = (current_time + rtt) & 0xFFFF
+            report = encode_report(flow_id, i + 1, current_time, rtt, 4 * rtt, i + 1, 1)
+            frame = bytes(args.offset) + report
+            send(frame + bytes(max(0, MIN_FRAME_SIZE - len(frame))))
+        if args.pcap:
+            timestamp_us += max(args.interval_us, 1)
+        elif args.interval_us:
+            time.sleep(args.interval_us / 1e6)
+
+    if args.pcap:
+        capture.close()
+        print("Wrote %d reports to %s" % (args.count * args.flows, args.pcap))
+    else:
+        print("Sent %d reports" % (args.count * args.flows))
+
+
+if __name__ == "__main__":
+    main()
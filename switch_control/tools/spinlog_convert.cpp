@@ -0,0 +1,147 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021 
+	
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+// Converts binary measurement logs of the control plane to CSV.
+
+#include <getopt.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+
+#include "../measurement_log.hpp"
+
+static void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [--output FILE] [--columns a,b,...] [--wallclock] [--info] LOG" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::string output_path;
+  std::set<std::string> selected_columns;
+  bool wallclock = false;
+  bool info = false;
+
+  static const struct option long_options[] = {
+      {"output", required_argument, 0, 'o'},
+      {"columns", required_argument, 0, 'c'},
+      {"wallclock", no_argument, 0, 'w'},
+      {"info", no_argument, 0, 'i'},
+      {0, 0, 0, 0},
+  };
+
+  while (true) {
+    const auto opt = getopt_long(argc, argv, "o:c:wi", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    }
+    switch (opt) {
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'c': {
+        std::istringstream names(optarg);
+        std::string name;
+        while (std::getline(names, name, ',')) {
+          selected_columns.insert(name);
+        }
+        break;
+      }
+      case 'w':
+        wallclock = true;
+        break;
+      case 'i':
+        info = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  BinaryLogReader reader;
+  std::string error;
+  if (!reader.open(argv[optind], &error)) {
+    std::cerr << argv[optind] << ": " << error << std::endl;
+    return 1;
+  }
+
+  const LogFileHeader& header = reader.header();
+  if (info) {
+    std::cout << "records: " << header.record_name << " (" << reader.recordCount() << " x " << header.record_size << " bytes)" << std::endl;
+    for (auto& column : reader.columns()) {
+      std::cout << "  " << column.name << ": u" << (8 << (column.type - 1));
+      if (column.count > 1) {
+        std::cout << "[" << (int)column.count << "]";
+      }
+      std::cout << " @" << column.offset << std::endl;
+    }
+    return 0;
+  }
+
+  FILE* output = stdout;
+  if (!output_path.empty()) {
+    output = fopen(output_path.c_str(), "w");
+    if (output == nullptr) {
+      std::cerr << output_path << ": " << strerror(errno) << std::endl;
+      return 1;
+    }
+  }
+  static char output_buffer[1 << 20];
+  setvbuf(output, output_buffer, _IOFBF, sizeof(output_buffer));
+
+  std::vector<LogColumn> columns;
+  for (auto& column : reader.columns()) {
+    if (selected_columns.empty() || selected_columns.count(column.name) != 0) {
+      columns.push_back(column);
+    }
+  }
+
+  // Header line, arrays are expanded to name_0, name_1, ...
+  bool first = true;
+  for (auto& column : columns) {
+    for (int element = 0; element < column.count; element++) {
+      fprintf(output, first ? "%s" : ",%s", column.name);
+      if (column.count > 1) {
+        fprintf(output, "_%d", element);
+      }
+      first = false;
+    }
+  }
+  fputc('\n', output);
+
+  int64_t wallclock_offset = header.realtime_ns - header.monotonic_ns;
+  for (size_t i = 0; i < reader.recordCount(); i++) {
+    const uint8_t* record = reader.record(i);
+    first = true;
+    for (auto& column : columns) {
+      for (int element = 0; element < column.count; element++) {
+        uint64_t value = BinaryLogReader::value(record, column, element);
+        if (wallclock && strcmp(column.name, "timestamp_ns") == 0) {
+          value += wallclock_offset;
+        }
+        fprintf(output, first ? "%lu" : ",%lu", value);
+        first = false;
+      }
+    }
+    fputc('\n', output);
+  }
+
+  if (output != stdout) {
+    fclose(output);
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+/*
+    Spin Tracker for Tofino
+    Copyright (c) 2021
+
+	  Author: Ike Kunze
+	  E-mail: kunze@comsys.rwth-aachen.de
+    Use of this source code is governed the MIT License.
+*/
+
+// Prints the flow state the control plane publishes with --stats_shm.
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../measurement_log.hpp"
+#include "../stats_shm.hpp"
+
+static void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [--flow ID] [--watch MS] [--wallclock] [--info] NAME" << std::endl;
+}
+
+static void printFlow(const StatsShmReader& reader, const StatsShmFlow& flow, bool wallclock, int64_t now_ns) {
+  int64_t updated_ns = wallclock ? reader.toRealtime(flow.updated_ns) : flow.updated_ns;
+  printf("%u,%ld,%ld,%u,%u,%u,%lu", flow.flow_id, (long)updated_ns, (long)((now_ns - flow.updated_ns) / 1000000), flow.rtt,
+         flow.rtt_accumulator, flow.class_id, (unsigned long)flow.measurement_total);
+  for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    printf(",%lu", (unsigned long)flow.class_total[rtt_class]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  long flow_id = -1;
+  int watch_ms = 0;
+  bool wallclock = false;
+  bool info = false;
+
+  static const struct option long_options[] = {
+      {"flow", required_argument, 0, 'f'},
+      {"watch", required_argument, 0, 'w'},
+      {"wallclock", no_argument, 0, 'r'},
+      {"info", no_argument, 0, 'i'},
+      {0, 0, 0, 0},
+  };
+
+  while (true) {
+    const auto opt = getopt_long(argc, argv, "f:w:ri", long_options, nullptr);
+    if (opt == -1) {
+      break;
+    }
+    switch (opt) {
+      case 'f':
+        flow_id = std::atol(optarg);
+        break;
+      case 'w':
+        watch_ms = std::atoi(optarg);
+        break;
+      case 'r':
+        wallclock = true;
+        break;
+      case 'i':
+        info = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  StatsShmReader reader;
+  std::string error;
+  if (!reader.open(argv[optind], &error)) {
+    std::cerr << argv[optind] << ": " << error << std::endl;
+    return 1;
+  }
+
+  if (info) {
+    std::cout << "writer pid: " << reader.writerPid() << std::endl;
+    std::cout << "capacity: " << reader.capacity() << " flows" << std::endl;
+    std::cout << "flow limit: " << reader.flowLimit() << std::endl;
+    std::cout << "updates: " << reader.updates() << std::endl;
+    std::cout << "last commit: " << (monotonicNanoseconds() - reader.commitTime()) / 1000000 << " ms ago" << std::endl;
+    return 0;
+  }
+
+  printf("flow_id,updated_ns,age_ms,rtt,rtt_accumulator,class_id,measurement_total");
+  for (int rtt_class = 0; rtt_class < NUM_RTT_CLASSES; rtt_class++) {
+    printf(",class_%d", rtt_class);
+  }
+  printf("\n");
+
+  // With --watch, one block of rows per period, separated by empty lines
+  while (true) {
+    StatsShmFlow flow;
+    int64_t now_ns = monotonicNanoseconds();
+    if (flow_id >= 0) {
+      if (reader.read((uint32_t)flow_id, &flow)) {
+        printFlow(reader, flow, wallclock, now_ns);
+      }
+    } else {
+      uint32_t flow_limit = reader.flowLimit();
+      for (uint32_t id = 0; id < flow_limit; id++) {
+        if (reader.read(id, &flow)) {
+          printFlow(reader, flow, wallclock, now_ns);
+        }
+      }
+    }
+
+    if (watch_ms <= 0) {
+      break;
+    }
+    printf("\n");
+    fflush(stdout);
+    usleep(watch_ms * 1000);
+  }
+  return 0;
+}